@@ -5,6 +5,7 @@
  */
 #include "common.h"
 #include "value.h"
+#include "struct_table.h"
 
 /* TODO(jcon): namespace */
 CoilStringFormat default_string_format = {
@@ -23,8 +24,8 @@ CoilStringFormat default_string_format = {
 /*
  * coil_init:
  *
- * Call this before using coil. Initializes the type system
- * and the coil none type.
+ * Call this before using coil. Initializes threads, the type system,
+ * the coil none type and the path hash seed.
  */
 void
 coil_init(void)
@@ -32,10 +33,17 @@ coil_init(void)
   static gboolean init_called = FALSE;
   g_assert(init_called == FALSE);
 
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  /* included files may be parsed on a thread pool */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
   g_type_init();
 //  g_type_init_with_debug_flags(G_TYPE_DEBUG_SIGNALS);
 
   coil_none_object = g_object_new(COIL_TYPE_NONE, NULL);
+  hash_path_seed_init();
   init_called = TRUE;
 }
 
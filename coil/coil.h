@@ -13,6 +13,8 @@
 #include "marshal.h"
 #include "parser_defs.h"
 #include "struct.h"
+#include "snapshot.h"
+#include "diff.h"
 #include "include.h"
 #include "link.h"
 
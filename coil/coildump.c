@@ -26,6 +26,7 @@ static gboolean brace_on_blank_line = FALSE;
 static gboolean commas_in_list = FALSE;
 static gboolean compact = FALSE;
 static gboolean compat = FALSE;
+static gboolean diff_files = FALSE;
 static gboolean expand_all = FALSE;
 static gboolean flatten = FALSE;
 static gboolean list_on_blank_line = FALSE;
@@ -34,6 +35,7 @@ static gboolean no_string_quotes = FALSE;
 static gboolean no_clobber_attributes = FALSE;
 static gboolean permissive = FALSE;
 static gboolean show_dependencies = FALSE;
+static gboolean show_stats = FALSE;
 static gboolean show_version = FALSE;
 
 static const GOptionEntry main_entries[] =
@@ -47,6 +49,9 @@ static const GOptionEntry main_entries[] =
   {"compat", 0, 0, G_OPTION_ARG_NONE, &compat,
       "Maintain compatability with previous coil versions.", NULL},
 
+  {"diff", 'd', 0, G_OPTION_ARG_NONE, &diff_files,
+      "Print the changes from the first input file to the second.", NULL},
+
   {"expand-all", 0, 0, G_OPTION_ARG_NONE, &expand_all,
       "Expand all values.", NULL},
 
@@ -145,6 +150,9 @@ static const GOptionEntry info_entries[] =
   {"show-dependency-tree", 0, 0, G_OPTION_ARG_NONE, &show_dependencies,
       "Show all files required by specified input coil files", NULL},
 
+  {"stats", 0, 0, G_OPTION_ARG_NONE, &show_stats,
+      "Show struct and path table statistics after expansion", NULL},
+
   { NULL }
 };
 
@@ -182,6 +190,17 @@ check_main_entries(GOptionContext *context,
     return FALSE;
   }
 
+  if (diff_files && (num_files != 2 || merge_files))
+  {
+    g_set_error_literal(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        "--diff should be specified with exactly two " \
+                        "input files and without --merge-files");
+
+    return FALSE;
+  }
+
   if (no_clobber_attributes && attributes == NULL)
   {
     g_set_error_literal(error,
@@ -474,6 +493,40 @@ error:
   g_propagate_error(error, internal_error);
 }
 
+static void
+print_diff(CoilStruct       *a,
+           CoilStruct       *b,
+           GString          *buffer,
+           CoilStringFormat *format,
+           GError          **error)
+{
+  g_return_if_fail(COIL_IS_STRUCT(a));
+  g_return_if_fail(COIL_IS_STRUCT(b));
+  g_return_if_fail(buffer);
+  g_return_if_fail(format);
+  g_return_if_fail(error == NULL || *error == NULL);
+
+  GError    *internal_error = NULL;
+  CoilPatch *patch;
+
+  patch = coil_struct_diff(a, b, &internal_error);
+
+  if (G_UNLIKELY(patch == NULL))
+    goto error;
+
+  coil_patch_build_string(patch, buffer, format, &internal_error);
+  coil_patch_free(patch);
+
+  if (G_UNLIKELY(internal_error))
+    goto error;
+
+  g_print("%s", buffer->str);
+  return;
+
+error:
+  g_propagate_error(error, internal_error);
+}
+
 static void
 init_string_format(CoilStringFormat *format)
 {
@@ -593,6 +646,58 @@ print_dependency_tree(const gchar *srcfile,
                   &format);
 }
 
+static void
+print_stats(const gchar *srcfile,
+            CoilStruct  *node,
+            GError     **error)
+{
+  g_return_if_fail(srcfile);
+  g_return_if_fail(COIL_IS_STRUCT(node));
+  g_return_if_fail(error == NULL || *error == NULL);
+
+  CoilStructStats  stats;
+  guint            i;
+
+  if (!coil_struct_expand_items(node, TRUE, error))
+    return;
+
+  coil_struct_get_stats(node, &stats);
+
+  g_printerr("---------------------------------------------------\n");
+  g_printerr("Statistics for %s:\n", srcfile);
+  g_printerr("  structs:        %u (%u prototypes pending)\n",
+             stats.structs, stats.prototypes);
+  g_printerr("  entries:        %u\n", stats.entries);
+  g_printerr("  links:          %u\n", stats.links);
+  g_printerr("  expressions:    %u\n", stats.expressions);
+  g_printerr("  includes:       %u\n", stats.includes);
+  g_printerr("  table entries:  %u (%u deleted slots)\n",
+             stats.table.size, stats.table.deleted);
+  g_printerr("  table buckets:  %u\n", stats.table.buckets);
+  g_printerr("  load factor:    %.3f\n",
+             stats.table.buckets
+               ? (gdouble)stats.table.size / stats.table.buckets : 0.0);
+  g_printerr("  table memory:   %" G_GSIZE_FORMAT " bytes\n",
+             stats.table.memory);
+
+  if (stats.table.region)
+    g_printerr("  region memory:  %" G_GSIZE_FORMAT " bytes\n",
+               stats.table.region);
+
+  g_printerr("  rehashes:       %u (%u grow, %u shrink)\n",
+             stats.table.rehashes, stats.table.grows, stats.table.shrinks);
+  g_printerr("  max chain:      %u\n", stats.table.max_chain);
+  g_printerr("  chain lengths: ");
+
+  for (i = 0; i < COIL_STRUCT_STATS_CHAINS; i++)
+    if (stats.table.chains[i])
+      g_printerr(" %u%s:%u", i,
+                 i == COIL_STRUCT_STATS_CHAINS - 1 ? "+" : "",
+                 stats.table.chains[i]);
+
+  g_printerr("\n");
+}
+
 static void
 print_files(void)
 {
@@ -633,7 +738,19 @@ print_files(void)
     }
   }
 
-  if (merge_files)
+  if (diff_files)
+  {
+    for (i = 0; i < nnodes; i++)
+      if (attrs && nodes[i]
+        && !coil_struct_merge_full(attrs, nodes[i], overwrite, FALSE, &error))
+        goto error;
+
+    if (nodes[0] == NULL || nodes[1] == NULL)
+      goto error;
+
+    print_diff(nodes[0], nodes[1], buffer, &format, &error);
+  }
+  else if (merge_files)
   {
     CoilStruct *root = coil_struct_new(NULL, NULL);
 
@@ -656,6 +773,9 @@ print_files(void)
       goto error;
 
     print_struct(root, buffer, &format, &error);
+
+    if (show_stats && error == NULL)
+      print_stats("merged files", root, &error);
   }
   else
     for (i = 0; i < nnodes; i++)
@@ -670,6 +790,12 @@ print_files(void)
 
       print_struct(nodes[i], buffer, &format, &error);
       g_string_truncate(buffer, 0);
+
+      if (G_UNLIKELY(error))
+        goto error;
+
+      if (show_stats && nodes[i])
+        print_stats(files[i], nodes[i], &error);
     }
 
   if (G_UNLIKELY(error))
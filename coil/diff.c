@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "diff.h"
+
+static const gchar change_marks[] = {'+', '-', '~'};
+
+static gboolean
+patch_add_change(GPtrArray      *changes,
+                 CoilChangeType  type,
+                 const GString  *path,
+                 const GValue   *old_value,
+                 const GValue   *new_value,
+                 GError        **error)
+{
+  CoilChange *change;
+  CoilPath   *p;
+
+  p = coil_path_new_len(path->str, path->len, error);
+  if (p == NULL)
+    return FALSE;
+
+  change = g_slice_new(CoilChange);
+  change->type = type;
+  change->path = p;
+  change->old_value = old_value ? coil_value_copy(old_value) : NULL;
+  change->new_value = new_value ? coil_value_copy(new_value) : NULL;
+
+  g_ptr_array_add(changes, change);
+
+  return TRUE;
+}
+
+static void
+change_free(gpointer data)
+{
+  CoilChange *change = data;
+
+  coil_path_unref(change->path);
+
+  if (change->old_value)
+    coil_value_free(change->old_value);
+
+  if (change->new_value)
+    coil_value_free(change->new_value);
+
+  g_slice_free(CoilChange, change);
+}
+
+static void
+prefix_append_key(GString        *prefix,
+                  const CoilPath *path)
+{
+  if (prefix->len > 0)
+    g_string_append_c(prefix, COIL_PATH_DELIM);
+
+  g_string_append_len(prefix, path->key, path->key_len);
+}
+
+/*
+ * Appends the changes turning a into b, their keys at prefix. Structs
+ * with the same content hash are taken as identical and not walked.
+ * Confirming them with coil_struct_equals() would cost as much as the
+ * walk it saves, so two different structs whose 32 bit hashes collide
+ * lose their changes from the patch.
+ */
+static gboolean
+diff_structs(CoilStruct *a,
+             CoilStruct *b,
+             GString    *prefix,
+             GPtrArray  *changes,
+             GError    **error)
+{
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value, *other;
+  GError         *internal_error = NULL;
+  guint           prefix_len = prefix->len;
+  guint           hash_a, hash_b;
+
+  if (!coil_struct_get_content_hash(a, &hash_a, error)
+    || !coil_struct_get_content_hash(b, &hash_b, error))
+    return FALSE;
+
+  if (hash_a == hash_b)
+    return TRUE;
+
+  /* keys of a removed from or modified in b */
+  coil_struct_iter_init(&it, a);
+
+  while (coil_struct_iter_next_expand(&it, &path, &value,
+                                      FALSE, &internal_error))
+  {
+    /* marked deleted */
+    if (value == NULL)
+      continue;
+
+    prefix_append_key(prefix, path);
+
+    other = coil_struct_lookup_key(b, path->key, path->key_len,
+                                   TRUE, &internal_error);
+
+    if (internal_error)
+      goto error;
+
+    if (other == NULL)
+    {
+      if (!patch_add_change(changes, COIL_CHANGE_REMOVED, prefix,
+                            value, NULL, &internal_error))
+        goto error;
+    }
+    else if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+      && G_VALUE_HOLDS(other, COIL_TYPE_STRUCT))
+    {
+      if (!diff_structs(COIL_STRUCT(g_value_get_object(value)),
+                        COIL_STRUCT(g_value_get_object(other)),
+                        prefix, changes, &internal_error))
+        goto error;
+    }
+    /* a struct replaced by a value or the other way around */
+    else if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+      || G_VALUE_HOLDS(other, COIL_TYPE_STRUCT)
+      || coil_value_compare(value, other, &internal_error) != 0)
+    {
+      if (internal_error
+        || !patch_add_change(changes, COIL_CHANGE_MODIFIED, prefix,
+                             value, other, &internal_error))
+        goto error;
+    }
+    else if (internal_error)
+      goto error;
+
+    g_string_truncate(prefix, prefix_len);
+  }
+
+  if (internal_error)
+    goto error;
+
+  /* keys of b missing from a */
+  coil_struct_iter_init(&it, b);
+
+  while (coil_struct_iter_next_expand(&it, &path, &value,
+                                      FALSE, &internal_error))
+  {
+    if (value == NULL)
+      continue;
+
+    other = coil_struct_lookup_key(a, path->key, path->key_len,
+                                   FALSE, &internal_error);
+
+    if (internal_error)
+      goto error;
+
+    if (other)
+      continue;
+
+    prefix_append_key(prefix, path);
+
+    if (!patch_add_change(changes, COIL_CHANGE_ADDED, prefix,
+                          NULL, value, &internal_error))
+      goto error;
+
+    g_string_truncate(prefix, prefix_len);
+  }
+
+  if (internal_error)
+    goto error;
+
+  return TRUE;
+
+error:
+  g_string_truncate(prefix, prefix_len);
+  g_propagate_error(error, internal_error);
+
+  return FALSE;
+}
+
+/*
+ * Returns the changes turning @a into @b, paths relative to both, or
+ * %NULL on error. Both are expanded. Subtrees of the same content hash
+ * are skipped without walking them, so comparing trees that mostly
+ * agree costs little more than the changes once their hashes are kept.
+ * The hashes are not confirmed, a collision between two different
+ * subtrees leaves their changes out of the patch.
+ * Values in the patch hold references to those of @a and @b.
+ */
+COIL_API(CoilPatch *)
+coil_struct_diff(CoilStruct *a,
+                 CoilStruct *b,
+                 GError    **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(a), NULL);
+  g_return_val_if_fail(COIL_IS_STRUCT(b), NULL);
+  g_return_val_if_fail(!coil_struct_is_prototype(a), NULL);
+  g_return_val_if_fail(!coil_struct_is_prototype(b), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilPatch *patch = g_new(CoilPatch, 1);
+  GString   *prefix = g_string_sized_new(128);
+
+  patch->changes = g_ptr_array_new_with_free_func(change_free);
+
+  if (a != b && !diff_structs(a, b, prefix, patch->changes, error))
+  {
+    coil_patch_free(patch);
+    patch = NULL;
+  }
+
+  g_string_free(prefix, TRUE);
+
+  return patch;
+}
+
+/* structs are copied expanded, they must not depend on the other tree */
+static gboolean
+patch_insert(CoilStruct     *self,
+             CoilPath       *path,
+             const GValue   *value,
+             GError        **error)
+{
+  GValue *copy;
+
+  if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+  {
+    CoilStruct *src = COIL_STRUCT(g_value_get_object(value));
+    CoilStruct *dst = coil_struct_new(error, NULL);
+
+    if (dst == NULL)
+      return FALSE;
+
+    if (!coil_struct_merge_full(src, dst, TRUE, TRUE, error))
+    {
+      g_object_unref(dst);
+      return FALSE;
+    }
+
+    coil_value_init(copy, COIL_TYPE_STRUCT, take_object, dst);
+  }
+  else
+    copy = coil_value_copy(value);
+
+  return coil_struct_insert_path(self, coil_path_ref(path), copy,
+                                 TRUE, error);
+}
+
+/*
+ * Applies @patch to @self in order, as in place of the struct diffed
+ * from. Added and modified values are set and removed keys deleted,
+ * keys already removed are ignored. Structs extending changed keys
+ * see the changes as with any insert or delete.
+ */
+COIL_API(gboolean)
+coil_struct_apply_patch(CoilStruct      *self,
+                        const CoilPatch *patch,
+                        GError         **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(!coil_struct_is_prototype(self), FALSE);
+  g_return_val_if_fail(patch, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  guint i;
+
+  for (i = 0; i < patch->changes->len; i++)
+  {
+    const CoilChange *change = g_ptr_array_index(patch->changes, i);
+
+    switch (change->type)
+    {
+      case COIL_CHANGE_ADDED:
+      case COIL_CHANGE_MODIFIED:
+        if (!patch_insert(self, change->path, change->new_value, error))
+          return FALSE;
+        break;
+
+      case COIL_CHANGE_REMOVED:
+        if (!coil_struct_delete_path(self, change->path, FALSE, error))
+          return FALSE;
+        break;
+
+      default:
+        g_assert_not_reached();
+    }
+  }
+
+  return TRUE;
+}
+
+COIL_API(guint)
+coil_patch_get_size(const CoilPatch *patch)
+{
+  g_return_val_if_fail(patch, 0);
+
+  return patch->changes->len;
+}
+
+/*
+ * One line per change, '+' added, '-' removed and '~' modified:
+ *
+ *   ~ a.b: 1 -> 2
+ */
+COIL_API(void)
+coil_patch_build_string(const CoilPatch  *patch,
+                        GString          *const buffer,
+                        CoilStringFormat *format,
+                        GError          **error)
+{
+  g_return_if_fail(patch);
+  g_return_if_fail(buffer);
+  g_return_if_fail(format);
+  g_return_if_fail(error == NULL || *error == NULL);
+
+  GError *internal_error = NULL;
+  guint   i;
+
+  for (i = 0; i < patch->changes->len; i++)
+  {
+    const CoilChange *change = g_ptr_array_index(patch->changes, i);
+
+    g_string_append_c(buffer, change_marks[change->type]);
+    g_string_append_c(buffer, ' ');
+    g_string_append_len(buffer, change->path->path, change->path->path_len);
+    g_string_append(buffer, ": ");
+
+    if (change->old_value)
+    {
+      coil_value_build_string(change->old_value, buffer,
+                              format, &internal_error);
+
+      if (internal_error)
+        goto error;
+
+      if (change->new_value)
+        g_string_append(buffer, " -> ");
+    }
+
+    if (change->new_value)
+    {
+      coil_value_build_string(change->new_value, buffer,
+                              format, &internal_error);
+
+      if (internal_error)
+        goto error;
+    }
+
+    g_string_append_c(buffer, '\n');
+  }
+
+  return;
+
+error:
+  g_propagate_error(error, internal_error);
+}
+
+COIL_API(void)
+coil_patch_free(CoilPatch *patch)
+{
+  g_return_if_fail(patch);
+
+  g_ptr_array_free(patch->changes, TRUE);
+  g_free(patch);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+#ifndef __COIL_DIFF_H
+#define __COIL_DIFF_H
+
+#include "struct.h"
+
+typedef struct _CoilChange CoilChange;
+typedef struct _CoilPatch  CoilPatch;
+
+typedef enum
+{
+  COIL_CHANGE_ADDED,
+  COIL_CHANGE_REMOVED,
+  COIL_CHANGE_MODIFIED,
+} CoilChangeType;
+
+struct _CoilChange
+{
+  CoilChangeType  type;
+  CoilPath       *path;      /* relative to the structs compared */
+  GValue         *old_value; /* NULL when added */
+  GValue         *new_value; /* NULL when removed */
+};
+
+struct _CoilPatch
+{
+  GPtrArray *changes; /* CoilChange, in the order of the structs compared */
+};
+
+G_BEGIN_DECLS
+
+CoilPatch *
+coil_struct_diff(CoilStruct *a,
+                 CoilStruct *b,
+                 GError    **error);
+
+gboolean
+coil_struct_apply_patch(CoilStruct      *self,
+                        const CoilPatch *patch,
+                        GError         **error);
+
+guint
+coil_patch_get_size(const CoilPatch *patch);
+
+void
+coil_patch_build_string(const CoilPatch  *patch,
+                        GString          *const buffer,
+                        CoilStringFormat *format,
+                        GError          **error);
+
+void
+coil_patch_free(CoilPatch *patch);
+
+G_END_DECLS
+
+#endif
@@ -19,6 +19,9 @@ G_DEFINE_ABSTRACT_TYPE(CoilExpandable, coil_expandable, G_TYPE_OBJECT);
 struct _CoilExpandablePrivate
 {
   GStaticMutex  expand_lock;
+
+  /* invalidated while expand_lock was held, see coil_expandable_invalidate */
+  gboolean      invalidate_pending : 1;
 };
 
 typedef enum
@@ -136,7 +139,12 @@ coil_expand(gpointer        object,
                       COIL_IS_STRUCT(self) ? COIL_STRUCT(self) : self->container,
                       "Cycle detected during expansion");
 
-    goto error;
+    /* the lock is held by the expansion we were reached from */
+    if (value_ptr)
+      *value_ptr = NULL;
+
+    g_propagate_error(error, internal_error);
+    return FALSE;
   }
 
   if (!klass->expand(self, &return_value, error))
@@ -151,6 +159,10 @@ coil_expand(gpointer        object,
 
   g_static_mutex_unlock(&priv->expand_lock);
 
+  /* something read while expanding changed, expand again next time */
+  if (G_UNLIKELY(priv->invalidate_pending))
+    coil_expandable_invalidate(self);
+
   if (value_ptr && return_value)
     *value_ptr = return_value;
 
@@ -167,6 +179,41 @@ error:
   return FALSE;
 }
 
+/*
+ * coil_expandable_invalidate: Expand @object again on next access
+ *
+ * Called when a value @object read while expanding changes. The readers
+ * of @object are invalidated in turn when its expanded value is dropped.
+ *
+ * @object: A CoilExpandable instance.
+ */
+COIL_API(void)
+coil_expandable_invalidate(gpointer object)
+{
+  g_return_if_fail(COIL_IS_EXPANDABLE(object));
+
+  CoilExpandable        *self = COIL_EXPANDABLE(object);
+  CoilExpandablePrivate *const priv = self->priv;
+  CoilExpandableClass   *klass = COIL_EXPANDABLE_GET_CLASS(self);
+
+  /* while expanding or invalidating, handled when the lock is released */
+  if (!g_static_mutex_trylock(&priv->expand_lock))
+  {
+    priv->invalidate_pending = TRUE;
+    return;
+  }
+
+  priv->invalidate_pending = FALSE;
+
+  if (klass->invalidate(self) && self->container)
+    coil_struct_invalidate_readers(self->container, self);
+
+  /* reached again through its own readers, a cycle already handled */
+  priv->invalidate_pending = FALSE;
+
+  g_static_mutex_unlock(&priv->expand_lock);
+}
+
 COIL_API(gboolean)
 coil_expand_value(const GValue  *value,
                   const GValue **return_value,
@@ -299,6 +346,13 @@ _expandable_is_expanded(gconstpointer self)
   return FALSE;
 }
 
+/* nothing is kept, readers of self read through it again */
+static gboolean
+_expandable_invalidate(gconstpointer self)
+{
+  return TRUE;
+}
+
 static gboolean
 _expandable_expand(gconstpointer  self,
                    const GValue **return_value,
@@ -358,6 +412,7 @@ coil_expandable_class_init(CoilExpandableClass *klass)
 
   klass->copy         = _expandable_copy;
   klass->is_expanded  = _expandable_is_expanded;
+  klass->invalidate   = _expandable_invalidate;
   klass->expand       = _expandable_expand;
   klass->equals       = _expandable_equals;
   klass->build_string = _expandable_build_string;
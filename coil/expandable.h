@@ -67,6 +67,9 @@ struct _CoilExpandableClass
 
   gboolean (*is_expanded) (gconstpointer self);
 
+  /* drop the expanded value, TRUE if readers of self need to know */
+  gboolean (*invalidate) (gconstpointer self);
+
   gboolean (*expand) (gconstpointer   self,
                       const GValue  **return_value,
                       GError        **error);
@@ -125,6 +128,9 @@ coil_expand_value(const GValue  *value,
                   gboolean       recursive,
                   GError       **error);
 
+void
+coil_expandable_invalidate(gpointer object);
+
 gboolean
 coil_expand(gpointer        object,
             const GValue  **return_value,
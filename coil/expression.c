@@ -22,6 +22,9 @@ struct _CoilExprPrivate
   GString   *expr;
   GValue    *expanded_value;
   gboolean   is_expanded : 1;
+
+  /* paths substituted are registered with coil_struct_add_reader() */
+  gboolean   is_reading : 1;
 };
 
 static gboolean
@@ -32,6 +35,22 @@ expr_is_expanded(gconstpointer object)
   return COIL_EXPR(object)->priv->is_expanded;
 }
 
+static gboolean
+expr_invalidate(gconstpointer object)
+{
+  g_return_val_if_fail(COIL_IS_EXPR(object), FALSE);
+
+  CoilExprPrivate *const priv = COIL_EXPR(object)->priv;
+
+  /* readers were told when the value was dropped before */
+  if (!priv->is_expanded)
+    return FALSE;
+
+  priv->is_expanded = FALSE;
+
+  return TRUE;
+}
+
 static void
 append_path_substitution(CoilExpr         *self,
                          GString          *buffer,
@@ -48,6 +67,10 @@ append_path_substitution(CoilExpr         *self,
   const GValue *value;
   GError       *internal_error = NULL;
 
+  if (!self->priv->is_reading
+    && !coil_struct_add_reader(container, path, len, self, error))
+    return;
+
   value = coil_struct_lookup(container, path, len, TRUE, &internal_error);
 
   if (G_UNLIKELY(internal_error))
@@ -121,10 +144,16 @@ expr_expand(gconstpointer  object,
     g_string_append_c(buffer, *s);
   }
 
-  coil_value_init(priv->expanded_value, G_TYPE_STRING,
-            take_string, g_string_free(buffer, FALSE));
+  /* expanded again after a path substituted changed, the value is
+   * updated in place as callers may hold on to it */
+  if (priv->expanded_value)
+    g_value_take_string(priv->expanded_value, g_string_free(buffer, FALSE));
+  else
+    coil_value_init(priv->expanded_value, G_TYPE_STRING,
+              take_string, g_string_free(buffer, FALSE));
 
   priv->is_expanded = TRUE;
+  priv->is_reading = TRUE;
 
 done:
   if (return_value)
@@ -378,6 +407,7 @@ coil_expr_class_init(CoilExprClass *klass)
   gobject_class->finalize = coil_expr_finalize;
 
   expandable_class->is_expanded = expr_is_expanded;
+  expandable_class->invalidate = expr_invalidate;
   expandable_class->expand = expr_expand;
   expandable_class->equals = expr_equals;
   expandable_class->build_string = expr_build_string;
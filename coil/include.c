@@ -61,14 +61,18 @@ typedef enum
 
 #if COIL_INCLUDE_CACHING
 
+/* files may be parsed on several threads, see coil_include_preload */
+G_LOCK_DEFINE_STATIC(namespace_cache);
 static GHashTable *namespace_cache = NULL;
 
+/* entries are kept alive by the objects in ref_count, all fields are
+ * read and written with namespace_cache held */
 typedef struct _CacheEntry
 {
     gchar        *filepath;
     CoilStruct   *namespace;
     time_t        m_time;
-    volatile gint ref_count;
+    guint         ref_count;
 } CacheEntry;
 
 static void
@@ -84,21 +88,36 @@ cache_entry_free(CacheEntry *entry)
 {
     g_return_if_fail(entry);
 
-    g_hash_table_remove(namespace_cache, entry->filepath);
     g_object_unref(entry->namespace);
     g_free(entry->filepath);
     g_free(entry);
 }
 
+/* call with namespace_cache held */
+static void
+cache_remove(CacheEntry *entry)
+{
+    if (g_hash_table_lookup(namespace_cache, entry->filepath) == entry)
+        g_hash_table_remove(namespace_cache, entry->filepath);
+}
+
 static void
 cache_gc_notify(gpointer data, GObject *object_address)
 {
     g_return_if_fail(data != NULL);
 
-    gchar *filepath = (gchar *)data;
-    CacheEntry *entry = g_hash_table_lookup(namespace_cache, filepath);
+    CacheEntry *entry = (CacheEntry *)data;
+    gboolean    last;
+
+    G_LOCK(namespace_cache);
+
+    last = (--entry->ref_count == 0);
+    if (last)
+        cache_remove(entry);
 
-    if (entry && g_atomic_int_dec_and_test(&entry->ref_count))
+    G_UNLOCK(namespace_cache);
+
+    if (last)
         cache_entry_free(entry);
 }
 
@@ -112,21 +131,28 @@ cache_save(GObject *object, const gchar *filepath, CoilStruct *namespace)
     CacheEntry *entry;
     struct stat st;
 
+    if (stat(filepath, &st) < 0)
+        return;
+
+    G_LOCK(namespace_cache);
+
     entry = g_hash_table_lookup(namespace_cache, filepath);
-    if (entry) {
-        g_atomic_int_inc(&entry->ref_count);
-        g_object_weak_ref(object, cache_gc_notify, entry->filepath);
-    }
-    else if (stat(filepath, &st) == 0) {
+
+    if (entry == NULL) {
         entry = g_new(CacheEntry, 1);
-        entry->ref_count = 1;
+        entry->ref_count = 0;
         entry->filepath = g_strdup(filepath);
         entry->namespace = g_object_ref(namespace);
         entry->m_time = st.st_mtime;
 
         g_hash_table_insert(namespace_cache, entry->filepath, entry);
-        g_object_weak_ref(object, cache_gc_notify, entry->filepath);
     }
+
+    entry->ref_count++;
+
+    G_UNLOCK(namespace_cache);
+
+    g_object_weak_ref(object, cache_gc_notify, entry);
 }
 
 static CoilStruct *
@@ -138,11 +164,21 @@ cache_load(gpointer _notify, const gchar *filepath, GError **error)
 
     GObject *notify = G_OBJECT(_notify);
     CacheEntry *entry;
-    CoilStruct *namespace;
+    CoilStruct *namespace = NULL, *old = NULL;
     struct stat st;
+    time_t m_time = 0;
+
+    G_LOCK(namespace_cache);
 
     entry = g_hash_table_lookup(namespace_cache, filepath);
-    if (entry == NULL) {
+    if (entry) {
+        namespace = g_object_ref(entry->namespace);
+        m_time = entry->m_time;
+    }
+
+    G_UNLOCK(namespace_cache);
+
+    if (namespace == NULL) {
         namespace = coil_parse_file(filepath, error);
         if (namespace) {
             cache_save(notify, filepath, namespace);
@@ -151,33 +187,72 @@ cache_load(gpointer _notify, const gchar *filepath, GError **error)
     }
 
     if (stat(filepath, &st) < 0) {
+        g_object_unref(namespace);
         g_set_error(error, COIL_ERROR, COIL_ERROR_INTERNAL,
                 "Cannot stat include file '%s'.", filepath);
         return NULL;
     }
 
-    if (st.st_mtime != entry->m_time) {
-        namespace = coil_parse_file(filepath, error);
+    if (st.st_mtime == m_time)
+        return namespace;
+
+    /* parse outside the lock, parsing may load includes itself */
+    g_object_unref(namespace);
+    namespace = coil_parse_file(filepath, error);
+
+    G_LOCK(namespace_cache);
+
+    /* the entry may have gone or been replaced meanwhile */
+    entry = g_hash_table_lookup(namespace_cache, filepath);
+
+    if (entry && entry->m_time != st.st_mtime) {
         if (namespace == NULL) {
-            /* parse error */
-            cache_entry_free(entry);
-            return NULL;
+            /* parse error, the entry goes when its last include does */
+            g_hash_table_remove(namespace_cache, filepath);
+        }
+        else {
+            old = entry->namespace;
+            entry->namespace = g_object_ref(namespace);
+            entry->m_time = st.st_mtime;
         }
-        g_object_unref(entry->namespace);
-        entry->namespace = namespace;
-        entry->m_time = st.st_mtime;
     }
-    return g_object_ref(entry->namespace);
+
+    G_UNLOCK(namespace_cache);
+
+    if (old)
+        g_object_unref(old);
+
+    return namespace;
 }
+
+static gboolean
+cache_contains(const gchar *filepath)
+{
+    gboolean result;
+
+    G_LOCK(namespace_cache);
+    result = g_hash_table_lookup(namespace_cache, filepath) != NULL;
+    G_UNLOCK(namespace_cache);
+
+    return result;
+}
+
 #define CACHE_INIT() cache_init()
 
 #define CACHE_LOAD(notify, path, err) \
     cache_load(notify, path, err)
 
+#define CACHE_SAVE(notify, path, namespace) \
+    cache_save(notify, path, namespace)
+
+#define CACHE_CONTAINS(path) cache_contains(path)
+
 #else
 
 #define CACHE_INIT()
 #define CACHE_LOAD(notify, path, err) coil_parse_file(path, err)
+#define CACHE_SAVE(notify, path, namespace)
+#define CACHE_CONTAINS(path) FALSE
 
 #endif
 
@@ -497,6 +572,124 @@ error:
     return FALSE;
 }
 
+typedef struct _PreloadJob
+{
+    CoilInclude *include;
+    const gchar *filepath;
+    CoilStruct  *namespace;
+} PreloadJob;
+
+static void
+preload_file(gpointer data, gpointer unused)
+{
+    PreloadJob *job = (PreloadJob *)data;
+    GError *internal_error = NULL;
+
+    job->namespace = coil_parse_file(job->filepath, &internal_error);
+
+    /* the include parses the file again and reports the error */
+    if (internal_error) {
+        if (job->namespace)
+            g_object_unref(job->namespace);
+
+        job->namespace = NULL;
+        g_error_free(internal_error);
+    }
+}
+
+/**
+ * coil_include_preload: Parse the files of @includes on a thread pool
+ *
+ * Includes that are expanded or loaded already, whose file name is
+ * computed by an expression or link, or whose file is in @files are
+ * skipped. Every other file is parsed once on up to @max_threads
+ * threads (-1 for no limit) and handed to the first include naming it,
+ * so expanding the include later only merges. Parse errors are left
+ * for the expansion to report. The paths of the parsed files are added
+ * to @files.
+ *
+ * Returns: the number of files parsed or -1 on error
+ */
+COIL_API(gint)
+coil_include_preload(GPtrArray   *includes,
+                     GHashTable  *files,
+                     gint         max_threads,
+                     GError     **error)
+{
+    g_return_val_if_fail(includes != NULL, -1);
+    g_return_val_if_fail(files != NULL, -1);
+    g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+    GThreadPool *pool;
+    PreloadJob *jobs;
+    GError *internal_error = NULL;
+    guint i, n = 0;
+    gint loaded = 0;
+
+    jobs = g_new(PreloadJob, MAX(includes->len, 1));
+
+    for (i = 0; i < includes->len; i++) {
+        CoilInclude *include = COIL_INCLUDE(g_ptr_array_index(includes, i));
+        CoilIncludePrivate *priv = include->priv;
+        const gchar *filepath;
+
+        if (priv->is_expanded || priv->namespace
+            || G_VALUE_HOLDS(priv->file_value, COIL_TYPE_EXPANDABLE))
+            continue;
+
+        filepath = expand_file_value(include, &internal_error);
+        if (filepath == NULL) {
+            g_clear_error(&internal_error);
+            continue;
+        }
+
+        if (g_hash_table_lookup_extended(files, filepath, NULL, NULL)
+            || CACHE_CONTAINS(filepath))
+            continue;
+
+        g_hash_table_insert(files, g_strdup(filepath), NULL);
+
+        jobs[n].include = include;
+        jobs[n].filepath = filepath;
+        jobs[n].namespace = NULL;
+        n++;
+    }
+
+    if (n == 0) {
+        g_free(jobs);
+        return 0;
+    }
+
+    pool = g_thread_pool_new(preload_file, NULL, max_threads, FALSE, error);
+    if (pool == NULL) {
+        g_free(jobs);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+        g_thread_pool_push(pool, &jobs[i], NULL);
+
+    /* wait for every file */
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    for (i = 0; i < n; i++) {
+        CoilInclude *include = jobs[i].include;
+
+        if (jobs[i].namespace == NULL)
+            continue;
+
+        CACHE_SAVE(G_OBJECT(coil_struct_get_root(
+                       COIL_EXPANDABLE(include)->container)),
+                   jobs[i].filepath, jobs[i].namespace);
+
+        include->priv->namespace = jobs[i].namespace;
+        loaded++;
+    }
+
+    g_free(jobs);
+    return loaded;
+}
+
 COIL_API(gboolean)
 coil_include_equals(gconstpointer   e1,
                     gconstpointer   e2,
@@ -83,6 +83,12 @@ CoilStruct *
 coil_include_dup_root_node(CoilInclude *self,
                            GError     **error);
 
+gint
+coil_include_preload(GPtrArray   *includes,
+                     GHashTable  *files,
+                     gint         max_threads,
+                     GError     **error);
+
 G_END_DECLS
 
 #endif
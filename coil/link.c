@@ -20,6 +20,13 @@ G_DEFINE_TYPE(CoilLink, coil_link, COIL_TYPE_EXPANDABLE);
 struct _CoilLinkPrivate
 {
   CoilPath   *path;
+
+  /* target_path resolved from the container, target_path stays as
+   * written so copies resolve it from their own container */
+  CoilPath   *resolved_path;
+
+  /* target is registered with coil_struct_add_reader() */
+  gboolean    is_reading : 1;
 };
 
 typedef enum
@@ -40,6 +47,37 @@ coil_link_get_path(const CoilLink *self)
   return priv->path;
 }
 
+/**
+ * The absolute path of the target of @self, resolved from its container
+ * the first time. The path belongs to @self.
+ */
+COIL_API(CoilPath *)
+coil_link_resolve_path(CoilLink *self,
+                       GError  **error)
+{
+  g_return_val_if_fail(COIL_IS_LINK(self), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilLinkPrivate *const priv = self->priv;
+  CoilStruct      *container = COIL_EXPANDABLE(self)->container;
+  const CoilPath  *container_path;
+
+  if (priv->resolved_path)
+    return priv->resolved_path;
+
+  if (COIL_PATH_IS_ABSOLUTE(self->target_path))
+    return self->target_path;
+
+  g_return_val_if_fail(container, NULL);
+  container_path = coil_struct_get_path(container);
+  g_return_val_if_fail(container_path, NULL);
+
+  priv->resolved_path = coil_path_resolve(self->target_path,
+                                          container_path, error);
+
+  return priv->resolved_path;
+}
+
 static gboolean
 link_is_expanded(gconstpointer link)
 {
@@ -56,18 +94,17 @@ link_expand(gconstpointer   link,
 
   CoilLink        *const self = COIL_LINK(link);
   CoilStruct      *container = COIL_EXPANDABLE(link)->container;
-  const CoilPath  *container_path;
+  CoilPath        *target_path;
   const GValue    *value;
   GError          *internal_error = NULL;
 
   g_return_val_if_fail(container, FALSE);
-  container_path = coil_struct_get_path(container);
-  g_return_val_if_fail(container_path, FALSE);
 
-  if (!coil_path_resolve_into(&self->target_path, container_path, error))
+  target_path = coil_link_resolve_path(self, error);
+  if (target_path == NULL)
     goto error;
 
-  value = coil_struct_lookup_path(container, self->target_path,
+  value = coil_struct_lookup_path(container, target_path,
                                   FALSE, &internal_error);
 
   if (G_UNLIKELY(value == NULL))
@@ -77,13 +114,25 @@ link_expand(gconstpointer   link,
     else
       coil_link_error(error, self,
           "target path '%s' does not exist.",
-          self->target_path->path);
+          target_path->path);
 
     goto error;
   }
 
   g_assert(G_IS_VALUE(value));
 
+  /* the target path never changes once resolved */
+  if (!self->priv->is_reading)
+  {
+    if (!coil_struct_add_reader(container,
+                                target_path->path,
+                                target_path->path_len,
+                                self, error))
+      goto error;
+
+    self->priv->is_reading = TRUE;
+  }
+
   if (return_value)
     *return_value = value;
 
@@ -289,6 +338,9 @@ coil_link_finalize(GObject *object)
   if (self->target_path)
     coil_path_unref(self->target_path);
 
+  if (priv->resolved_path)
+    coil_path_unref(priv->resolved_path);
+
   if (priv->path)
     coil_path_unref(priv->path);
 
@@ -310,6 +362,12 @@ coil_link_set_property(GObject      *object,
       if (self->target_path)
         coil_path_unref(self->target_path);
       self->target_path = g_value_dup_boxed(value);
+
+      if (priv->resolved_path)
+      {
+        coil_path_unref(priv->resolved_path);
+        priv->resolved_path = NULL;
+      }
       break;
 
     case PROP_PATH:
@@ -62,6 +62,10 @@ coil_link_new_valist(const gchar *first_property_name,
 const CoilPath *
 coil_link_get_path(const CoilLink *link);
 
+CoilPath *
+coil_link_resolve_path(CoilLink *self,
+                       GError  **error);
+
 
 gboolean
 coil_link_equals(gconstpointer self,
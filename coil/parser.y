@@ -33,6 +33,10 @@
 #define PUSH_CONTAINER(parser, c) \
   g_queue_push_head(&(parser)->containers, (c))
 
+/* values are allocated from the region of the root, if any */
+#define PARSER_VALUE_INIT(parser, v_ptr, type, v_func, ptr) \
+  coil_value_init_in((parser)->region, v_ptr, type, v_func, ptr)
+
 #define parser_error(parser, format, args...) \
   g_set_error(&parser->error, \
               COIL_ERROR, \
@@ -199,19 +203,16 @@ static gboolean
 parser_push_container(CoilParser *parser)
 {
   CoilStruct     *new_container, *container = PEEK_CONTAINER(parser);
-  const CoilPath *path = parser->path;
 
-  new_container = coil_struct_create_containers_fast(container,
-                                                     path->path, path->path_len,
+  new_container = coil_struct_create_containers_path(container,
+                                                     parser->path,
                                                      FALSE, FALSE,
                                                      &parser->error);
 
   if (new_container == NULL)
     return FALSE;
 
-  g_object_set(new_container,
-               "accumulate", TRUE,
-               NULL);
+  coil_struct_begin_batch(new_container);
 
   PUSH_CONTAINER(parser, new_container);
 
@@ -223,9 +224,7 @@ parser_pop_container(CoilParser *parser)
 {
   CoilStruct *container = POP_CONTAINER(parser);
 
-  g_object_set(container,
-               "accumulate", FALSE,
-               NULL);
+  coil_struct_end_batch(container);
 
   g_object_unref(container);
 }
@@ -258,7 +257,9 @@ parser_handle_include(CoilParser   *parser,
         return FALSE;
     }
 
-    file_value = (GValue *)include_args->data;
+    /* the include frees its file value, hand it a copy of its own */
+    file_value = coil_value_copy((GValue *)include_args->data);
+    coil_value_free_in(parser->region, include_args->data);
     include_args = g_list_delete_link(include_args, include_args);
 
     n = g_list_length(include_args);
@@ -267,6 +268,7 @@ parser_handle_include(CoilParser   *parser,
     for (i = 0; i < n; i++) {
         import = (GValue *)include_args->data;
         imports = g_value_array_insert(imports, i, import);
+        coil_value_free_in(parser->region, import);
         include_args = g_list_delete_link(include_args, include_args);
     }
 
@@ -397,8 +399,8 @@ parser_has_errors(CoilParser *const parser)
 %destructor { g_string_free($$, TRUE); } <gstring>
 %destructor { coil_path_unref($$); } <path>
 %destructor { coil_path_list_free($$); } <path_list>
-%destructor { coil_value_free($$); } <value>
-%destructor { coil_value_list_free($$); } <value_list>
+%destructor { coil_value_free_in(YYCTX->region, $$); } <value>
+%destructor { coil_value_list_free_in(YYCTX->region, $$); } <value_list>
 %destructor { g_value_array_free($$); } <value_array>
 
 %start coil
@@ -630,12 +632,12 @@ link_path
     if (link == NULL)
       YYERROR;
 
-    coil_value_init($$, COIL_TYPE_LINK, take_object, link);
+    PARSER_VALUE_INIT(YYCTX, $$, COIL_TYPE_LINK, take_object, link);
   }
 ;
 
 pathstring_value
-  : pathstring { coil_value_init($$, COIL_TYPE_PATH, take_boxed, $1); }
+  : pathstring { PARSER_VALUE_INIT(YYCTX, $$, COIL_TYPE_PATH, take_boxed, $1); }
 ;
 
 pathstring
@@ -686,6 +688,9 @@ value_list
         g_value_array_insert($$, i, value);
         list = g_list_previous(list);
     }
+
+    /* the array holds copies */
+    coil_value_list_free_in(YYCTX->region, $2);
   }
 ;
 
@@ -709,7 +714,7 @@ value
   : primative  { $$ = $1; }
   | string     { $$ = $1; }
   | link       { $$ = $1; }
-  | value_list { coil_value_init($$, COIL_TYPE_LIST, take_boxed, $1); }
+  | value_list { PARSER_VALUE_INIT(YYCTX, $$, COIL_TYPE_LIST, take_boxed, $1); }
 ;
 
 path
@@ -721,17 +726,17 @@ path
 
 string
   : STRING_LITERAL
-  { coil_value_init($$, G_TYPE_GSTRING, take_boxed, $1); }
+  { PARSER_VALUE_INIT(YYCTX, $$, G_TYPE_GSTRING, take_boxed, $1); }
   | STRING_EXPRESSION
-  { coil_value_init($$, COIL_TYPE_EXPR, take_object, coil_expr_new($1, NULL)); }
+  { PARSER_VALUE_INIT(YYCTX, $$, COIL_TYPE_EXPR, take_object, coil_expr_new($1, NULL)); }
 ;
 
 primative
-  : NONE_SYM  { coil_value_init($$, COIL_TYPE_NONE, set_object, coil_none_object); }
-  | TRUE_SYM  { coil_value_init($$, G_TYPE_BOOLEAN, set_boolean, TRUE); }
-  | FALSE_SYM { coil_value_init($$, G_TYPE_BOOLEAN, set_boolean, FALSE); }
-  | INTEGER   { coil_value_init($$, G_TYPE_LONG, set_long, $1); }
-  | DOUBLE    { coil_value_init($$, G_TYPE_DOUBLE, set_double, $1); }
+  : NONE_SYM  { PARSER_VALUE_INIT(YYCTX, $$, COIL_TYPE_NONE, set_object, coil_none_object); }
+  | TRUE_SYM  { PARSER_VALUE_INIT(YYCTX, $$, G_TYPE_BOOLEAN, set_boolean, TRUE); }
+  | FALSE_SYM { PARSER_VALUE_INIT(YYCTX, $$, G_TYPE_BOOLEAN, set_boolean, FALSE); }
+  | INTEGER   { PARSER_VALUE_INIT(YYCTX, $$, G_TYPE_LONG, set_long, $1); }
+  | DOUBLE    { PARSER_VALUE_INIT(YYCTX, $$, G_TYPE_DOUBLE, set_double, $1); }
 ;
 
 %%
@@ -837,6 +842,8 @@ coil_parser_init(CoilParser *const parser,
                                              NULL, g_object_unref);
 
   parser->root = coil_struct_new(NULL, NULL);
+  parser->region = coil_struct_get_region(parser->root);
+  coil_struct_set_loading(parser->root, TRUE);
   parser->scanner = scanner;
 
   g_object_ref(parser->root);
@@ -859,6 +866,7 @@ coil_parser_finish(CoilParser *parser,
   CoilStruct *container;
 
   parser_post_processing(parser);
+  coil_struct_set_loading(parser->root, FALSE);
 
   g_signal_remove_emission_hook(g_signal_lookup("create", COIL_TYPE_STRUCT),
                                 parser->prototype_hook_id);
@@ -45,6 +45,7 @@ typedef struct _CoilParser
 {
   const gchar *filepath;
   CoilStruct  *root;
+  CoilRegion  *region;
   CoilPath    *path;
   gulong       prototype_hook_id;
   GQueue       containers;
@@ -11,16 +11,39 @@
 #include "strings_extra.h"
 #include "error.h"
 #include "path.h"
+#include "struct_table.h"
 
 CoilPath _coil_root_path = {
   (gchar *)COIL_ROOT_PATH,
-  (guint8)COIL_ROOT_PATH_LEN,
+  COIL_ROOT_PATH_LEN,
   (gchar *)NULL,
-  (guint8)0,
+  0,
   (COIL_STATIC_PATH |
    COIL_PATH_IS_ROOT |
    COIL_PATH_IS_ABSOLUTE),
   1,
+  NULL,
+  0,
+  NULL,
+};
+
+/*
+ * Absolute paths are interned so equal paths share one object. Interned
+ * paths are never changed in place and are removed from the table when
+ * their last reference is dropped.
+ */
+G_LOCK_DEFINE_STATIC(path_intern);
+static GHashTable *path_intern_table = NULL;
+
+/*
+ * Prefix hashes of an absolute path. Entry i describes the prefix holding
+ * the first i keys, so entry 0 is @root and entry n_keys is the path.
+ */
+struct _CoilPathPrefixes
+{
+  guint   n_keys;
+  guint  *lens;
+  guint   hashes[];
 };
 
 /* TODO: proper error handling */
@@ -33,6 +56,20 @@ path_alloc(void)
   return path;
 }
 
+/*
+ * Link @p to the path of its container so hashes and prefixes of @p are
+ * derived from those already cached in the container. Only interned
+ * containers are linked since they can not change under @p. The string
+ * of @p is still built in full, readers use path->path directly.
+ */
+static void
+path_set_container(CoilPath       *p,
+                   const CoilPath *container)
+{
+  if (container->flags & (COIL_PATH_IS_INTERNED | COIL_PATH_IS_ROOT))
+    p->container = coil_path_ref((CoilPath *)container);
+}
+
 static void
 pathval_to_strval(const GValue *pathval,
                         GValue *strval)
@@ -123,13 +160,14 @@ key_length_error(const gchar *key,
               (gint)(COIL_PATH_LEN - COIL_ROOT_PATH_LEN - 1));
 }
 
-COIL_API(CoilPath *)
-coil_path_take_strings(gchar         *path,
-                       guint8         path_len,
-                       gchar         *key,
-                       guint8         key_len,
-                       CoilPathFlags  flags)
-
+/* build a path, with @scan of @path when @key is NULL */
+static CoilPath *
+path_take_scanned(gchar          *path,
+                  guint           path_len,
+                  gchar          *key,
+                  guint           key_len,
+                  CoilPathFlags   flags,
+                  const PathScan *scan)
 {
   g_return_val_if_fail(path, NULL);
   g_return_val_if_fail(*path, NULL);
@@ -167,11 +205,13 @@ coil_path_take_strings(gchar         *path,
     p->flags |= COIL_PATH_IS_ABSOLUTE;
     if (key == NULL)
     {
-      p->key = memrchr(p->path + COIL_ROOT_PATH_LEN,
-                       COIL_PATH_DELIM,
-                       p->path_len - COIL_ROOT_PATH_LEN);
-      p->key_len = p->path_len - (++p->key - p->path);
+      p->key = p->path + scan->key_offset;
+      p->key_len = p->path_len - scan->key_offset;
       p->flags |= COIL_STATIC_KEY;
+
+      if (*path == COIL_SPECIAL_CHAR)
+        p->hash = scan->hash;
+
       return p;
     }
     goto have_key;
@@ -185,15 +225,8 @@ have_key:
   }
   else
   {
-    p->key = memrchr(path, COIL_PATH_DELIM, path_len);
-    if (p->key == NULL)
-    {
-      g_assert(!(p->flags & COIL_PATH_IS_ABSOLUTE));
-      p->key = p->path;
-      p->key_len = p->path_len;
-    }
-    else
-      p->key_len = p->path_len - (++p->key - p->path);
+    p->key = p->path + scan->key_offset;
+    p->key_len = p->path_len - scan->key_offset;
   }
 
   if (p->key >= p->path && p->key <= p->path + p->path_len)
@@ -205,6 +238,75 @@ have_key:
   return p;
 }
 
+/* absolute paths are hashed while finding the key */
+#define PATH_SCAN_FLAGS(path) \
+  ((*(path) == COIL_SPECIAL_CHAR) ? PATH_SCAN_HASH : 0)
+
+COIL_API(CoilPath *)
+coil_path_take_strings(gchar         *path,
+                       guint          path_len,
+                       gchar         *key,
+                       guint          key_len,
+                       CoilPathFlags  flags)
+{
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(*path, NULL);
+  g_return_val_if_fail(path_len > 0, NULL);
+
+  PathScan scan;
+
+  if (key == NULL && !(flags & COIL_PATH_IS_ROOT))
+    path_scan(&scan, 0, path, path_len, PATH_SCAN_FLAGS(path));
+
+  return path_take_scanned(path, path_len, key, key_len, flags, &scan);
+}
+
+static void
+path_invalid_error(const gchar *path,
+                   guint        path_len,
+                   GError     **error)
+{
+  g_set_error(error,
+              COIL_ERROR,
+              COIL_ERROR_PATH,
+              "The path '%.*s' is invalid or contains invalid characters.",
+              path_len, path);
+}
+
+/**
+ * Validate @path and take it as coil_path_take_strings() would, scanning
+ * @path once for both. @path is not taken on error.
+ */
+COIL_API(CoilPath *)
+coil_path_take_checked(gchar          *path,
+                       guint           path_len,
+                       CoilPathFlags   flags,
+                       GError        **error)
+{
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(path_len > 0, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  PathScan scan;
+
+  if (path_len > COIL_PATH_LEN)
+  {
+    path_length_error(path, path_len, error);
+    return NULL;
+  }
+
+  path_scan(&scan, 0, path, path_len,
+            PATH_SCAN_FLAGS(path) | PATH_SCAN_VALIDATE);
+
+  if (!scan.valid)
+  {
+    path_invalid_error(path, path_len, error);
+    return NULL;
+  }
+
+  return path_take_scanned(path, path_len, NULL, 0, flags, &scan);
+}
+
 COIL_API(CoilPath *)
 coil_path_new_len(const gchar  *buffer,
                   guint         buf_len,
@@ -213,19 +315,15 @@ coil_path_new_len(const gchar  *buffer,
   g_return_val_if_fail(buffer || *buffer, NULL);
   g_return_val_if_fail(buf_len > 0, NULL);
 
-  if (!coil_check_path(buffer, buf_len, error))
-    return NULL;
+  gchar    *path = g_strndup(buffer, buf_len);
+  CoilPath *p;
 
-  if (buffer[0] == COIL_PATH_DELIM
-     && buffer[1] != COIL_PATH_DELIM)
-  {
-    /** ignore single leading . for relative path */
-    buffer++;
-    buf_len--;
-  }
+  /* a single leading . never validates so there is nothing to strip */
+  p = coil_path_take_checked(path, buf_len, 0, error);
+  if (p == NULL)
+    g_free(path);
 
-  buffer = g_strndup(buffer, buf_len);
-  return coil_path_take_strings((gchar *)buffer, buf_len, NULL, 0, 0);
+  return p;
 }
 
 COIL_API(CoilPath *)
@@ -247,6 +345,11 @@ coil_path_copy(const CoilPath *p)
   copy->key = &copy->path[p->path_len - p->key_len];
   copy->key_len = p->key_len;
   copy->flags = (p->flags & ~COIL_STATIC_PATH) | COIL_STATIC_KEY;
+  copy->flags &= ~COIL_PATH_IS_INTERNED;
+  copy->hash = p->hash;
+
+  if (p->container)
+    copy->container = coil_path_ref(p->container);
 
   return copy;
 }
@@ -263,6 +366,10 @@ coil_path_equal(const CoilPath *a,
     || a->flags & b->flags & COIL_PATH_IS_ROOT)
     return TRUE;
 
+  /* equal interned paths are the same object */
+  if (a->flags & b->flags & COIL_PATH_IS_INTERNED)
+    return FALSE;
+
   if (a->path_len != b->path_len
     || a->key_len != b->key_len
       /* check same relativity */
@@ -288,12 +395,12 @@ coil_path_compare(const CoilPath *a,
 }
 
 
-COIL_API(void)
-coil_path_free(CoilPath *p)
+/* free @p and return its container reference for the caller to drop */
+static CoilPath *
+path_free_internal(CoilPath *p)
 {
-  g_return_if_fail(p);
-
   CoilPathFlags flags = ~p->flags;
+  CoilPath     *container = p->container;
 
   if (flags & COIL_STATIC_KEY)
     g_free(p->key);
@@ -301,7 +408,55 @@ coil_path_free(CoilPath *p)
   if (flags & COIL_STATIC_PATH)
     g_free(p->path);
 
+  g_free(p->prefixes);
   g_free(p);
+
+  return container;
+}
+
+/* drop a reference, TRUE if it was the last and @p may be freed */
+static gboolean
+path_release(CoilPath *p)
+{
+  gint ref_count;
+
+  if (!COIL_PATH_IS_INTERNED(p))
+    return g_atomic_int_dec_and_test(&p->ref_count);
+
+  /* drop any reference but the last without the lock */
+  do
+  {
+    ref_count = g_atomic_int_get(&p->ref_count);
+
+    if (ref_count == 1)
+      break;
+  } while (!g_atomic_int_compare_and_exchange(&p->ref_count,
+                                              ref_count, ref_count - 1));
+
+  if (ref_count > 1)
+    return FALSE;
+
+  /* coil_path_intern may take a new reference until p leaves the table */
+  G_LOCK(path_intern);
+
+  if (g_atomic_int_dec_and_test(&p->ref_count))
+    g_hash_table_remove(path_intern_table, p);
+  else
+    p = NULL;
+
+  G_UNLOCK(path_intern);
+
+  return p != NULL;
+}
+
+COIL_API(void)
+coil_path_free(CoilPath *p)
+{
+  g_return_if_fail(p);
+
+  p = path_free_internal(p);
+  if (p)
+    coil_path_unref(p);
 }
 
 COIL_API(CoilPath *)
@@ -318,8 +473,214 @@ coil_path_unref(CoilPath *p)
 {
   g_return_if_fail(p);
 
-  if (g_atomic_int_dec_and_test(&p->ref_count))
-    coil_path_free(p);
+  /* walk up the containers instead of recursing, paths may be deep */
+  while (p && path_release(p))
+    p = path_free_internal(p);
+}
+
+/* only absolute paths are interned, their seeded hash is cached */
+static guint
+path_intern_hash(gconstpointer key)
+{
+  return coil_path_get_hash((CoilPath *)key);
+}
+
+static gboolean
+path_intern_equal(gconstpointer a,
+                  gconstpointer b)
+{
+  const CoilPath *pa = (const CoilPath *)a, *pb = (const CoilPath *)b;
+
+  return pa->path_len == pb->path_len
+    && memcmp(pa->path, pb->path, pa->path_len) == 0;
+}
+
+/**
+ * Return the interned path equal to @p.
+ *
+ * Steals the reference to @p and returns a reference to the shared path,
+ * which may be @p itself. Relative, root and static paths are returned
+ * unchanged since they are not owned or depend on context.
+ */
+COIL_API(CoilPath *)
+coil_path_intern(CoilPath *p) /* steals */
+{
+  g_return_val_if_fail(p, NULL);
+
+  CoilPath *interned;
+
+  if (p->flags & (COIL_PATH_IS_INTERNED | COIL_PATH_IS_ROOT | COIL_STATIC_PATH)
+    || COIL_PATH_IS_RELATIVE(p))
+    return p;
+
+  G_LOCK(path_intern);
+
+  if (G_UNLIKELY(path_intern_table == NULL))
+    path_intern_table = g_hash_table_new(path_intern_hash, path_intern_equal);
+
+  interned = g_hash_table_lookup(path_intern_table, p);
+
+  if (interned)
+  {
+    g_atomic_int_inc(&interned->ref_count);
+
+    /* keep the container link if the shared path has none */
+    if (interned->container == NULL && p->container)
+    {
+      g_atomic_pointer_set(&interned->container, p->container);
+      p->container = NULL;
+    }
+  }
+  else
+  {
+    p->flags |= COIL_PATH_IS_INTERNED;
+    g_hash_table_insert(path_intern_table, p, p);
+  }
+
+  G_UNLOCK(path_intern);
+
+  if (interned)
+  {
+    coil_path_unref(p);
+    return interned;
+  }
+
+  return p;
+}
+
+/** number of distinct interned paths */
+COIL_API(guint)
+coil_path_intern_size(void)
+{
+  guint size;
+
+  G_LOCK(path_intern);
+  size = path_intern_table ? g_hash_table_size(path_intern_table) : 0;
+  G_UNLOCK(path_intern);
+
+  return size;
+}
+
+/**
+ * Return the table hash of absolute path @p.
+ *
+ * The hash is computed on first use and kept in the path, so an interned
+ * path is hashed once no matter how many lookups or inserts use it.
+ */
+COIL_API(guint)
+coil_path_get_hash(CoilPath *p)
+{
+  g_return_val_if_fail(p, 0);
+  g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(p), 0);
+
+  guint hash;
+
+  if (COIL_PATH_IS_ROOT(p))
+    return 0;
+
+  /* racing threads compute and store the same value */
+  hash = p->hash;
+  if (G_UNLIKELY(hash == 0))
+  {
+    CoilPath *container = g_atomic_pointer_get(&p->container);
+
+    /* only the key needs hashing if the container hash is known */
+    if (container && (container->hash || COIL_PATH_IS_ROOT(container)))
+      hash = hash_relative_path(container->hash, p->key, p->key_len);
+    else
+      hash = hash_absolute_path(p->path, p->path_len);
+
+    p->hash = hash;
+  }
+
+  return hash;
+}
+
+static CoilPathPrefixes *
+path_alloc_prefixes(guint n_keys)
+{
+  CoilPathPrefixes *prefixes;
+
+  prefixes = g_malloc(sizeof(*prefixes) + (n_keys + 1) * 2 * sizeof(guint));
+  prefixes->n_keys = n_keys;
+  prefixes->lens = &prefixes->hashes[n_keys + 1];
+
+  return prefixes;
+}
+
+static CoilPathPrefixes *
+path_build_prefixes(const CoilPath *p)
+{
+  CoilPathPrefixes *prefixes, *outer = NULL;
+  PathScan          scan;
+  guint             n_keys;
+
+  if (p->container)
+    outer = g_atomic_pointer_get(&p->container->prefixes);
+
+  /* extend the prefixes of the container by the key */
+  if (outer)
+  {
+    n_keys = outer->n_keys + 1;
+    prefixes = path_alloc_prefixes(n_keys);
+
+    memcpy(prefixes->hashes, outer->hashes, n_keys * sizeof(guint));
+    memcpy(prefixes->lens, outer->lens, n_keys * sizeof(guint));
+
+    prefixes->hashes[n_keys] = hash_relative_path(outer->hashes[n_keys - 1],
+                                                  p->key, p->key_len);
+    prefixes->lens[n_keys] = p->path_len;
+
+    return prefixes;
+  }
+
+  path_scan(&scan, 0, p->path, p->path_len, PATH_SCAN_PREFIXES);
+
+  n_keys = scan.n_keys;
+  prefixes = path_alloc_prefixes(n_keys);
+
+  memcpy(prefixes->hashes, scan.hashes, (n_keys + 1) * sizeof(guint));
+  memcpy(prefixes->lens, scan.lens, (n_keys + 1) * sizeof(guint));
+
+  path_scan_clear(&scan);
+
+  return prefixes;
+}
+
+/**
+ * Return the number of keys in absolute path @p and point @hashes and
+ * @lens at the hash and length of each prefix of @p, from @root (index 0)
+ * to @p itself. The arrays are built once and owned by @p.
+ */
+COIL_API(guint)
+coil_path_get_prefixes(CoilPath      *p,
+                       const guint  **hashes,
+                       const guint  **lens)
+{
+  g_return_val_if_fail(p, 0);
+  g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(p), 0);
+  g_return_val_if_fail(hashes, 0);
+  g_return_val_if_fail(lens, 0);
+
+  CoilPathPrefixes *prefixes;
+
+  prefixes = g_atomic_pointer_get(&p->prefixes);
+  if (G_UNLIKELY(prefixes == NULL))
+  {
+    prefixes = path_build_prefixes(p);
+
+    if (!g_atomic_pointer_compare_and_exchange((gpointer *)&p->prefixes,
+                                               NULL, prefixes))
+    {
+      g_free(prefixes);
+      prefixes = g_atomic_pointer_get(&p->prefixes);
+    }
+  }
+
+  *hashes = prefixes->hashes;
+  *lens = prefixes->lens;
+
+  return prefixes->n_keys;
 }
 
 #if COIL_DEBUG
@@ -374,7 +735,10 @@ coil_path_concat(const CoilPath  *container,
   path->flags = (container->flags & COIL_PATH_IS_ABSOLUTE)
               | COIL_STATIC_KEY;
 
-  return path;
+  if (COIL_PATH_IS_ABSOLUTE(container))
+    path_set_container(path, container);
+
+  return coil_path_intern(path);
 }
 
 COIL_API(CoilPath *)
@@ -387,6 +751,7 @@ coil_build_path_valist(GError     **error,
   gchar       *buffer, *p;
   const gchar *key = first_key;
   guint        path_len = 0, key_len = 0, n = 64;
+  CoilPath    *result;
 
   p = buffer = (gchar *)g_malloc(n);
 
@@ -409,17 +774,11 @@ coil_build_path_valist(GError     **error,
 
   buffer[--path_len] = '\0';
 
-  if (!coil_check_path(buffer, path_len, error))
-  {
+  result = coil_path_take_checked(buffer, path_len, 0, error);
+  if (result == NULL)
     g_free(buffer);
-    return NULL;
-  }
 
-  key = &buffer[path_len - key_len];
-
-  return coil_path_take_strings(buffer, path_len,
-                                (gchar *)key, (guint8)key_len,
-                                COIL_STATIC_KEY);
+  return result;
 }
 
 COIL_API(CoilPath *)
@@ -444,18 +803,13 @@ COIL_API(gboolean)
 coil_validate_path_len(const gchar *path,
                        guint        path_len)
 {
-  static GRegex *path_regex = NULL;
-
   g_return_val_if_fail(path != NULL, FALSE);
 
-  if (G_UNLIKELY(!path_regex))
-    path_regex = g_regex_new("^"COIL_PATH_REGEX"$",
-                             G_REGEX_OPTIMIZE,
-                             G_REGEX_MATCH_NOTEMPTY,
-                             NULL);
+  PathScan scan;
+
+  path_scan(&scan, 0, path, path_len, PATH_SCAN_VALIDATE);
 
-  return g_regex_match_full(path_regex, path, path_len,
-                            0, 0, NULL, NULL);
+  return scan.valid;
 }
 
 COIL_API(gboolean)
@@ -468,18 +822,9 @@ COIL_API(gboolean)
 coil_validate_key_len(const gchar *key,
                       guint        key_len)
 {
-  static GRegex *key_regex = NULL;
-
   g_return_val_if_fail(key, FALSE);
 
-  if (G_UNLIKELY(!key_regex))
-    key_regex = g_regex_new("^"COIL_KEY_REGEX"$",
-                            G_REGEX_OPTIMIZE,
-                            G_REGEX_MATCH_NOTEMPTY,
-                            NULL);
-
-  return g_regex_match_full(key_regex, key, key_len,
-                            0, 0, NULL, NULL);
+  return path_scan_key(key, key_len);
 }
 
 COIL_API(gboolean)
@@ -527,20 +872,19 @@ coil_check_path(const gchar *path,
   g_return_val_if_fail(path_len, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
+  PathScan scan;
+
   if (path_len > COIL_PATH_LEN)
   {
     path_length_error(path, path_len, error);
     return FALSE;
   }
 
-  if (!coil_validate_path_len(path, path_len))
-  {
-    g_set_error(error,
-                COIL_ERROR,
-                COIL_ERROR_PATH,
-                "The path '%.*s' is invalid or contains invalid characters.",
-                path_len, path);
+  path_scan(&scan, 0, path, path_len, PATH_SCAN_VALIDATE);
 
+  if (!scan.valid)
+  {
+    path_invalid_error(path, path_len, error);
     return FALSE;
   }
 
@@ -582,7 +926,9 @@ coil_path_change_container(CoilPath      **path_ptr,
   g_return_val_if_fail(!COIL_PATH_IS_BACKREF(path), FALSE);
   g_return_val_if_fail(path->key && path->key_len, FALSE);
 
-  if (path->ref_count > 1 || path->flags & COIL_STATIC_PATH)
+  /* interned paths are shared even with a single reference */
+  if (path->ref_count > 1
+    || path->flags & (COIL_STATIC_PATH | COIL_PATH_IS_INTERNED))
   {
     CoilPath *old = path;
 
@@ -603,6 +949,17 @@ coil_path_change_container(CoilPath      **path_ptr,
   }
   else
   {
+    /* cached hashes describe the old container */
+    path->hash = 0;
+    g_free(path->prefixes);
+    path->prefixes = NULL;
+
+    if (path->container)
+    {
+      coil_path_unref(path->container);
+      path->container = NULL;
+    }
+
     if (len > path->path_len)
       path->path = g_realloc(path->path, len + 1);
 
@@ -633,6 +990,10 @@ coil_path_change_container(CoilPath      **path_ptr,
   path->path[len] = '\0';
   path->path_len = len;
   path->flags |= COIL_PATH_IS_ABSOLUTE | COIL_STATIC_KEY;
+
+  path_set_container(path, container);
+
+  *path_ptr = coil_path_intern(path);
   return TRUE;
 }
 
@@ -649,8 +1010,8 @@ coil_path_resolve(const CoilPath *path, /* any path */
   CoilPath    *resolved;
   const gchar *qualifier, *e;
   gchar       *p;
-  guint8       context_len, qualifier_len;
-  guint16      path_len;
+  guint        context_len, qualifier_len;
+  guint        path_len;
 
   if (G_UNLIKELY(COIL_PATH_IS_RELATIVE(context)))
     g_error("Error resolving path '%s', "
@@ -723,7 +1084,11 @@ coil_path_resolve(const CoilPath *path, /* any path */
   resolved->flags = COIL_PATH_IS_ABSOLUTE
                   | COIL_STATIC_KEY;
 
-  return resolved;
+  /* a single key resolves directly under context */
+  if (context_len == context->path_len && qualifier_len == path->key_len)
+    path_set_container(resolved, context);
+
+  return coil_path_intern(resolved);
 }
 
 COIL_API(gboolean)
@@ -758,7 +1123,7 @@ coil_path_relativize(const CoilPath *target, /* absolute path */
   g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(container), NULL);
 
   CoilPath    *relative;
-  guint8       prefix_len, tail_len, num_dots = 2;
+  guint        prefix_len, tail_len, num_dots = 2;
   const gchar *delim, *prefix, *path;
 
   if (COIL_PATH_IS_RELATIVE(target)
@@ -16,16 +16,28 @@ typedef enum {
   COIL_PATH_IS_ABSOLUTE    = 1 << 2,
   COIL_PATH_IS_ROOT        = 1 << 3,
   COIL_PATH_IS_BACKREF     = 1 << 4,
+  COIL_PATH_IS_INTERNED    = 1 << 5,
 } CoilPathFlags;
 
+typedef struct _CoilPathPrefixes CoilPathPrefixes;
+
 typedef struct _CoilPath
 {
-  gchar         *path;
-  guint8         path_len;
-  gchar         *key;
-  guint8         key_len;
-  CoilPathFlags  flags;
-  volatile gint  ref_count;
+  gchar            *path;
+  guint             path_len;
+  gchar            *key;
+  guint             key_len;
+  CoilPathFlags     flags;
+  volatile gint     ref_count;
+
+  /* interned path of the container, NULL if not known. Only caches
+   * the hash and prefixes, path always holds the whole string */
+  struct _CoilPath *container;
+
+  /* cached by coil_path_get_hash, 0 until computed */
+  guint             hash;
+  /* cached by coil_path_get_prefixes, NULL until computed */
+  CoilPathPrefixes *volatile prefixes;
 } CoilPath;
 
 extern CoilPath _coil_root_path;
@@ -33,12 +45,10 @@ extern CoilPath _coil_root_path;
 #define coil_root_path ((CoilPath *)(&_coil_root_path))
 #define CoilRootPath (coil_path_ref(coil_root_path))
 
-#define COIL_PATH_LEN 255
+/* lengths are stored in 16 bits by the struct table */
+#define COIL_PATH_LEN 65535
 #define COIL_PATH_BUFLEN (COIL_PATH_LEN + 1) /* +1 for '\0' */
 
-#define COIL_PATH_MAX_PARTS \
-  ((gint)((COIL_PATH_LEN - COIL_ROOT_PATH_LEN) / 2))
-
 #define COIL_SPECIAL_CHAR '@'
 #define COIL_SPECIAL_CHAR_S "@"
 
@@ -64,6 +74,9 @@ extern CoilPath _coil_root_path;
 #define COIL_PATH_IS_BACKREF(p) \
         ((p)->flags & COIL_PATH_IS_BACKREF)
 
+#define COIL_PATH_IS_INTERNED(p) \
+        ((p)->flags & COIL_PATH_IS_INTERNED)
+
 #define COIL_PATH_CONTAINER_LEN(p) \
   (((p)->path_len - (p->key_len)) - 1)
 
@@ -75,12 +88,12 @@ extern CoilPath _coil_root_path;
 
 #define COIL_TYPE_PATH (coil_path_get_type())
 
+/* longer paths are built on the heap, see COIL_PATH_QUICK_BUFFER_FREE */
+#define COIL_PATH_QUICK_BUFFER_LEN 1024
+
 #define COIL_PATH_QUICK_BUFFER(buf, blen, ctr, clen, key, klen) \
   G_STMT_START \
   { \
-    g_assert(sizeof(blen) == sizeof(guint8)); \
-    g_assert(sizeof(clen) == sizeof(guint8)); \
-    g_assert(sizeof(klen) == sizeof(guint8)); \
     g_assert(((guint32)(klen + clen + 1)) <= COIL_PATH_LEN); \
     register gchar *__p; \
     if (*key == COIL_PATH_DELIM) { \
@@ -90,14 +103,24 @@ extern CoilPath _coil_root_path;
       g_assert(klen > 0); \
     } \
     blen = clen + klen + 1; \
-    buf = g_alloca(blen + 1); \
+    if (blen < COIL_PATH_QUICK_BUFFER_LEN) \
+      buf = g_alloca(blen + 1); \
+    else \
+      buf = g_malloc(blen + 1); \
     __p = mempcpy(buf, ctr, clen); \
    *__p++ = COIL_PATH_DELIM; \
     __p = mempcpy(__p, key, klen); \
     *__p = 0; \
   } \
-  G_STMT_END\
+  G_STMT_END
 
+#define COIL_PATH_QUICK_BUFFER_FREE(buf, blen) \
+  G_STMT_START \
+  { \
+    if ((blen) >= COIL_PATH_QUICK_BUFFER_LEN) \
+      g_free(buf); \
+  } \
+  G_STMT_END
 
 
 G_BEGIN_DECLS
@@ -120,11 +143,17 @@ coil_path_list_free(GList *list);
 
 CoilPath *
 coil_path_take_strings(gchar         *path,
-                       guint8         path_len,
+                       guint          path_len,
                        gchar         *key,
-                       guint8         key_len,
+                       guint          key_len,
                        CoilPathFlags  flags);
 
+CoilPath *
+coil_path_take_checked(gchar          *path,
+                       guint           path_len,
+                       CoilPathFlags   flags,
+                       GError        **error);
+
 CoilPath *
 coil_path_new_len(const gchar  *buffer,
                   guint         buf_len,
@@ -154,6 +183,20 @@ coil_path_ref(CoilPath *p);
 void
 coil_path_unref(CoilPath *p);
 
+CoilPath *
+coil_path_intern(CoilPath *p) G_GNUC_WARN_UNUSED_RESULT;
+
+guint
+coil_path_intern_size(void);
+
+guint
+coil_path_get_hash(CoilPath *p);
+
+guint
+coil_path_get_prefixes(CoilPath      *p,
+                       const guint  **hashes,
+                       const guint  **lens);
+
 CoilPath *
 coil_path_concat(const CoilPath *container,
                  const CoilPath *key,
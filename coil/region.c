@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "region.h"
+
+/*
+ * A region hands out memory from large blocks by bumping a pointer and
+ * frees all of it at once. Memory from a region is never freed on its
+ * own, so anything allocated here must not outlive the region.
+ */
+
+#define BLOCK_BASE(mem) \
+  ((gsize)(mem) & ~(gsize)(COIL_REGION_BLOCK_BYTES - 1))
+
+/* requests larger than this get a block of their own */
+#define LARGE_ALLOC (COIL_REGION_BLOCK_BYTES / 4)
+
+#define DEFAULT_ALIGN (2 * sizeof(gsize))
+
+struct _CoilRegion
+{
+  /* free space in the current block */
+  gchar      *next;
+  gchar      *end;
+
+  GPtrArray  *blocks;
+  /* base of every COIL_REGION_BLOCK_BYTES span held by the region */
+  GHashTable *bases;
+
+  gsize       allocations;
+  gsize       bytes;
+  gsize       memory;
+};
+
+COIL_API(CoilRegion *)
+coil_region_new(void)
+{
+  CoilRegion *region = g_new0(CoilRegion, 1);
+
+  region->blocks = g_ptr_array_new();
+  region->bases = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  return region;
+}
+
+static gchar *
+region_add_block(CoilRegion *region,
+                 gsize       size)
+{
+  gpointer block;
+  gsize    offset;
+
+  size = (size + COIL_REGION_BLOCK_BYTES - 1)
+       & ~(gsize)(COIL_REGION_BLOCK_BYTES - 1);
+
+  if (posix_memalign(&block, COIL_REGION_BLOCK_BYTES, size) != 0)
+    g_error("%s: failed to allocate %" G_GSIZE_FORMAT " bytes",
+            G_STRLOC, size);
+
+  g_ptr_array_add(region->blocks, block);
+  region->memory += size;
+
+  for (offset = 0; offset < size; offset += COIL_REGION_BLOCK_BYTES)
+    g_hash_table_insert(region->bases, (gchar *)block + offset, region);
+
+  return block;
+}
+
+COIL_API(void)
+coil_region_free(CoilRegion *region)
+{
+  g_return_if_fail(region);
+
+  guint i;
+
+  for (i = 0; i < region->blocks->len; i++)
+    free(g_ptr_array_index(region->blocks, i));
+
+  g_ptr_array_free(region->blocks, TRUE);
+  g_hash_table_destroy(region->bases);
+  g_free(region);
+}
+
+COIL_API(gpointer)
+coil_region_alloc_aligned(CoilRegion *region,
+                          gsize       size,
+                          gsize       align)
+{
+  g_return_val_if_fail(region, NULL);
+  g_return_val_if_fail(size > 0, NULL);
+  g_return_val_if_fail(align > 0 && (align & (align - 1)) == 0, NULL);
+  g_return_val_if_fail(align <= COIL_REGION_BLOCK_BYTES, NULL);
+
+  gchar *p;
+
+  region->allocations++;
+  region->bytes += size;
+
+  if (size > LARGE_ALLOC)
+    return region_add_block(region, size);
+
+  p = (gchar *)(((gsize)region->next + align - 1) & ~(gsize)(align - 1));
+
+  if (region->next == NULL || p + size > region->end)
+  {
+    p = region_add_block(region, COIL_REGION_BLOCK_BYTES);
+    region->end = p + COIL_REGION_BLOCK_BYTES;
+  }
+
+  region->next = p + size;
+
+  return p;
+}
+
+COIL_API(gpointer)
+coil_region_alloc(CoilRegion *region,
+                  gsize       size)
+{
+  return coil_region_alloc_aligned(region, size, DEFAULT_ALIGN);
+}
+
+COIL_API(gpointer)
+coil_region_alloc0(CoilRegion *region,
+                   gsize       size)
+{
+  gpointer mem = coil_region_alloc_aligned(region, size, DEFAULT_ALIGN);
+
+  return memset(mem, 0, size);
+}
+
+COIL_API(gchar *)
+coil_region_strndup(CoilRegion  *region,
+                    const gchar *str,
+                    gsize        len)
+{
+  g_return_val_if_fail(region, NULL);
+  g_return_val_if_fail(str, NULL);
+
+  gchar *copy = coil_region_alloc_aligned(region, len + 1, 1);
+
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  return copy;
+}
+
+/** TRUE if @mem was allocated from @region */
+COIL_API(gboolean)
+coil_region_contains(const CoilRegion *region,
+                     gconstpointer     mem)
+{
+  g_return_val_if_fail(region, FALSE);
+
+  return g_hash_table_lookup(region->bases,
+                             GSIZE_TO_POINTER(BLOCK_BASE(mem))) != NULL;
+}
+
+COIL_API(void)
+coil_region_get_stats(const CoilRegion *region,
+                      CoilRegionStats  *stats)
+{
+  g_return_if_fail(region);
+  g_return_if_fail(stats);
+
+  stats->blocks = region->blocks->len;
+  stats->allocations = region->allocations;
+  stats->bytes = region->bytes;
+  stats->memory = region->memory;
+}
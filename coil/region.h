@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+#ifndef __COIL_REGION_H
+#define __COIL_REGION_H
+
+/* blocks are aligned to their size so owners are found by address */
+#define COIL_REGION_BLOCK_BYTES (64 * 1024)
+
+typedef struct _CoilRegion CoilRegion;
+typedef struct _CoilRegionStats CoilRegionStats;
+
+struct _CoilRegionStats
+{
+  guint blocks;
+  gsize allocations;
+  gsize bytes;  /* handed out */
+  gsize memory; /* held in blocks */
+};
+
+G_BEGIN_DECLS
+
+CoilRegion *
+coil_region_new(void);
+
+void
+coil_region_free(CoilRegion *region);
+
+gpointer
+coil_region_alloc(CoilRegion *region,
+                  gsize       size) G_GNUC_MALLOC;
+
+gpointer
+coil_region_alloc0(CoilRegion *region,
+                   gsize       size) G_GNUC_MALLOC;
+
+gpointer
+coil_region_alloc_aligned(CoilRegion *region,
+                          gsize       size,
+                          gsize       align) G_GNUC_MALLOC;
+
+gchar *
+coil_region_strndup(CoilRegion  *region,
+                    const gchar *str,
+                    gsize        len);
+
+gboolean
+coil_region_contains(const CoilRegion *region,
+                     gconstpointer     mem);
+
+void
+coil_region_get_stats(const CoilRegion *region,
+                      CoilRegionStats  *stats);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "struct_table.h"
+
+/* when no displacement places a bucket, the slots are grown and retried */
+#define MAX_DISPLACE (1 << 16)
+
+typedef struct _SnapshotEntry
+{
+  guint         hash;
+  guint         key_len;
+  const gchar  *key; /* see snapshot_key(), in strings */
+  GValue        value;
+} SnapshotEntry;
+
+/*
+ * A snapshot is the frozen struct or a view of a struct frozen with
+ * it. Views share the index of their root and live as long as it.
+ */
+struct _CoilSnapshot
+{
+  volatile gint  ref_count;
+  CoilSnapshot  *root;
+
+  /* lookups are relative to the struct of the snapshot */
+  guint          hash;
+  CoilPath      *path;
+
+  /* the struct in keys of the index, absolute when not below the root */
+  const gchar   *key;
+  guint          key_len;
+
+  /* paths below the struct */
+  guint          size;
+
+  /* the index, in the root only. Sorted by slot, slot i holds entries
+   * first[i] up to first[i + 1] */
+  SnapshotEntry *entries;
+  guint          n_entries;
+
+  guint32       *first;
+  guint          n_slots;
+
+  guint32       *displace;
+  guint          n_buckets;
+
+  /* keys and string values, each stored once */
+  GStringChunk  *strings;
+
+  GPtrArray     *views;
+};
+
+typedef struct _SnapshotBuild
+{
+  CoilSnapshot *snapshot;
+  GArray       *entries;
+  GHashTable   *views;     /* struct to its view */
+  GHashTable   *collected; /* structs whose keys are in entries */
+  GQueue        links;     /* linked structs, collected last */
+} SnapshotBuild;
+
+#define REDUCE(h, n) ((guint32)(((guint64)(h) * (n)) >> 32))
+
+static inline guint32
+slot_hash(guint32 hash,
+          guint32 displace)
+{
+  guint32 h = hash ^ (displace * 0x9E3779B9u);
+
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static inline guint32
+snapshot_slot(const CoilSnapshot *snapshot,
+              guint32             hash)
+{
+  const guint32 d = snapshot->displace[REDUCE(hash, snapshot->n_buckets)];
+
+  return REDUCE(slot_hash(hash, d), snapshot->n_slots);
+}
+
+/* the key of @path in the index */
+static const gchar *
+snapshot_key(CoilSnapshot   *snapshot,
+             const CoilPath *path,
+             guint          *key_len)
+{
+  const guint prefix_len = snapshot->path->path_len;
+
+  if (path->path_len > prefix_len + 1
+    && path->path[prefix_len] == COIL_PATH_DELIM
+    && memcmp(path->path, snapshot->path->path, prefix_len) == 0)
+  {
+    *key_len = path->path_len - prefix_len - 1;
+    return g_string_chunk_insert_const(snapshot->strings,
+                                       path->path + prefix_len + 1);
+  }
+
+  *key_len = path->path_len;
+  return g_string_chunk_insert_const(snapshot->strings, path->path);
+}
+
+static CoilSnapshot *
+snapshot_view(SnapshotBuild *build,
+              CoilStruct    *object)
+{
+  CoilSnapshot *snapshot = build->snapshot;
+  CoilSnapshot *view;
+
+  view = g_hash_table_lookup(build->views, object);
+  if (view)
+    return view;
+
+  view = g_new0(CoilSnapshot, 1);
+  view->root = snapshot;
+  view->path = coil_path_ref((CoilPath *)coil_struct_get_path(object));
+  view->hash = coil_path_get_hash(view->path);
+  view->key = snapshot_key(snapshot, view->path, &view->key_len);
+
+  g_ptr_array_add(snapshot->views, view);
+  g_hash_table_insert(build->views, object, view);
+
+  return view;
+}
+
+static gboolean
+snapshot_collect(SnapshotBuild *build,
+                 CoilSnapshot  *view,
+                 CoilStruct    *node,
+                 GError       **error)
+{
+  CoilSnapshot   *snapshot = build->snapshot;
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value;
+
+  if (!coil_struct_expand(node, error))
+    return FALSE;
+
+  g_hash_table_insert(build->collected, node, node);
+  coil_struct_iter_init(&it, node);
+
+  while (coil_struct_iter_next(&it, &path, &value))
+  {
+    SnapshotEntry entry;
+
+    /* links are resolved and structs expanded, prototypes left alone */
+    if (G_VALUE_HOLDS(value, COIL_TYPE_EXPANDABLE)
+      && !(G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+        && coil_struct_is_prototype(COIL_STRUCT(g_value_get_object(value))))
+      && !coil_expand_value(value, &value, TRUE, error))
+      return FALSE;
+
+    entry.key = snapshot_key(snapshot, path, &entry.key_len);
+    entry.hash = coil_path_get_hash((CoilPath *)path);
+
+    memset(&entry.value, 0, sizeof(entry.value));
+
+    if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+    {
+      CoilStruct   *object = COIL_STRUCT(g_value_get_object(value));
+      CoilSnapshot *child = snapshot_view(build, object);
+
+      /* owned by the root, see coil_snapshot_unref() */
+      g_value_init(&entry.value, COIL_TYPE_SNAPSHOT);
+      g_value_set_static_boxed(&entry.value, child);
+      g_array_append_val(build->entries, entry);
+      view->size++;
+
+      /* the keys of prototypes are not known until they are extended */
+      if (coil_struct_is_prototype(object))
+        continue;
+
+      if (coil_struct_get_container(object) != node)
+      {
+        g_queue_push_tail(&build->links, object);
+        continue;
+      }
+
+      if (!g_hash_table_lookup(build->collected, object)
+        && !snapshot_collect(build, child, object, error))
+        return FALSE;
+
+      view->size += child->size;
+      continue;
+    }
+
+    g_value_init(&entry.value, G_VALUE_TYPE(value));
+
+    if (G_VALUE_HOLDS(value, G_TYPE_STRING))
+    {
+      const gchar *string = g_value_get_string(value);
+
+      if (string)
+        string = g_string_chunk_insert_const(snapshot->strings, string);
+
+      g_value_set_static_string(&entry.value, string);
+    }
+    else
+      g_value_copy(value, &entry.value);
+
+    g_array_append_val(build->entries, entry);
+    view->size++;
+  }
+
+  return TRUE;
+}
+
+static gint
+entry_compare(gconstpointer a,
+              gconstpointer b)
+{
+  const SnapshotEntry *x = a, *y = b;
+
+  return (x->hash > y->hash) - (x->hash < y->hash);
+}
+
+/*
+ * Place every distinct hash in its own slot by hash and displace
+ * (CHD): hashes are grouped into buckets, and buckets are placed
+ * largest first, each trying displacements until all of its hashes
+ * land in free slots.
+ */
+static gboolean
+snapshot_place(CoilSnapshot  *snapshot,
+               const guint32 *hashes,
+               guint32       *slot_of,
+               guint          n)
+{
+  const guint n_buckets = snapshot->n_buckets;
+  const guint n_slots = snapshot->n_slots;
+  guint32    *bucket_first = g_new0(guint32, n_buckets + 1);
+  guint32    *members = g_new(guint32, MAX(n, 1));
+  guint32    *order = g_new(guint32, n_buckets);
+  guint32    *size_first;
+  guint8     *taken = g_new0(guint8, n_slots);
+  guint       max_size = 0, i, j, b;
+  gboolean    result = TRUE;
+
+  /* group hashes by bucket */
+  for (i = 0; i < n; i++)
+    bucket_first[REDUCE(hashes[i], n_buckets) + 1]++;
+
+  for (b = 0; b < n_buckets; b++)
+  {
+    max_size = MAX(max_size, bucket_first[b + 1]);
+    bucket_first[b + 1] += bucket_first[b];
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    b = REDUCE(hashes[i], n_buckets);
+    members[bucket_first[b]++] = i;
+  }
+
+  for (b = n_buckets; b > 0; b--)
+    bucket_first[b] = bucket_first[b - 1];
+
+  bucket_first[0] = 0;
+
+  /* order buckets largest first */
+  size_first = g_new0(guint32, max_size + 2);
+
+  for (b = 0; b < n_buckets; b++)
+    size_first[max_size - (bucket_first[b + 1] - bucket_first[b]) + 1]++;
+
+  for (i = 0; i <= max_size; i++)
+    size_first[i + 1] += size_first[i];
+
+  for (b = 0; b < n_buckets; b++)
+    order[size_first[max_size - (bucket_first[b + 1] - bucket_first[b])]++] = b;
+
+  g_free(size_first);
+
+  for (i = 0; i < n_buckets && result; i++)
+  {
+    const guint32 lo = bucket_first[order[i]];
+    const guint32 hi = bucket_first[order[i] + 1];
+    guint32       d;
+
+    snapshot->displace[order[i]] = 0;
+
+    if (lo == hi)
+      continue;
+
+    for (d = 0; d < MAX_DISPLACE; d++)
+    {
+      for (j = lo; j < hi; j++)
+      {
+        const guint32 s = REDUCE(slot_hash(hashes[members[j]], d), n_slots);
+
+        if (taken[s])
+          break;
+
+        taken[s] = 1;
+        slot_of[members[j]] = s;
+      }
+
+      if (j == hi)
+        break;
+
+      /* release the slots taken by this attempt */
+      while (j-- > lo)
+        taken[slot_of[members[j]]] = 0;
+    }
+
+    if (d == MAX_DISPLACE)
+      result = FALSE;
+    else
+      snapshot->displace[order[i]] = d;
+  }
+
+  g_free(taken);
+  g_free(order);
+  g_free(members);
+  g_free(bucket_first);
+
+  return result;
+}
+
+static void
+snapshot_build_index(CoilSnapshot *snapshot,
+                     GArray       *entries)
+{
+  SnapshotEntry *sorted = (SnapshotEntry *)entries->data;
+  const guint    size = entries->len;
+  guint32       *hashes = g_new(guint32, MAX(size, 1));
+  guint32       *group = g_new(guint32, MAX(size, 1));
+  guint32       *slot_of;
+  guint          n = 0, i;
+
+  g_array_sort(entries, entry_compare);
+
+  /* paths with equal hashes share a slot */
+  for (i = 0; i < size; i++)
+  {
+    if (i == 0 || sorted[i].hash != sorted[i - 1].hash)
+      hashes[n++] = sorted[i].hash;
+
+    group[i] = n - 1;
+  }
+
+  slot_of = g_new(guint32, MAX(n, 1));
+
+  snapshot->n_buckets = n / 4 + 1;
+  snapshot->n_slots = n + n / 8 + 1;
+  snapshot->displace = g_new(guint32, snapshot->n_buckets);
+
+  while (!snapshot_place(snapshot, hashes, slot_of, n))
+    snapshot->n_slots += snapshot->n_slots / 4 + 1;
+
+  /* lay entries out by slot */
+  snapshot->first = g_new0(guint32, snapshot->n_slots + 1);
+  snapshot->entries = g_new(SnapshotEntry, MAX(size, 1));
+  snapshot->n_entries = size;
+
+  for (i = 0; i < size; i++)
+    snapshot->first[slot_of[group[i]] + 1]++;
+
+  for (i = 0; i < snapshot->n_slots; i++)
+    snapshot->first[i + 1] += snapshot->first[i];
+
+  /* first[s] is used as the fill position of slot s, then restored */
+  for (i = 0; i < size; i++)
+    snapshot->entries[snapshot->first[slot_of[group[i]]]++] = sorted[i];
+
+  for (i = snapshot->n_slots; i > 0; i--)
+    snapshot->first[i] = snapshot->first[i - 1];
+
+  snapshot->first[0] = 0;
+
+  g_free(slot_of);
+  g_free(group);
+  g_free(hashes);
+}
+
+static void
+snapshot_free(CoilSnapshot *snapshot)
+{
+  guint i;
+
+  for (i = 0; i < snapshot->views->len; i++)
+  {
+    CoilSnapshot *view = g_ptr_array_index(snapshot->views, i);
+
+    coil_path_unref(view->path);
+    g_free(view);
+  }
+
+  g_ptr_array_free(snapshot->views, TRUE);
+
+  for (i = 0; i < snapshot->n_entries; i++)
+    g_value_unset(&snapshot->entries[i].value);
+
+  g_free(snapshot->entries);
+  g_free(snapshot->first);
+  g_free(snapshot->displace);
+  g_string_chunk_free(snapshot->strings);
+  coil_path_unref(snapshot->path);
+  g_free(snapshot);
+}
+
+/**
+ * coil_struct_freeze: Expand @self and everything in it into a snapshot
+ *
+ * The snapshot is immutable and maps every path below @self to its
+ * expanded value through a perfect hash, with links resolved and keys
+ * and string values shared. Lookups do not lock or touch reference
+ * counts, so any number of threads may look up paths in a snapshot at
+ * once.
+ *
+ * Struct values are held as snapshots of those structs, frozen with
+ * @self into the same index; a struct @self links to elsewhere in the
+ * tree is frozen too, its paths only reached through the link. They are
+ * referenced with @self, and the snapshot holds no CoilStruct.
+ *
+ * Returns: a new snapshot or %NULL on error
+ */
+COIL_API(CoilSnapshot *)
+coil_struct_freeze(CoilStruct *self,
+                   GError    **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilSnapshot  *snapshot;
+  CoilStruct    *object;
+  SnapshotBuild  build;
+  gboolean       result;
+  guint          i;
+
+  snapshot = g_new0(CoilSnapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->root = snapshot;
+  snapshot->path = coil_path_ref((CoilPath *)coil_struct_get_path(self));
+  snapshot->hash = coil_path_get_hash(snapshot->path);
+  snapshot->strings = g_string_chunk_new(4096);
+  snapshot->views = g_ptr_array_new();
+
+  build.snapshot = snapshot;
+  build.entries = g_array_new(FALSE, FALSE, sizeof(SnapshotEntry));
+  build.views = g_hash_table_new(g_direct_hash, g_direct_equal);
+  build.collected = g_hash_table_new(g_direct_hash, g_direct_equal);
+  g_queue_init(&build.links);
+
+  g_hash_table_insert(build.views, self, snapshot);
+
+  result = snapshot_collect(&build, snapshot, self, error);
+
+  while (result && (object = g_queue_pop_head(&build.links)))
+  {
+    if (!g_hash_table_lookup(build.collected, object))
+      result = snapshot_collect(&build, snapshot_view(&build, object),
+                                object, error);
+  }
+
+  g_queue_clear(&build.links);
+  g_hash_table_destroy(build.collected);
+  g_hash_table_destroy(build.views);
+
+  if (!result)
+  {
+    for (i = 0; i < build.entries->len; i++)
+      g_value_unset(&g_array_index(build.entries, SnapshotEntry, i).value);
+
+    g_array_free(build.entries, TRUE);
+    snapshot_free(snapshot);
+
+    return NULL;
+  }
+
+  snapshot_build_index(snapshot, build.entries);
+  g_array_free(build.entries, TRUE);
+
+  return snapshot;
+}
+
+/**
+ * coil_snapshot_ref: Reference @snapshot
+ *
+ * A view is referenced through the snapshot it was frozen with.
+ */
+COIL_API(CoilSnapshot *)
+coil_snapshot_ref(CoilSnapshot *snapshot)
+{
+  g_return_val_if_fail(snapshot, NULL);
+
+  g_atomic_int_inc(&snapshot->root->ref_count);
+
+  return snapshot;
+}
+
+COIL_API(void)
+coil_snapshot_unref(CoilSnapshot *snapshot)
+{
+  g_return_if_fail(snapshot);
+
+  CoilSnapshot *root = snapshot->root;
+
+  if (g_atomic_int_dec_and_test(&root->ref_count))
+    snapshot_free(root);
+}
+
+COIL_API(GType)
+coil_snapshot_get_type(void)
+{
+  static GType type_id = 0;
+
+  if (G_UNLIKELY(!type_id))
+    type_id = g_boxed_type_register_static(g_intern_static_string("CoilSnapshot"),
+                                           (GBoxedCopyFunc)coil_snapshot_ref,
+                                           (GBoxedFreeFunc)coil_snapshot_unref);
+
+  return type_id;
+}
+
+/**
+ * coil_snapshot_lookup: Find the value of @path in @snapshot
+ *
+ * @path is relative to the frozen struct, or absolute below it.
+ *
+ * Returns: the expanded value, owned by @snapshot, or %NULL if @path
+ * is not in @snapshot
+ */
+COIL_API(const GValue *)
+coil_snapshot_lookup(const CoilSnapshot *snapshot,
+                     const gchar        *path,
+                     guint               path_len)
+{
+  g_return_val_if_fail(snapshot, NULL);
+  g_return_val_if_fail(path, NULL);
+
+  const CoilSnapshot  *root = snapshot->root;
+  const SnapshotEntry *entry, *end;
+  const guint          key_len = snapshot->key_len;
+  guint                hash, slot;
+
+  if (*path == COIL_SPECIAL_CHAR)
+  {
+    const guint prefix_len = snapshot->path->path_len;
+
+    if (path_len <= prefix_len + 1
+      || path[prefix_len] != '.'
+      || memcmp(path, snapshot->path->path, prefix_len) != 0)
+      return NULL;
+
+    path += prefix_len + 1;
+    path_len -= prefix_len + 1;
+  }
+
+  if (path_len == 0 || *path == '.' || *path == COIL_SPECIAL_CHAR)
+    return NULL;
+
+  hash = hash_relative_path(snapshot->hash, path, path_len);
+  slot = snapshot_slot(root, hash);
+
+  entry = root->entries + root->first[slot];
+  end = root->entries + root->first[slot + 1];
+
+  /* in a view keys are the key of its struct followed by @path */
+  for (; entry < end; entry++)
+  {
+    if (entry->hash == hash
+      && entry->key_len == (key_len ? key_len + 1 : 0) + path_len
+      && memcmp(entry->key + entry->key_len - path_len, path, path_len) == 0
+      && (key_len == 0
+        || (entry->key[key_len] == COIL_PATH_DELIM
+          && memcmp(entry->key, snapshot->key, key_len) == 0)))
+      return &entry->value;
+  }
+
+  return NULL;
+}
+
+COIL_API(guint)
+coil_snapshot_get_size(const CoilSnapshot *snapshot)
+{
+  g_return_val_if_fail(snapshot, 0);
+
+  return snapshot->size;
+}
+
+COIL_API(void)
+coil_snapshot_get_stats(const CoilSnapshot *snapshot,
+                        CoilSnapshotStats  *stats)
+{
+  g_return_if_fail(snapshot);
+  g_return_if_fail(stats);
+
+  const CoilSnapshot *root = snapshot->root;
+
+  stats->size = snapshot->size;
+  stats->entries = root->n_entries;
+  stats->slots = root->n_slots;
+  stats->buckets = root->n_buckets;
+  stats->memory = sizeof(*root)
+                + root->views->len * sizeof(CoilSnapshot)
+                + root->n_entries * sizeof(SnapshotEntry)
+                + (root->n_slots + 1) * sizeof(guint32)
+                + root->n_buckets * sizeof(guint32);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+#ifndef __COIL_SNAPSHOT_H
+#define __COIL_SNAPSHOT_H
+
+#include "struct.h"
+
+typedef struct _CoilSnapshot      CoilSnapshot;
+typedef struct _CoilSnapshotStats CoilSnapshotStats;
+
+#define COIL_TYPE_SNAPSHOT (coil_snapshot_get_type())
+
+struct _CoilSnapshotStats
+{
+  guint size;    /* paths */
+  guint entries; /* paths of the index, shared with views */
+  guint slots;
+  guint buckets; /* displacement values of the perfect hash */
+  gsize memory;  /* index and entries, shared strings not included */
+};
+
+G_BEGIN_DECLS
+
+GType
+coil_snapshot_get_type(void) G_GNUC_CONST;
+
+CoilSnapshot *
+coil_struct_freeze(CoilStruct *self,
+                   GError    **error);
+
+CoilSnapshot *
+coil_snapshot_ref(CoilSnapshot *snapshot);
+
+void
+coil_snapshot_unref(CoilSnapshot *snapshot);
+
+const GValue *
+coil_snapshot_lookup(const CoilSnapshot *snapshot,
+                     const gchar        *path,
+                     guint               path_len);
+
+guint
+coil_snapshot_get_size(const CoilSnapshot *snapshot);
+
+void
+coil_snapshot_get_stats(const CoilSnapshot *snapshot,
+                        CoilSnapshotStats  *stats);
+
+G_END_DECLS
+
+#endif
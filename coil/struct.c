@@ -11,15 +11,49 @@
 #include "marshal.h"
 
 #include "struct.h"
+#include "struct_table.h"
 
 #include "link.h"
 #include "include.h"
+#include "expression.h"
+#include "list.h"
 
 G_DEFINE_TYPE(CoilStruct, coil_struct, COIL_TYPE_EXPANDABLE);
 
 #define COIL_STRUCT_GET_PRIVATE(obj) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), COIL_TYPE_STRUCT, CoilStructPrivate))
 
+typedef struct _StructObserver StructObserver;
+
+/*
+ * A struct that inherits from a parent without copying its entries
+ * observes the parent and is expanded before the parent changes, see
+ * struct_change_notify(). Once the entries are copied the struct is an
+ * heir of the parent instead and the keys the parent changes are copied
+ * again, see struct_update_heirs(). Each link is on the list of the
+ * parent and on the list of the dependent so either side can drop it.
+ *
+ * Sharing only defers the copy, it is not delta storage: the first
+ * expansion of a struct copies every entry it inherits, not just the
+ * keys it overrides, and an heir keeps all of them.
+ */
+struct _StructObserver
+{
+  CoilStruct     *parent;
+  CoilStruct     *dependent;
+
+  /* position of parent in the dependencies of dependent, heirs only */
+  guint           order;
+  gboolean        is_heir;
+
+  /* in observers of parent */
+  StructObserver *prev;
+  StructObserver *next;
+
+  /* in observing of dependent */
+  StructObserver *next_parent;
+};
+
 struct _CoilStructPrivate
 {
   CoilStruct          *root;
@@ -28,26 +62,36 @@ struct _CoilStructPrivate
 
   StructTable         *table;
 
-  GQueue               entries;
+  StructEntryVector    entries;
   GQueue               dependencies;
   GList               *expand_ptr;
 
+  StructObserver      *observers;
+  StructObserver      *heirs;
+  StructObserver      *observing;
+
+  /* expandables by hash of the paths they read, root only */
+  GHashTable          *readers;
+
   guint                size;
   guint                hash;
 
+  /* changes are not reported while > 0, see coil_struct_begin_batch() */
+  guint                batch_depth;
+
 #if COIL_DEBUG
   guint                version;
 #endif
 
+  /* see coil_struct_get_content_hash() */
+  guint                content_hash;
+  gboolean             has_content_hash : 1;
+
   gboolean             is_prototype : 1;
-  gboolean             is_accumulating : 1;
-};
 
-typedef struct _ExpandNotify
-{
-  CoilStruct *object;
-  gulong      handler_id;
-} ExpandNotify;
+  /* heirs are not updated while set, root only */
+  gboolean             is_loading : 1;
+};
 
 typedef enum
 {
@@ -79,14 +123,14 @@ struct_signals[LAST_SIGNAL] = {0, };
 static CoilStruct *
 struct_lookup_container_internal(CoilStruct  *self,
                                  const gchar *path,
-                                 guint8       path_len,
+                                 guint        path_len,
                                  GError     **error);
 
 static gboolean
 struct_delete_internal(CoilStruct   *self,
                        guint         hash,
                        const gchar  *path,
-                       guint8        path_len,
+                       guint         path_len,
                        gboolean      strict,
                        gboolean      reset_container,
                        GError      **error);
@@ -95,28 +139,39 @@ static gboolean
 struct_iter_next_entry(CoilStructIter *iter,
                        StructEntry   **entry);
 
-static GError *
-struct_expand_notify(GObject *instance,
-                     gpointer data);
+static void
+struct_add_observer(CoilStruct *self,
+                    CoilStruct *parent);
 
 static void
-prototype_cast_notify(GObject    *instance,
-                        GParamSpec *arg1,
-                        gpointer    data);
+struct_remove_observer(CoilStruct *self,
+                       CoilStruct *parent);
 
 static void
-struct_connect_expand_notify(CoilStruct *const self,
-                             CoilStruct *const parent);
+observer_unlink(StructObserver *observer);
 
 static gboolean
 struct_change_notify(CoilStruct  *self,
                      GError     **error);
 
+static gboolean
+struct_entry_changed(CoilStruct     *self,
+                     guint           hash,
+                     const CoilPath *path,
+                     GError        **error);
+
+static void
+readers_free(GHashTable *readers);
+
+static void
+struct_drop_content_hash(CoilStruct *self);
+
 static const GValue *
 struct_lookup_internal(CoilStruct     *self,
+                       CoilPath       *path_obj,
                        guint           hash,
                        const gchar    *path,
-                       guint8          path_len,
+                       guint           path_len,
                        gboolean        expand_value,
                        gboolean        expand_container,
                        GError        **error);
@@ -141,12 +196,17 @@ destroy_root_struct(gpointer data,
   if (last_ref)
   {
     CoilStruct        *self = COIL_STRUCT(object);
-    CoilStructPrivate *priv = self->priv;
     StructEntry       *entry = (StructEntry *)data;
+    StructTable       *table;
+
+    /* the entry holds the last reference, finalizing self drops the
+     * table before the entry is back in its pool */
+    table = struct_table_ref(self->priv->table);
 
     g_object_ref(object);
     g_object_remove_toggle_ref(object, (GToggleNotify)destroy_root_struct, data);
-    struct_table_delete_entry(priv->table, entry);
+    struct_table_delete_entry(table, entry);
+    struct_table_unref(table);
   }
 }
 
@@ -213,10 +273,11 @@ struct_change_container(CoilStruct *self,
 
   CoilStructPrivate *const priv = self->priv;
   CoilExpandable    *const super = COIL_EXPANDABLE(self);
-  CoilStructIter     it;
   CoilStruct        *old_container = super->container;
   StructTable       *old_table = NULL;
   StructEntry       *entry;
+  StructEntryVector  entries = STRUCT_ENTRY_VECTOR_INIT;
+  guint32            i;
   GError            *internal_error = NULL;
 
   /* remove self from previous container */
@@ -283,12 +344,15 @@ struct_change_container(CoilStruct *self,
   }
 
   /* iterate through key-values and update paths entry table */
-  coil_struct_iter_init(&it, self);
-
-  while (struct_iter_next_entry(&it, &entry))
+  for (i = 0; i < priv->entries.len; i++)
   {
-    /* remove each entry from current entry table */
-    struct_table_remove_entry(old_table, entry);
+    entry = priv->entries.items[i];
+    if (entry == NULL)
+      continue;
+
+    /* move each entry out of current entry table, copied if tables differ */
+    entry = struct_table_move_entry(old_table, priv->table, entry);
+    struct_entry_vector_append(&entries, entry);
 
     /* update path with proper container */
     if (!coil_path_change_container(&entry->path, priv->path, &internal_error))
@@ -302,11 +366,11 @@ struct_change_container(CoilStruct *self,
     struct_table_insert_entry(priv->table, entry);
 
     /* if value is struct recursively change containers */
-    if (entry->value && G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT))
+    if (entry->kind == STRUCT_VALUE_STRUCT)
     {
       CoilStruct *object;
 
-      object = COIL_STRUCT(g_value_get_object(entry->value));
+      object = COIL_STRUCT(g_value_get_object(&entry->value));
       if (!struct_change_container(object, self,
                                    entry->path, &entry->hash,
                                    FALSE, &internal_error))
@@ -314,6 +378,8 @@ struct_change_container(CoilStruct *self,
     }
   }
 
+  struct_entry_vector_clear(&priv->entries);
+  priv->entries = entries;
   struct_table_unref(old_table);
 
   return TRUE;
@@ -323,7 +389,12 @@ error:
     g_propagate_error(error, internal_error);
 
   if (old_table)
+  {
+    /* entries not moved yet are released with the old table */
+    struct_entry_vector_clear(&priv->entries);
+    priv->entries = entries;
     struct_table_unref(old_table);
+  }
 
   return FALSE;
 }
@@ -352,24 +423,30 @@ struct_resolve_path(CoilStruct     *self,
 
   CoilStructPrivate *const priv = self->priv;
 
+  CoilPath          *resolved;
+
   if (COIL_PATH_IS_ABSOLUTE(path))
   {
-    *return_hash = hash_absolute_path(path->path, path->path_len);
+    *return_hash = coil_path_get_hash((CoilPath *)path);
     return coil_path_ref((CoilPath *)path);
   }
 
+  resolved = coil_path_resolve(path, priv->path, error);
+  if (resolved == NULL)
+    return NULL;
+
   if (COIL_PATH_IS_BACKREF(path))
+    *return_hash = coil_path_get_hash(resolved);
+  else if (resolved->hash == 0)
   {
-    CoilPath *resolved = coil_path_resolve(path, priv->path, error);
-
-    if (resolved)
-      *return_hash = hash_absolute_path(resolved->path, resolved->path_len);
-
-    return resolved;
+    /* cheaper than hashing the resolved path, cache it for the next use */
+    *return_hash = hash_relative_path(priv->hash, path->path, path->path_len);
+    resolved->hash = *return_hash;
   }
+  else
+    *return_hash = resolved->hash;
 
-  *return_hash = hash_relative_path(priv->hash, path->path, path->path_len);
-  return coil_path_resolve(path, priv->path, error);
+  return resolved;
 }
 
 static gboolean
@@ -409,24 +486,34 @@ coil_struct_empty(CoilStruct *self,
 
   CoilStructPrivate *const priv = self->priv;
 
-  /*
-  GError            *internal_error = NULL;
-  g_signal_emit(self, struct_signals[MODIFY], 0,
-                (gpointer *)&internal_error);
+  struct_drop_content_hash(self);
 
-  if (G_UNLIKELY(internal_error))
+  /* readers go with the entries holding them */
+  if (priv->readers)
   {
-    g_propagate_error(error, internal_error);
-    return;
-  }*/
+    readers_free(priv->readers);
+    priv->readers = NULL;
+  }
+
+  /* stop observing parents before letting go of them */
+  while (priv->observing)
+    observer_unlink(priv->observing);
 
   CoilExpandable *object;
   while ((object = g_queue_pop_head(&priv->dependencies)))
     g_object_unref(object);
 
   StructEntry *entry;
-  while ((entry = g_queue_pop_head(&priv->entries)))
-    struct_table_delete_entry(priv->table, entry);
+  guint32      i;
+
+  for (i = 0; i < priv->entries.len; i++)
+  {
+    entry = priv->entries.items[i];
+    if (entry)
+      struct_table_delete_entry(priv->table, entry);
+  }
+
+  struct_entry_vector_clear(&priv->entries);
 
   priv->size = 0;
 
@@ -536,6 +623,19 @@ coil_struct_get_path(const CoilStruct *self)
   return self->priv->path;
 }
 
+/**
+ * Return the region of the root of @self, NULL if coil is built without
+ * region allocation. Values allocated from it may only be inserted into
+ * structs under the same root.
+ */
+COIL_API(CoilRegion *)
+coil_struct_get_region(const CoilStruct *self)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+
+  return struct_table_get_region(self->priv->table);
+}
+
 COIL_API(gboolean)
 coil_struct_compare_root(const CoilStruct *a,
                           const CoilStruct *b)
@@ -605,17 +705,13 @@ insert_with_existing_entry(CoilStruct  *self,
                            GError     **error)
 {
   /* entry exists for path (value may be null) */
-  GValue *old_value = entry->value;
-
-  if (old_value != NULL
-    && G_VALUE_HOLDS(old_value, COIL_TYPE_STRUCT))
+  if (entry->kind == STRUCT_VALUE_STRUCT)
   {
     CoilStruct *src, *dst;
 
-    src = COIL_STRUCT(g_value_get_object(value));
-    dst = COIL_STRUCT(g_value_get_object(old_value));
+    dst = COIL_STRUCT(g_value_get_object(&entry->value));
 
-    if (src != dst && coil_struct_is_prototype(dst))
+    if (coil_struct_is_prototype(dst))
     {
       if (!G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
       {
@@ -629,21 +725,26 @@ insert_with_existing_entry(CoilStruct  *self,
         return FALSE;
       }
 
-      /* XXX: Overwriting a prototype.
-       * Merge the items from struct we're trying to set now
-       * and destroy it (leaving the prototype in place but casting to
-       * non-prototype).
-       */
-      if (!coil_struct_merge_full(src, dst, TRUE, FALSE, error))
-        return FALSE;
+      src = COIL_STRUCT(g_value_get_object(value));
+
+      if (src != dst)
+      {
+        /* XXX: Overwriting a prototype.
+         * Merge the items from struct we're trying to set now
+         * and destroy it (leaving the prototype in place but casting to
+         * non-prototype).
+         */
+        if (!coil_struct_merge_full(src, dst, TRUE, FALSE, error))
+          return FALSE;
 
-      if (path)
-        coil_path_unref(path);
+        if (path)
+          coil_path_unref(path);
 
-      if (value)
-        coil_value_free(value);
+        if (value)
+          struct_table_free_value(self->priv->table, value);
 
-      return TRUE;
+        return TRUE;
+      }
     }
   }
   else if (!replace)
@@ -657,9 +758,8 @@ insert_with_existing_entry(CoilStruct  *self,
   }
 
   /* entry exists, overwrite value */
-  if (old_value)
-    coil_value_free(old_value);
-  entry->value = value;
+  struct_entry_set_value(self->priv->table, entry, value);
+  struct_table_touch(self->priv->table);
 
   if (entry->path)
     coil_path_unref(entry->path);
@@ -674,6 +774,7 @@ struct_insert_internal(CoilStruct     *self,
                        GValue         *value, /* steals */
                        guint           hash,
                        gboolean        replace, /* TRUE to replace old value */
+                       gboolean        inherited, /* copied from a parent */
                        GError        **error)
 {
   g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
@@ -685,7 +786,7 @@ struct_insert_internal(CoilStruct     *self,
   CoilStructPrivate *const priv = self->priv;
   StructEntry       *entry;
   GError            *internal_error = NULL;
-  gboolean           value_is_struct = FALSE;
+  gboolean           is_new_entry = FALSE;
 
   g_return_val_if_fail(g_str_has_prefix(path->path, priv->path->path),
                        FALSE);
@@ -693,10 +794,12 @@ struct_insert_internal(CoilStruct     *self,
   g_return_val_if_fail(COIL_PATH_CONTAINER_LEN(path) == priv->path->path_len,
                        FALSE);
 
+  /* entries share one path object with every equal path */
+  path = coil_path_intern(path);
+
   if (!struct_change_notify(self, &internal_error))
     goto error;
 
-  /* TODO(jcon): dont check value for struct more than once */
   if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
   {
     CoilStruct *object;
@@ -710,8 +813,6 @@ struct_insert_internal(CoilStruct     *self,
                          coil_struct_get_path(self)->path);
        goto error;
     }
-
-    value_is_struct = TRUE;
   }
 
   entry = struct_table_lookup(priv->table, hash,
@@ -720,33 +821,41 @@ struct_insert_internal(CoilStruct     *self,
   if (entry == NULL)
   {
     entry = struct_table_insert(priv->table, hash, path, value);
-    g_queue_push_tail(&priv->entries, entry);
+    struct_entry_vector_append(&priv->entries, entry);
     priv->size++;
-
-    if (!struct_change_notify(self, &internal_error))
-      goto error;
+    is_new_entry = TRUE;
   }
   else if (!insert_with_existing_entry(self, entry,
                                        path, value,
                                        replace, error))
     goto error;
 
+  /* path and value belong to the entry now, value is moved into it */
+  path = NULL;
+  value = NULL;
+
+  entry->inherited = inherited;
+
+  if (is_new_entry
+    && !struct_change_notify(self, &internal_error))
+    goto error;
+
 #if COIL_DEBUG
   priv->version++;
 #endif
 
   /* XXX: if value is struct, path will change based on container. */
   /* TODO(jcon): implement set_container in expandable */
-  if (value_is_struct)
+  if (entry->kind == STRUCT_VALUE_STRUCT)
   {
     CoilStruct *object, *container;
 
-    object = COIL_STRUCT(g_value_get_object(value));
+    object = COIL_STRUCT(g_value_get_object(&entry->value));
     container = coil_struct_get_container(object);
 
     if (container != self
       && !struct_change_container(object, self,
-                                  path, &hash,
+                                  entry->path, &hash,
                                   TRUE, &internal_error))
       goto error;
 
@@ -754,21 +863,21 @@ struct_insert_internal(CoilStruct     *self,
     if (!coil_struct_is_prototype(object))
       coil_struct_foreach_ancestor(self, TRUE, make_prototype_final, NULL);
 
-    return TRUE;
+    return struct_entry_changed(self, hash, entry->path, error);
   }
 
-  if (G_VALUE_HOLDS(value, COIL_TYPE_EXPANDABLE))
+  if (entry->kind == STRUCT_VALUE_EXPANDABLE)
   {
     CoilExpandable *object;
 
-    object = COIL_EXPANDABLE(g_value_get_object(value));
+    object = COIL_EXPANDABLE(g_value_get_object(&entry->value));
     g_object_set(G_OBJECT(object),
                  "container", self,
                  NULL);
   }
 
   coil_struct_foreach_ancestor(self, TRUE, make_prototype_final, NULL);
-  return TRUE;
+  return struct_entry_changed(self, hash, entry->path, error);
 
 error:
   if (internal_error)
@@ -778,75 +887,28 @@ error:
     coil_path_unref(path);
 
   if (value)
-    coil_value_free(value);
+    struct_table_free_value(self->priv->table, value);
 
   return FALSE;
 }
 
-static void
-compute_path_hash_with_len(const gchar *path,
-                     guint8       path_len,
-                     guint       *hashes,
-                     guint8      *lens,
-                     guint8      *num_parts)
-{
-  g_return_if_fail(path);
-  g_return_if_fail(path_len > 0);
-  g_return_if_fail(lens);
-  g_return_if_fail(hashes);
-
-  guint8       i;
-  const gchar *end, *delim, *next;
-
-  memset(lens, 0, sizeof(*lens) * COIL_PATH_MAX_PARTS);
-  memset(hashes, 0, sizeof(*hashes) * COIL_PATH_MAX_PARTS);
-
-  lens[0] = COIL_ROOT_PATH_LEN;
-  hashes[0] = 0;
-
-  end = path + path_len;
-  delim = path + COIL_ROOT_PATH_LEN + 1;
-
-  next = memchr(delim, COIL_PATH_DELIM, end - delim);
-  for (i = 1; next != NULL; i++)
-  {
-    lens[i] = next - path;
-    hashes[i] = hash_relative_path(hashes[i - 1], delim, next - delim);
-    delim = next + 1;
-    next = memchr(delim, COIL_PATH_DELIM, end - delim);
-  }
-
-  lens[i] = path_len;
-  hashes[i] = hash_relative_path(hashes[i - 1], delim, end - delim);
-
-  if (num_parts)
-    *num_parts = i;
-}
-
-COIL_API(CoilStruct *)
-coil_struct_create_containers_fast(CoilStruct     *self,
-                                   const gchar    *path,
-                                   guint8          path_len,
-                                   gboolean        prototype,
-                                   gboolean        has_lookup,
-                                   GError        **error)
+/*
+ * Create the structs for the first @i keys of @path, given the hash and
+ * length of each prefix of @path.
+ */
+static CoilStruct *
+struct_create_containers(CoilStruct    *self,
+                         const gchar   *path,
+                         const guint   *hashes,
+                         const guint   *lens,
+                         guint          i,
+                         gboolean       prototype,
+                         gboolean       has_lookup,
+                         GError       **error)
 {
-  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
-  g_return_val_if_fail(path, NULL);
-  g_return_val_if_fail(*path == '@', NULL);
-  g_return_val_if_fail(path_len >= COIL_ROOT_PATH_LEN, NULL);
-  g_return_val_if_fail(path_len <= COIL_PATH_LEN, NULL);
-  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
-
   CoilStructPrivate *priv = self->priv;
   CoilStruct        *container;
-  guint              hashes[COIL_PATH_MAX_PARTS];
-  guint8             lens[COIL_PATH_MAX_PARTS], i, missing_keys = 0;
-
-  if (path_len == COIL_ROOT_PATH_LEN)
-    return coil_struct_get_root(self);
-
-  compute_path_hash_with_len(path, path_len, hashes, lens, &i);
+  guint              missing_keys = 0;
 
   g_assert(i > 0);
 
@@ -865,7 +927,7 @@ coil_struct_create_containers_fast(CoilStruct     *self,
     if (entry == NULL)
       continue;
 
-    if (entry->value == NULL)
+    if (entry->kind == STRUCT_VALUE_EMPTY)
     {
       coil_struct_error(error, self,
                         "Attempting to insert value within a previously "
@@ -875,18 +937,18 @@ coil_struct_create_containers_fast(CoilStruct     *self,
       return NULL;
     }
 
-    if (!G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT))
+    if (entry->kind != STRUCT_VALUE_STRUCT)
     {
       coil_struct_error(error, self,
                         "Attempting to assign values in non-struct "
                         "object %.*s type '%s'.",
                         lens[i], path,
-                        G_VALUE_TYPE_NAME(entry->value));
+                        G_VALUE_TYPE_NAME(&entry->value));
 
       return NULL;
     }
 
-    container = COIL_STRUCT(g_value_get_object(entry->value));
+    container = COIL_STRUCT(g_value_get_object(&entry->value));
     break;
   }
 
@@ -899,7 +961,7 @@ coil_struct_create_containers_fast(CoilStruct     *self,
   {
     CoilPath   *p;
     gchar      *str, *key;
-    guint8      key_len;
+    guint       key_len;
     CoilStruct *prev;
 
     prev = g_object_ref(container);
@@ -924,6 +986,86 @@ coil_struct_create_containers_fast(CoilStruct     *self,
   return container;
 }
 
+COIL_API(CoilStruct *)
+coil_struct_create_containers_fast(CoilStruct     *self,
+                                   const gchar    *path,
+                                   guint           path_len,
+                                   gboolean        prototype,
+                                   gboolean        has_lookup,
+                                   GError        **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(*path == '@', NULL);
+  g_return_val_if_fail(path_len >= COIL_ROOT_PATH_LEN, NULL);
+  g_return_val_if_fail(path_len <= COIL_PATH_LEN, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilStruct *container;
+  CoilPath   *p;
+
+  if (path_len == COIL_ROOT_PATH_LEN)
+    return coil_struct_get_root(self);
+
+  p = coil_path_take_strings((gchar *)path, path_len, NULL, 0,
+                             COIL_STATIC_PATH | COIL_PATH_IS_ABSOLUTE);
+
+  container = coil_struct_create_containers_path(self, p,
+                                                 prototype, has_lookup,
+                                                 error);
+  coil_path_unref(p);
+
+  return container;
+}
+
+/* create the structs leading up to the container of @path */
+static CoilStruct *
+struct_create_path_container(CoilStruct *self,
+                             CoilPath   *path,
+                             gboolean    prototype,
+                             GError    **error)
+{
+  const guint  *hashes;
+  const guint  *lens;
+  guint         n_keys;
+
+  n_keys = coil_path_get_prefixes(path, &hashes, &lens);
+  if (n_keys <= 1)
+    return coil_struct_get_root(self);
+
+  return struct_create_containers(self, path->path, hashes, lens, n_keys - 1,
+                                  prototype, FALSE, error);
+}
+
+/**
+ * Same as coil_struct_create_containers_fast but uses the prefix hashes
+ * cached in @path.
+ */
+COIL_API(CoilStruct *)
+coil_struct_create_containers_path(CoilStruct *self,
+                                   CoilPath   *path,
+                                   gboolean    prototype,
+                                   gboolean    has_lookup,
+                                   GError    **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(path), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  const guint  *hashes;
+  const guint  *lens;
+  guint         n_keys;
+
+  if (COIL_PATH_IS_ROOT(path))
+    return coil_struct_get_root(self);
+
+  n_keys = coil_path_get_prefixes(path, &hashes, &lens);
+
+  return struct_create_containers(self, path->path, hashes, lens, n_keys,
+                                  prototype, has_lookup, error);
+}
+
 COIL_API(CoilStruct *)
 coil_struct_create_containers(CoilStruct  *self,
                               const gchar *path,
@@ -937,13 +1079,21 @@ coil_struct_create_containers(CoilStruct  *self,
   g_return_val_if_fail(path_len > 0, NULL);
   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
-  if (!coil_check_path(path, path_len, error))
+  CoilPath   *p;
+  CoilStruct *result;
+
+  p = coil_path_take_checked((gchar *)path, path_len,
+                             COIL_STATIC_PATH | COIL_PATH_IS_ABSOLUTE,
+                             error);
+  if (p == NULL)
     return NULL;
 
-  return coil_struct_create_containers_fast(self,
-                                            path, path_len,
-                                            prototype, has_lookup,
-                                            error);
+  result = coil_struct_create_containers_path(self, p,
+                                              prototype, has_lookup,
+                                              error);
+  coil_path_unref(p);
+
+  return result;
 }
 
 
@@ -974,21 +1124,20 @@ coil_struct_insert_path(CoilStruct *self,
     goto error;
   }
 
-  container = coil_struct_create_containers(self, path->path,
-                                            COIL_PATH_CONTAINER_LEN(path),
-                                            TRUE, FALSE, error);
+  container = struct_create_path_container(self, path, TRUE, error);
 
   if (G_UNLIKELY(container == NULL))
     goto error;
 
-  return struct_insert_internal(container, path, value, hash, replace, error);
+  return struct_insert_internal(container, path, value, hash,
+                                replace, FALSE, error);
 
 error:
   if (path)
     coil_path_unref(path);
 
   if (value)
-    coil_value_free(value);
+    struct_table_free_value(self->priv->table, value);
 
   return FALSE;
 }
@@ -1007,17 +1156,18 @@ coil_struct_insert(CoilStruct  *self,
   g_return_val_if_fail(value, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  if (!coil_check_path(path, path_len, error))
+  CoilPath *p = coil_path_take_checked(path, path_len, 0, error);
+
+  if (p == NULL)
     return FALSE;
 
-  return coil_struct_insert_fast(self, path, (guint8)path_len,
-                                 value, replace, error);
+  return coil_struct_insert_path(self, p, value, replace, error);
 }
 
 COIL_API(gboolean)
 coil_struct_insert_fast(CoilStruct *self,
                         gchar      *path,
-                        guint8      path_len,
+                        guint       path_len,
                         GValue     *value,
                         gboolean    replace,
                         GError    **error)
@@ -1056,29 +1206,192 @@ coil_struct_insert_key(CoilStruct   *self,
   if (path == NULL)
     return FALSE;
 
-  return struct_insert_internal(self, path, value, hash, replace, error);
+  return struct_insert_internal(self, path, value, hash,
+                                replace, FALSE, error);
 }
 
-static gboolean
-struct_remove_entry(CoilStruct            *self,
-                    const StructEntry     *entry,
-                    GError               **error)
+typedef struct _BatchItem
 {
-  CoilStructPrivate *const priv = self->priv;
+  CoilPath *path;
+  GValue   *value;
+  guint     hash;
+  guint     index; /* in the items given */
+} BatchItem;
 
-#if 0
-  GError            *internal_error = NULL;
-  g_signal_emit(self, struct_signals[MODIFY],
-                0, (gpointer *)&internal_error);
+/* by container path, items of one container in the order given */
+static gint
+batch_item_cmp(gconstpointer a,
+               gconstpointer b,
+               gpointer      unused)
+{
+  const BatchItem *x = a, *y = b;
+  guint            xlen = COIL_PATH_CONTAINER_LEN(x->path);
+  guint            ylen = COIL_PATH_CONTAINER_LEN(y->path);
+  gint             r;
 
-  if (G_UNLIKELY(internal_error))
+  r = memcmp(x->path->path, y->path->path, MIN(xlen, ylen));
+  if (r)
+    return r;
+
+  if (xlen != ylen)
+    return xlen < ylen ? -1 : 1;
+
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void
+batch_items_free(StructTable *table,
+                 BatchItem   *batch,
+                 guint        first,
+                 guint        last)
+{
+  for (; first < last; first++)
   {
-    g_propagate_error(error, internal_error);
+    coil_path_unref(batch[first].path);
+    struct_table_free_value(table, batch[first].value);
+  }
+}
+
+/**
+ * coil_struct_insert_batch: Insert many values at once
+ *
+ * Same as coil_struct_insert() for each of @items, but checks every
+ * path first and sorts the items by container so each container is
+ * found or created once. The table is sized for the new keys up front and
+ * dependents of @self are notified once, before anything changes.
+ * Keys of one struct keep the order given, structs created for them
+ * are added in path order. The paths and values of @items are taken
+ * over whether they are inserted or not, items inserted before an
+ * error stay.
+ *
+ * @self: A CoilStruct instance, relative paths are resolved from it.
+ * @items: Paths and values to insert.
+ * @n_items: Number of @items.
+ * @replace: TRUE to replace values already set.
+ * @error: GError reference or NULL.
+ */
+COIL_API(gboolean)
+coil_struct_insert_batch(CoilStruct     *self,
+                         CoilStructItem *items, /* steals contents */
+                         guint           n_items,
+                         gboolean        replace,
+                         GError        **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(items || n_items == 0, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  BatchItem  *batch = g_new(BatchItem, n_items);
+  CoilStruct *container = NULL;
+  guint       i, j, n_new, reserved;
+
+  for (i = 0; i < n_items; i++)
+  {
+    BatchItem *item = &batch[i];
+
+    item->value = items[i].value;
+    item->index = i;
+    item->path = coil_path_take_checked(items[i].path, items[i].path_len,
+                                        0, error);
+
+    if (item->path == NULL)
+    {
+      g_free(items[i].path);
+      struct_table_free_value(self->priv->table, item->value);
+      goto error;
+    }
+
+    if (!struct_resolve_path_into(self, &item->path, &item->hash, error))
+      goto item_error;
+
+    if (COIL_PATH_IS_ROOT(item->path))
+    {
+      coil_struct_error(error, self,
+                        "Cannot assign a value directly to @root.");
+
+      goto item_error;
+    }
+  }
+
+  g_qsort_with_data(batch, n_items, sizeof(BatchItem), batch_item_cmp, NULL);
+
+  if (n_items > 0 && !struct_change_notify(self, error))
+  {
+    batch_items_free(self->priv->table, batch, 0, n_items);
+    g_free(batch);
+
     return FALSE;
   }
-#endif
 
-  g_queue_remove(&priv->entries, (gpointer)entry);
+  /* keys already set replace their entries in place */
+  for (i = 0, n_new = 0; i < n_items; i++)
+    if (!struct_table_lookup(self->priv->table, batch[i].hash,
+                             batch[i].path->path, batch[i].path->path_len))
+      n_new++;
+
+  reserved = struct_table_reserve(self->priv->table, n_new);
+  coil_struct_begin_batch(self);
+
+  for (i = 0; i < n_items; i++)
+  {
+    BatchItem *item = &batch[i];
+    guint      container_len = COIL_PATH_CONTAINER_LEN(item->path);
+
+    if (container == NULL
+      || container->priv->path->path_len != container_len
+      || memcmp(container->priv->path->path, item->path->path,
+                container_len))
+    {
+      container = struct_create_path_container(self, item->path,
+                                               TRUE, error);
+
+      if (G_UNLIKELY(container == NULL))
+      {
+        batch_items_free(self->priv->table, batch, i, n_items);
+        break;
+      }
+    }
+
+    if (!struct_insert_internal(container, item->path, item->value,
+                                item->hash, replace, FALSE, error))
+    {
+      batch_items_free(self->priv->table, batch, i + 1, n_items);
+      break;
+    }
+  }
+
+  coil_struct_end_batch(self);
+  struct_table_release(self->priv->table, reserved);
+  g_free(batch);
+
+  return i == n_items;
+
+item_error:
+  coil_path_unref(batch[i].path);
+  struct_table_free_value(self->priv->table, batch[i].value);
+
+error:
+  batch_items_free(self->priv->table, batch, 0, i);
+
+  for (j = i + 1; j < n_items; j++)
+  {
+    g_free(items[j].path);
+    struct_table_free_value(self->priv->table, items[j].value);
+  }
+
+  g_free(batch);
+
+  return FALSE;
+}
+
+static gboolean
+struct_remove_entry(CoilStruct            *self,
+                    StructEntry           *entry,
+                    GError               **error)
+{
+  CoilStructPrivate *const priv = self->priv;
+
+  struct_entry_vector_remove(&priv->entries, entry);
 
 #if COIL_DEBUG
   priv->version++;
@@ -1111,7 +1424,7 @@ static gboolean
 struct_delete_internal(CoilStruct   *self,
                        guint         hash,
                        const gchar  *path,
-                       guint8        path_len,
+                       guint         path_len,
                        gboolean      strict,
                        gboolean      reset_container,
                        GError      **error)
@@ -1125,6 +1438,8 @@ struct_delete_internal(CoilStruct   *self,
   CoilStructPrivate *const priv = self->priv;
   CoilStruct        *container;
   StructEntry       *entry;
+  CoilPath          *entry_path;
+  gboolean           result;
 
   entry = struct_table_lookup(priv->table, hash, path, path_len);
 
@@ -1148,17 +1463,29 @@ struct_delete_internal(CoilStruct   *self,
   if (container == NULL)
     return FALSE;
 
+  /* structs sharing entries of container take their copy first */
+  if (reset_container && !struct_change_notify(container, error))
+    return FALSE;
+
   if (reset_container
-    && G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT))
+    && entry->kind == STRUCT_VALUE_STRUCT)
   {
-    GObject *object = g_value_get_object(entry->value);
+    GObject *object = g_value_get_object(&entry->value);
     if (!struct_change_container(COIL_STRUCT(object),
                                  NULL, NULL, NULL, FALSE,
                                  error))
       return FALSE;
   }
 
-  return struct_delete_entry(container, entry, error);
+  /* the entry takes its path along */
+  entry_path = coil_path_ref(entry->path);
+
+  result = struct_delete_entry(container, entry, error)
+    && struct_entry_changed(container, hash, entry_path, error);
+
+  coil_path_unref(entry_path);
+
+  return result;
 }
 
 COIL_API(gboolean)
@@ -1211,13 +1538,11 @@ coil_struct_delete(CoilStruct  *self,
 
   CoilPath *p;
 
-  if (!coil_check_path(path, path_len, error))
+  p = coil_path_take_checked((gchar *)path, path_len,
+                             COIL_STATIC_PATH, error);
+  if (p == NULL)
     return FALSE;
 
-  p = coil_path_take_strings((gchar *)path, path_len,
-                             NULL, 0,
-                             COIL_STATIC_PATH);
-
   return coil_struct_delete_path(self, p, strict, error);
 }
 
@@ -1238,7 +1563,8 @@ coil_struct_delete_key(CoilStruct  *self,
   const CoilPath    *const p = priv->path;
   guint              hash;
   gchar             *path;
-  guint8             path_len;
+  guint              path_len;
+  gboolean           result;
 
   if (!coil_check_key(key, key_len, error))
     return FALSE;
@@ -1249,11 +1575,15 @@ coil_struct_delete_key(CoilStruct  *self,
                          p->path, p->path_len,
                          key, key_len);
 
-  return struct_delete_internal(self, hash,
-                                path, path_len,
-                                strict, TRUE,
-                                error);
-}
+  result = struct_delete_internal(self, hash,
+                                  path, path_len,
+                                  strict, TRUE,
+                                  error);
+
+  COIL_PATH_QUICK_BUFFER_FREE(path, path_len);
+
+  return result;
+}
 
 static gboolean
 struct_mark_deleted_internal(CoilStruct  *self,
@@ -1275,7 +1605,7 @@ struct_mark_deleted_internal(CoilStruct  *self,
 
   if (entry && !force)
   {
-    if (entry->value == NULL)
+    if (entry->kind == STRUCT_VALUE_EMPTY)
        coil_struct_error(error, self,
          "Attempting to delete '%s' twice.",
          path->key);
@@ -1286,19 +1616,7 @@ struct_mark_deleted_internal(CoilStruct  *self,
 
     goto error;
   }
-/*
-  GError *internal_error = NULL;
-  g_signal_emit(self, struct_signals[MODIFY], 0,
-      (gpointer *)&internal_error);
-
-  if (G_UNLIKELY(internal_error))
-  {
-    g_propagate_error(error, internal_error);
-    goto error;
-  }
-*/
-
-  struct_table_insert(priv->table, hash, path, NULL);
+  struct_table_insert(priv->table, hash, coil_path_intern(path), NULL);
 
 #if COIL_DEBUG
   priv->version++;
@@ -1335,11 +1653,7 @@ coil_struct_mark_deleted_path(CoilStruct     *self,
     return FALSE;
   }
 
-  container = coil_struct_create_containers(self,
-                                            path->path,
-                                            COIL_PATH_CONTAINER_LEN(path),
-                                            TRUE, FALSE,
-                                            error);
+  container = struct_create_path_container(self, path, TRUE, error);
 
   if (G_UNLIKELY(container == NULL))
     return FALSE;
@@ -1350,7 +1664,7 @@ coil_struct_mark_deleted_path(CoilStruct     *self,
 COIL_API(gboolean)
 coil_struct_mark_deleted_fast(CoilStruct *self,
                               gchar      *path,
-                              guint8      path_len,
+                              guint       path_len,
                               gboolean    force,
                               GError    **error)
 {
@@ -1378,10 +1692,12 @@ coil_struct_mark_deleted(CoilStruct  *self,
   g_return_val_if_fail(path_len, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  if (!coil_check_path(path, path_len, error))
+  CoilPath *p = coil_path_take_checked(path, path_len, 0, error);
+
+  if (p == NULL)
     return FALSE;
 
-  return coil_struct_mark_deleted_fast(self, path, path_len, force, error);
+  return coil_struct_mark_deleted_path(self, p, force, error);
 }
 
 COIL_API(gboolean)
@@ -1521,7 +1837,7 @@ coil_struct_add_dependency(CoilStruct     *self,
     if(G_UNLIKELY(!check_parent_sanity(self, parent, error)))
       return FALSE;
 
-    struct_connect_expand_notify(self, parent);
+    struct_add_observer(self, parent);
   }
   else
   {
@@ -1562,86 +1878,127 @@ coil_struct_add_dependency(CoilStruct     *self,
 }
 
 static void
-expand_notify_free(gpointer  data,
-                   GClosure *closure)
+observer_link(CoilStruct *self, /* dependent */
+              CoilStruct *parent,
+              gboolean    is_heir,
+              guint       order)
 {
-  g_return_if_fail(data);
-  g_free(data);
-}
+  g_return_if_fail(COIL_IS_STRUCT(self));
+  g_return_if_fail(COIL_IS_STRUCT(parent));
 
-static GError *
-struct_expand_notify(GObject *instance, /* parent */
-                     gpointer data) /* ExpandNotify */
-{
-  g_return_val_if_fail(COIL_IS_STRUCT(instance), NULL);
-  g_return_val_if_fail(data, NULL);
+  CoilStructPrivate *const priv = self->priv;
+  CoilStructPrivate *const parent_priv = parent->priv;
+  StructObserver    *observer = g_slice_new(StructObserver);
+  StructObserver   **head;
 
-  ExpandNotify      *notify = (ExpandNotify *)data;
-  CoilStruct        *self = notify->object;
-  GError            *internal_error = NULL;
+  head = is_heir ? &parent_priv->heirs : &parent_priv->observers;
 
-  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  observer->parent = parent;
+  observer->dependent = self;
+  observer->order = order;
+  observer->is_heir = is_heir;
 
-  g_signal_handler_disconnect(instance, notify->handler_id);
-  /* notify = NULL */
+  observer->prev = NULL;
+  observer->next = *head;
+  if (*head)
+    (*head)->prev = observer;
+  *head = observer;
 
-  coil_struct_expand(self, &internal_error);
+  observer->next_parent = priv->observing;
+  priv->observing = observer;
+}
 
-  return internal_error;
+static void
+struct_add_observer(CoilStruct *self, /* dependent */
+                    CoilStruct *parent)
+{
+  observer_link(self, parent, FALSE, 0);
 }
 
 static void
-prototype_cast_notify(GObject    *instance, /* parent */
-                      GParamSpec *unused, /* ignore argument */
-                      gpointer    data) /* ExpandNotify */
+observer_unlink(StructObserver *observer)
 {
-  g_return_if_fail(COIL_IS_STRUCT(instance));
-  g_return_if_fail(data);
+  g_return_if_fail(observer);
 
-  CoilStruct   *self, *parent;
-  ExpandNotify *notify = (ExpandNotify *)data;
+  CoilStructPrivate *const parent_priv = observer->parent->priv;
+  StructObserver   **link = &observer->dependent->priv->observing;
 
-  self = notify->object;
-  parent = COIL_STRUCT(instance);
+  if (observer->prev)
+    observer->prev->next = observer->next;
+  else if (observer->is_heir)
+    parent_priv->heirs = observer->next;
+  else
+    parent_priv->observers = observer->next;
 
-  if (!coil_struct_is_prototype(parent))
-  {
-    g_signal_handler_disconnect(instance, notify->handler_id);
+  if (observer->next)
+    observer->next->prev = observer->prev;
 
-    notify = g_new(ExpandNotify, 1);
-    notify->object = self;
-    notify->handler_id = g_signal_connect_data(instance, "modify",
-                                               G_CALLBACK(struct_expand_notify),
-                                               notify, expand_notify_free, 0);
-  }
+  /* a struct observes only as many parents as it has dependencies */
+  while (*link != observer)
+    link = &(*link)->next_parent;
+
+  *link = observer->next_parent;
+
+  g_slice_free(StructObserver, observer);
 }
 
 static void
-struct_connect_expand_notify(CoilStruct *const self,
-                             CoilStruct *const parent)
+struct_remove_observer(CoilStruct *self, /* dependent */
+                       CoilStruct *parent)
 {
   g_return_if_fail(COIL_IS_STRUCT(self));
   g_return_if_fail(COIL_IS_STRUCT(parent));
 
-  ExpandNotify *notify = g_new(ExpandNotify, 1);
-  const gchar  *detailed_signal;
-  GCallback     callback;
+  StructObserver *observer;
 
-  notify->object = self;
+  for (observer = self->priv->observing;
+       observer != NULL;
+       observer = observer->next_parent)
+  {
+    if (observer->parent == parent && !observer->is_heir)
+    {
+      observer_unlink(observer);
+      return;
+    }
+  }
+}
 
-  if (coil_struct_is_prototype(parent))
+/*
+ * Expand every struct observing @self. Each observer is dropped before
+ * its struct is expanded, the expansion may change @self again. Like
+ * handlers of a signal every observer runs, only one error is kept.
+ */
+static gboolean
+struct_notify_observers(CoilStruct  *self,
+                        GError     **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  CoilStructPrivate *const priv = self->priv;
+  StructObserver    *observer;
+  CoilStruct        *dependent;
+  GError            *internal_error = NULL;
+
+  /* dependents of a prototype wait for it to be defined */
+  if (priv->is_prototype)
+    return TRUE;
+
+  while ((observer = priv->observers))
   {
-    detailed_signal = "notify::is-prototype";
-    callback = G_CALLBACK(prototype_cast_notify);
+    dependent = observer->dependent;
+    observer_unlink(observer);
+
+    coil_struct_expand(dependent, internal_error ? NULL : &internal_error);
   }
-  else
+
+  if (G_UNLIKELY(internal_error))
   {
-    detailed_signal = "modify";
-    callback = G_CALLBACK(struct_expand_notify);
+    g_propagate_error(error, internal_error);
+    return FALSE;
   }
 
-  notify->handler_id = g_signal_connect_data(parent, detailed_signal, callback,
-                                             notify, expand_notify_free, 0);
+  return TRUE;
 }
 
 COIL_API(gboolean)
@@ -1680,7 +2037,7 @@ coil_struct_extend_path(CoilStruct  *self,
   if (!struct_resolve_path_into(context, &path, &hash, error))
     goto error;
 
-  value = struct_lookup_internal(context, hash,
+  value = struct_lookup_internal(context, path, hash,
                                  path->path, path->path_len,
                                  FALSE, FALSE, &internal_error);
 
@@ -1706,9 +2063,9 @@ coil_struct_extend_path(CoilStruct  *self,
   {
     CoilStruct *container;
 
-    container = coil_struct_create_containers(context,
-                                              path->path, path->path_len,
-                                              TRUE, TRUE, &internal_error);
+    container = coil_struct_create_containers_path(context, path,
+                                                   TRUE, TRUE,
+                                                   &internal_error);
 
     if (G_UNLIKELY(container == NULL))
       goto error;
@@ -1768,7 +2125,7 @@ coil_struct_iter_init(CoilStructIter *iter,
 #if COIL_DEBUG
   iter->version = priv->version;
 #endif
-  iter->position = g_queue_peek_head_link(&priv->entries);
+  iter->position = 0;
 }
 
 static gboolean
@@ -1789,13 +2146,17 @@ struct_iter_next_entry(CoilStructIter *iter,
   g_return_val_if_fail(iter->version == self->priv->version, FALSE);
 #endif
 
-  if (!iter->position)
-    return FALSE;
+  const StructEntryVector *entries = &iter->node->priv->entries;
 
-  *entry = (StructEntry *)iter->position->data;
-  iter->position = g_list_next(iter->position);
+  /* skip tombstones */
+  while (iter->position < entries->len)
+  {
+    *entry = entries->items[iter->position++];
+    if (*entry)
+      return TRUE;
+  }
 
-  return TRUE;
+  return FALSE;
 }
 
 COIL_API(gboolean)
@@ -1815,7 +2176,7 @@ coil_struct_iter_next(CoilStructIter  *iter,
     *path = entry->path;
 
   if (value)
-    *value = entry->value;
+    *value = STRUCT_ENTRY_VALUE(entry);
 
   return TRUE;
 }
@@ -1831,14 +2192,21 @@ coil_struct_iter_next_expand(CoilStructIter  *iter,
   g_return_val_if_fail(value, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  if (!coil_struct_iter_next(iter, path, value))
+  StructEntry *entry;
+
+  if (!struct_iter_next_entry(iter, &entry))
     return FALSE;
 
+  if (path)
+    *path = entry->path;
+
+  *value = STRUCT_ENTRY_VALUE(entry);
+
   if (!struct_change_notify(iter->node, error))
     return FALSE;
 
   /* stop iteration on error */
-  if (G_VALUE_HOLDS(*value, COIL_TYPE_EXPANDABLE))
+  if (STRUCT_ENTRY_IS_EXPANDABLE(entry))
     return coil_expand_value(*value, value, recursive, error);
 
   return TRUE;
@@ -1852,40 +2220,124 @@ struct_change_notify(CoilStruct  *self,
   g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  CoilStruct        *container;
-  CoilStructPrivate *priv = self->priv;
-  GError            *internal_error = NULL;
+  do
+  {
+    CoilStructPrivate *const priv = self->priv;
 
-  if (priv->is_accumulating)
-    return TRUE;
+    if (priv->batch_depth > 0)
+      return TRUE;
 
-  g_signal_emit(self, struct_signals[MODIFY], 0, &internal_error);
-  if (G_UNLIKELY(internal_error))
-  {
-    g_propagate_error(error, internal_error);
-    return FALSE;
-  }
+    if (priv->observers && !struct_notify_observers(self, error))
+      return FALSE;
 
-  container = coil_struct_get_container(self);
-  if (container == NULL)
-    return TRUE;
+    /* only pay for the signal when someone listens */
+    if (G_UNLIKELY(g_signal_has_handler_pending(self, struct_signals[MODIFY],
+                                                0, FALSE)))
+    {
+      GError *internal_error = NULL;
+
+      g_signal_emit(self, struct_signals[MODIFY], 0, &internal_error);
 
-  return struct_change_notify(container, error);
+      if (G_UNLIKELY(internal_error))
+      {
+        g_propagate_error(error, internal_error);
+        return FALSE;
+      }
+    }
+
+    self = coil_struct_get_container(self);
+  } while (self);
+
+  return TRUE;
+}
+
+/**
+ * coil_struct_begin_batch: Stop reporting changes to @self
+ *
+ * Until the matching coil_struct_end_batch() changes to @self do not
+ * expand the structs inheriting from it, and are not reported to its
+ * containers. Batches nest.
+ *
+ * @self: A CoilStruct instance.
+ */
+COIL_API(void)
+coil_struct_begin_batch(CoilStruct *self)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+
+  self->priv->batch_depth++;
+}
+
+/**
+ * coil_struct_end_batch: Resume reporting changes to @self
+ *
+ * Ends the batch started by the last coil_struct_begin_batch().
+ *
+ * @self: A CoilStruct instance.
+ */
+COIL_API(void)
+coil_struct_end_batch(CoilStruct *self)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+  g_return_if_fail(self->priv->batch_depth > 0);
+
+  self->priv->batch_depth--;
 }
 
+/**
+ * coil_struct_set_loading: Mark the tree of @self as being loaded
+ *
+ * While set, keys changed in a struct are not copied again into the
+ * structs inheriting from it, so a document sees a parent as it was
+ * where it is extended. Set by the parser for the document it builds.
+ *
+ * @self: A CoilStruct instance.
+ * @is_loading: TRUE while the document is parsed.
+ */
+COIL_API(void)
+coil_struct_set_loading(CoilStruct *self,
+                        gboolean    is_loading)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+
+  self->priv->root->priv->is_loading = is_loading;
+}
+
+/*
+ * TRUE if @self can share the entries of @parent instead of copying
+ * them, by depending on @parent like @extends does. Entries are copied
+ * only when @self is expanded and @parent is never modified before
+ * @self has its copy, see struct_change_notify(). Sharing does not work
+ * across roots, copies into another root are made right away. Once
+ * expanded @self holds a full copy of what it inherits, so this saves
+ * memory only for structs that are never expanded.
+ */
 static gboolean
-struct_merge_item(CoilStruct     *self,
-                  const CoilPath *srcpath,
-                  const GValue   *srcvalue,
-                  gboolean        overwrite,
-                  gboolean        force_expand,
-                  GError        **error)
+struct_can_share(const CoilStruct *self,
+                 const CoilStruct *parent)
 {
   g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
-  g_return_val_if_fail(srcpath, FALSE);
-  g_return_val_if_fail(G_IS_VALUE(srcvalue), FALSE);
+  g_return_val_if_fail(COIL_IS_STRUCT(parent), FALSE);
+
+  return !coil_struct_is_prototype(parent)
+    && coil_struct_compare_root(self, parent)
+    && check_parent_sanity(self, parent, NULL);
+}
+
+static gboolean
+struct_merge_item(CoilStruct        *self,
+                  const StructEntry *srcentry,
+                  gboolean           overwrite,
+                  gboolean           force_expand,
+                  GError           **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(srcentry, FALSE);
+  g_return_val_if_fail(srcentry->kind != STRUCT_VALUE_EMPTY, FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
+  const CoilPath    *srcpath = srcentry->path;
+  const GValue      *srcvalue = &srcentry->value;
   CoilStructPrivate *priv = self->priv;
   StructEntry       *entry;
   CoilPath          *path = NULL;
@@ -1905,14 +2357,13 @@ struct_merge_item(CoilStruct     *self,
   if (entry && !overwrite)
   {
     /* merge values if old and new entries are structs */
-    if (entry->value
-      && G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT)
-      && G_VALUE_HOLDS(srcvalue, COIL_TYPE_STRUCT))
+    if (entry->kind == STRUCT_VALUE_STRUCT
+      && srcentry->kind == STRUCT_VALUE_STRUCT)
     {
       CoilStruct *src, *dst;
 
       src  = COIL_STRUCT(g_value_get_object(srcvalue));
-      dst = COIL_STRUCT(g_value_get_object(entry->value));
+      dst = COIL_STRUCT(g_value_get_object(&entry->value));
 
       if (!coil_struct_merge_full(src, dst,
                                   overwrite, force_expand,
@@ -1932,7 +2383,7 @@ struct_merge_item(CoilStruct     *self,
     return TRUE;
   }
 
-  if (G_VALUE_HOLDS(srcvalue, COIL_TYPE_STRUCT))
+  if (srcentry->kind == STRUCT_VALUE_STRUCT)
   {
     CoilStruct *obj, *new_obj;
 
@@ -1945,15 +2396,22 @@ struct_merge_item(CoilStruct     *self,
     if (new_obj == NULL)
       goto error;
 
-    if (!coil_struct_merge_full(obj, new_obj,
-                                overwrite, force_expand,
-                                &internal_error))
+    /* inherit obj by reference, overwriting merges replace self with a
+     * struct that does not outlive them so those are copied */
+    if (!overwrite && !force_expand && struct_can_share(new_obj, obj))
+    {
+      if (!coil_struct_add_dependency(new_obj, obj, &internal_error))
+        goto error;
+    }
+    else if (!coil_struct_merge_full(obj, new_obj,
+                                     overwrite, force_expand,
+                                     &internal_error))
       goto error;
 
     coil_value_init(value, COIL_TYPE_STRUCT, take_object, new_obj);
   }
   else if (force_expand
-    && G_VALUE_HOLDS(srcvalue, COIL_TYPE_EXPANDABLE))
+    && srcentry->kind == STRUCT_VALUE_EXPANDABLE)
   {
     const GValue *real_value = NULL;
 
@@ -1969,7 +2427,7 @@ struct_merge_item(CoilStruct     *self,
 
     value = coil_value_copy(real_value);
   }
-  else if (G_VALUE_HOLDS(srcvalue, COIL_TYPE_EXPANDABLE))
+  else if (srcentry->kind == STRUCT_VALUE_EXPANDABLE)
   {
     CoilExpandable *obj, *obj_copy;
 
@@ -1986,7 +2444,7 @@ struct_merge_item(CoilStruct     *self,
   else
     value = coil_value_copy(srcvalue);
 
-  if (!struct_insert_internal(self, path, value, hash, TRUE, error))
+  if (!struct_insert_internal(self, path, value, hash, TRUE, TRUE, error))
     goto error;
 
   return TRUE;
@@ -2001,6 +2459,281 @@ error:
   return FALSE;
 }
 
+/*
+ * Copy the key of @srcpath into @self again from the first parent
+ * holding it, the one struct_merge_item() took it from when @self was
+ * expanded. Keys set in @self itself, deleted keys included, are kept.
+ */
+static gboolean
+struct_inherit_key(CoilStruct     *self,
+                   const CoilPath *srcpath,
+                   GError        **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(srcpath, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  CoilStructPrivate *const priv = self->priv;
+  StructObserver    *heir, *source = NULL;
+  StructEntry       *entry, *srcentry = NULL, *candidate;
+  CoilPath          *path, *parent_path;
+  guint              hash, parent_hash;
+  gboolean           result = TRUE;
+
+  hash = hash_relative_path(priv->hash, srcpath->key, srcpath->key_len);
+
+  path = coil_path_concat(priv->path, srcpath, error);
+  if (path == NULL)
+    return FALSE;
+
+  entry = struct_table_lookup(priv->table, hash,
+                              path->path, path->path_len);
+
+  if (entry && !entry->inherited)
+    goto done;
+
+  for (heir = priv->observing; heir; heir = heir->next_parent)
+  {
+    CoilStructPrivate *const parent_priv = heir->parent->priv;
+
+    if (!heir->is_heir || (source && heir->order > source->order))
+      continue;
+
+    parent_hash = hash_relative_path(parent_priv->hash,
+                                     srcpath->key, srcpath->key_len);
+
+    parent_path = coil_path_concat(parent_priv->path, srcpath, error);
+    if (parent_path == NULL)
+    {
+      result = FALSE;
+      goto done;
+    }
+
+    candidate = struct_table_lookup(parent_priv->table, parent_hash,
+                                    parent_path->path,
+                                    parent_path->path_len);
+
+    coil_path_unref(parent_path);
+
+    if (candidate && candidate->kind != STRUCT_VALUE_EMPTY)
+    {
+      source = heir;
+      srcentry = candidate;
+    }
+  }
+
+  /* replaced in place to keep the order of keys */
+  if (srcentry)
+    result = struct_merge_item(self, srcentry, entry != NULL,
+                               COIL_STRICT_CONTEXT, error);
+  else if (entry)
+    result = struct_delete_internal(self, hash,
+                                    path->path, path->path_len,
+                                    FALSE, TRUE, error);
+
+done:
+  coil_path_unref(path);
+
+  return result;
+}
+
+/* copy a key changed in @self into the structs inheriting from it */
+static gboolean
+struct_update_heirs(CoilStruct     *self,
+                    const CoilPath *path,
+                    GError        **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(path, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  StructObserver *heir, *next;
+
+  for (heir = self->priv->heirs; heir; heir = next)
+  {
+    next = heir->next;
+
+    if (!struct_inherit_key(heir->dependent, path, error))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+readers_invalidate(GHashTable *readers,
+                   guint       hash)
+{
+  GSList *list;
+
+  list = g_hash_table_lookup(readers, GUINT_TO_POINTER(hash));
+
+  /* finalized readers are left as NULL */
+  for (; list; list = g_slist_next(list))
+    if (list->data)
+      coil_expandable_invalidate(list->data);
+}
+
+/*
+ * Invalidate the expandables reading the value of @hash in @self, or
+ * the value of any container holding it.
+ */
+static void
+struct_invalidate_readers(CoilStruct *self,
+                          guint       hash)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+
+  GHashTable *readers = self->priv->root->priv->readers;
+
+  if (G_LIKELY(readers == NULL))
+    return;
+
+  readers_invalidate(readers, hash);
+
+  do
+  {
+    readers_invalidate(readers, self->priv->hash);
+    self = coil_struct_get_container(self);
+  } while (self);
+}
+
+static void
+readers_free(GHashTable *readers)
+{
+  GHashTableIter  it;
+  GSList         *list, *link;
+
+  g_hash_table_iter_init(&it, readers);
+
+  while (g_hash_table_iter_next(&it, NULL, (gpointer *)&list))
+  {
+    for (link = list; link; link = g_slist_next(link))
+      if (link->data)
+        g_object_remove_weak_pointer(G_OBJECT(link->data), &link->data);
+
+    g_slist_free(list);
+  }
+
+  g_hash_table_destroy(readers);
+}
+
+/* Call after the entry of @hash and @path in @self was set or deleted */
+static gboolean
+struct_entry_changed(CoilStruct     *self,
+                     guint           hash,
+                     const CoilPath *path,
+                     GError        **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(path, FALSE);
+
+  struct_drop_content_hash(self);
+  struct_invalidate_readers(self, hash);
+
+  /* a document inherits the keys set before @extends, not after */
+  if (self->priv->heirs && !self->priv->root->priv->is_loading)
+    return struct_update_heirs(self, path, error);
+
+  return TRUE;
+}
+
+/**
+ * coil_struct_add_reader: Expand @reader again when @path changes
+ *
+ * Once @path, or a container of @path, is set or deleted in the tree
+ * of @self, coil_expandable_invalidate() is called on @reader. Readers
+ * are not referenced and are dropped when finalized.
+ *
+ * @self: A CoilStruct instance.
+ * @path: A path, relative to @self or absolute.
+ * @path_len: Length of @path.
+ * @reader: A CoilExpandable instance which read @path.
+ * @error: A GError reference or NULL.
+ */
+COIL_API(gboolean)
+coil_struct_add_reader(CoilStruct  *self,
+                       const gchar *path,
+                       guint        path_len,
+                       gpointer     reader,
+                       GError     **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(path && *path, FALSE);
+  g_return_val_if_fail(path_len, FALSE);
+  g_return_val_if_fail(COIL_IS_EXPANDABLE(reader), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  CoilStructPrivate *const root_priv = self->priv->root->priv;
+  CoilPath          *p, *resolved;
+  GSList            *list;
+  guint              hash;
+
+  p = coil_path_take_checked((gchar *)path, path_len,
+                             COIL_STATIC_PATH, error);
+  if (p == NULL)
+    return FALSE;
+
+  resolved = struct_resolve_path(self, p, &hash, error);
+  coil_path_unref(p);
+
+  if (resolved == NULL)
+    return FALSE;
+
+  coil_path_unref(resolved);
+
+  if (root_priv->readers == NULL)
+    root_priv->readers = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  list = g_hash_table_lookup(root_priv->readers, GUINT_TO_POINTER(hash));
+  list = g_slist_remove_all(list, NULL);
+  list = g_slist_prepend(list, reader);
+
+  g_object_add_weak_pointer(G_OBJECT(reader), &list->data);
+  g_hash_table_insert(root_priv->readers, GUINT_TO_POINTER(hash), list);
+
+  return TRUE;
+}
+
+/**
+ * coil_struct_invalidate_readers: Report a change of a value in @self
+ *
+ * Invalidates the readers of the entry of @self holding @object, for
+ * expandables whose expanded value changed without the entry changing.
+ *
+ * @self: A CoilStruct instance.
+ * @object: The expandable held by an entry of @self.
+ */
+COIL_API(void)
+coil_struct_invalidate_readers(CoilStruct    *self,
+                               gconstpointer  object)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+  g_return_if_fail(G_IS_OBJECT(object));
+
+  CoilStructPrivate *const priv = self->priv;
+  StructEntry       *entry;
+  guint32            i;
+
+  /* the value may be anywhere in the entry, a list item for one */
+  struct_drop_content_hash(self);
+
+  if (G_LIKELY(priv->root->priv->readers == NULL))
+    return;
+
+  for (i = 0; i < priv->entries.len; i++)
+  {
+    entry = priv->entries.items[i];
+
+    if (entry && STRUCT_ENTRY_IS_EXPANDABLE(entry)
+      && g_value_get_object(&entry->value) == object)
+    {
+      struct_invalidate_readers(self, entry->hash);
+      return;
+    }
+  }
+}
+
 COIL_API(gboolean)
 coil_struct_merge_full(CoilStruct  *src,
                        CoilStruct  *dst,
@@ -2014,26 +2747,25 @@ coil_struct_merge_full(CoilStruct  *src,
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
   CoilStructIter   it;
-  const CoilPath  *path;
-  const GValue    *value;
+  StructEntry     *entry;
 
   if (!coil_struct_expand(src, error))
     return FALSE;
 
-  g_object_set(G_OBJECT(dst), "accumulate", TRUE, NULL);
+  coil_struct_begin_batch(dst);
 
   coil_struct_iter_init(&it, src);
 
-  while (coil_struct_iter_next(&it, &path, &value))
+  while (struct_iter_next_entry(&it, &entry))
   {
-    if (!struct_merge_item(dst, path, value, overwrite, force_expand, error))
+    if (!struct_merge_item(dst, entry, overwrite, force_expand, error))
     {
-      g_object_set(G_OBJECT(dst), "accumulate", FALSE, NULL);
+      coil_struct_end_batch(dst);
       return FALSE;
     }
   }
 
-  g_object_set(G_OBJECT(dst), "accumulate", FALSE, NULL);
+  coil_struct_end_batch(dst);
   return TRUE;
 }
 
@@ -2104,14 +2836,10 @@ struct_expand_dependency(CoilStruct     *self,
     return FALSE;
 #endif
 
-  /* if the parent changes after now we dont care */
-  g_signal_handlers_disconnect_matched(parent,
-                                       G_SIGNAL_MATCH_ID |
-                                       G_SIGNAL_MATCH_FUNC |
-                                       G_SIGNAL_MATCH_DATA,
-                                       struct_signals[MODIFY], 0, NULL,
-                                       G_CALLBACK(struct_expand_notify),
-                                       self);
+  /* keys the parent changes after now are copied again */
+  struct_remove_observer(self, parent);
+  observer_link(self, parent, TRUE,
+                g_queue_index(&self->priv->dependencies, dependency));
 
   return TRUE;
 }
@@ -2141,7 +2869,7 @@ struct_expand(gconstpointer    object,
   /* Since we waited to expand we're not really changing anything
    * (theoretically). */
   /* TODO(jcon): remove this  -- handle in merge */
-  g_object_set(self, "accumulate", TRUE, NULL);
+  coil_struct_begin_batch(self);
 
   if (priv->expand_ptr == NULL)
     list = g_queue_peek_head_link(&priv->dependencies);
@@ -2155,7 +2883,7 @@ struct_expand(gconstpointer    object,
 
     if (!struct_expand_dependency(self, dependency, error))
     {
-      g_object_set(self, "accumulate", FALSE, NULL);
+      coil_struct_end_batch(self);
       return FALSE;
     }
 
@@ -2167,7 +2895,7 @@ struct_expand(gconstpointer    object,
 #endif
 
   /* resume reporting modifications -- particularly to dependents */
-  g_object_set(self, "accumulate", FALSE, NULL);
+  coil_struct_end_batch(self);
 
   return TRUE;
 }
@@ -2179,17 +2907,333 @@ coil_struct_expand(CoilStruct *self,
   return coil_expand(self, NULL, FALSE, error);
 }
 
-COIL_API(gboolean)
-coil_struct_expand_items(CoilStruct  *self,
-                         gboolean     recursive,
-                         GError     **error)
+/*
+ * Expansion plan
+ *
+ * Expanding a struct expands its dependencies first and a link expands
+ * its target, each through coil_expand(), so long extends and link
+ * chains recurse as deep as they are long. struct_expand_ordered()
+ * walks the dependency graph depth first with an explicit stack instead
+ * and expands every struct and link after everything it depends on, so
+ * the expansion itself never has to recurse. A dependency back onto the
+ * stack is a cycle and is reported with every struct and link on it.
+ *
+ * A struct depends on the structs and links it extends. A link depends
+ * on the struct or link it targets or, when the target does not exist
+ * until a container is expanded, on the closest existing container and
+ * its ancestors, as lookup_internal_expand() would expand them.
+ * Includes and expressions do not add edges and are expanded on demand
+ * as before.
+ */
+
+typedef struct _PlanStep
 {
-  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  CoilExpandable *node;
+  const CoilPath *label; /* shown in cycle errors */
+} PlanStep;
+
+typedef struct _PlanFrame
+{
+  PlanStep  step;
+  GArray   *deps;
+  guint     next;
+} PlanFrame;
+
+typedef enum
+{
+  PLAN_VISITING = 1,
+  PLAN_DONE,
+} PlanState;
+
+static void
+plan_add_step(GArray         *deps,
+              gpointer        node,
+              const CoilPath *label)
+{
+  PlanStep step = {COIL_EXPANDABLE(node), label};
+
+  if (COIL_IS_STRUCT(node) && coil_struct_is_prototype(COIL_STRUCT(node)))
+    return;
+
+  g_array_append_val(deps, step);
+}
+
+static void
+plan_link_deps(CoilLink *link,
+               GArray   *deps)
+{
+  CoilStruct   *container = COIL_EXPANDABLE(link)->container;
+  CoilStruct   *root;
+  CoilPath     *path;
+  const GValue *value;
+  const guint  *lens, *hashes;
+  guint         i;
+
+  /* a bad path is reported when the link is expanded */
+  if (container == NULL
+    || (path = coil_link_resolve_path(link, NULL)) == NULL)
+    return;
+
+  root = coil_struct_get_root(container);
+
+  value = struct_lookup_internal(root, path, coil_path_get_hash(path),
+                                 path->path, path->path_len,
+                                 FALSE, FALSE, NULL);
+
+  if (value)
+  {
+    if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+      || G_VALUE_HOLDS(value, COIL_TYPE_LINK))
+      plan_add_step(deps, g_value_get_object(value), path);
+
+    return;
+  }
+
+  /* the closest container that exists and its ancestors */
+  i = coil_path_get_prefixes(path, &hashes, &lens);
+  container = root;
+
+  for (--i; i > 0; i--)
+  {
+    value = struct_lookup_internal(root, NULL, hashes[i], path->path, lens[i],
+                                   FALSE, FALSE, NULL);
+
+    if (value && G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+    {
+      container = COIL_STRUCT(g_value_get_object(value));
+      break;
+    }
+  }
+
+  for (; container; container = coil_struct_get_container(container))
+    plan_add_step(deps, container, coil_struct_get_path(container));
+}
+
+static GArray *
+plan_deps(CoilExpandable *node)
+{
+  GArray *deps = g_array_new(FALSE, FALSE, sizeof(PlanStep));
+
+  if (COIL_IS_STRUCT(node))
+  {
+    CoilStructPrivate *const priv = COIL_STRUCT(node)->priv;
+    GList             *list;
+
+    if (struct_needs_expand(node))
+      return deps;
+
+    list = priv->expand_ptr ? g_list_next(priv->expand_ptr)
+                            : g_queue_peek_head_link(&priv->dependencies);
+
+    for (; list; list = g_list_next(list))
+    {
+      if (COIL_IS_STRUCT(list->data))
+        plan_add_step(deps, list->data,
+                      coil_struct_get_path(COIL_STRUCT(list->data)));
+      else if (COIL_IS_LINK(list->data))
+        plan_link_deps(COIL_LINK(list->data), deps);
+    }
+  }
+  else if (COIL_IS_LINK(node))
+    plan_link_deps(COIL_LINK(node), deps);
+
+  return deps;
+}
+
+static void
+plan_cycle_error(GArray          *stack,
+                 const PlanStep  *step,
+                 GError         **error)
+{
+  GString        *msg = g_string_sized_new(256);
+  CoilExpandable *node;
+  guint           i = stack->len;
+
+  /* find where the cycle starts */
+  while (g_array_index(stack, PlanFrame, --i).step.node != step->node)
+    ;
+
+  node = g_array_index(stack, PlanFrame, i).step.node;
+
+  for (; i < stack->len; i++)
+  {
+    const PlanFrame *frame = &g_array_index(stack, PlanFrame, i);
+
+    g_string_append_printf(msg, "%s -> ", frame->step.label->path);
+  }
+
+  g_string_append(msg, step->label->path);
+
+  if (COIL_IS_STRUCT(node))
+    coil_struct_error(error, COIL_STRUCT(node),
+                      "Cycle detected during expansion: %s", msg->str);
+  else
+    coil_struct_error(error, node->container,
+                      "Cycle detected during expansion: %s", msg->str);
+
+  g_string_free(msg, TRUE);
+}
 
+static gboolean
+plan_expand(GHashTable      *state,
+            GArray          *stack,
+            const PlanStep  *start,
+            GError         **error)
+{
+  PlanFrame frame;
+  gboolean  result = TRUE;
+
+  if (g_hash_table_lookup(state, start->node))
+    return TRUE;
+
+  frame.step = *start;
+  frame.deps = plan_deps(start->node);
+  frame.next = 0;
+
+  g_array_append_val(stack, frame);
+  g_hash_table_insert(state, g_object_ref(start->node),
+                     GINT_TO_POINTER(PLAN_VISITING));
+
+  while (stack->len > 0)
+  {
+    PlanFrame *top = &g_array_index(stack, PlanFrame, stack->len - 1);
+
+    if (top->next < top->deps->len)
+    {
+      const PlanStep *dep = &g_array_index(top->deps, PlanStep, top->next++);
+
+      switch (GPOINTER_TO_INT(g_hash_table_lookup(state, dep->node)))
+      {
+        case PLAN_DONE:
+          break;
+
+        case PLAN_VISITING:
+          plan_cycle_error(stack, dep, error);
+          result = FALSE;
+          goto done;
+
+        default:
+          frame.step = *dep;
+          frame.deps = plan_deps(dep->node);
+          frame.next = 0;
+
+          g_array_append_val(stack, frame);
+          g_hash_table_insert(state, g_object_ref(dep->node),
+                              GINT_TO_POINTER(PLAN_VISITING));
+          break;
+      }
+
+      continue;
+    }
+
+    /* everything it depends on is expanded */
+    if (!coil_expand(top->step.node, NULL, FALSE, error))
+    {
+      result = FALSE;
+      goto done;
+    }
+
+    g_hash_table_insert(state, g_object_ref(top->step.node),
+                        GINT_TO_POINTER(PLAN_DONE));
+    g_array_free(top->deps, TRUE);
+    g_array_set_size(stack, stack->len - 1);
+  }
+
+done:
+  while (stack->len > 0)
+  {
+    g_array_free(g_array_index(stack, PlanFrame, stack->len - 1).deps, TRUE);
+    g_array_set_size(stack, stack->len - 1);
+  }
+
+  return result;
+}
+
+/* expands every struct and link below self, see Expansion plan above */
+static gboolean
+struct_expand_ordered(CoilStruct  *self,
+                      GError     **error)
+{
+  /* holds a reference for every insert so no address is reused */
+  GHashTable *state = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            g_object_unref, NULL);
+  GArray     *stack = g_array_new(FALSE, FALSE, sizeof(PlanFrame));
+  GArray     *items = g_array_new(FALSE, FALSE, sizeof(PlanStep));
+  GQueue      queue = G_QUEUE_INIT;
+  CoilStruct *node;
+  gboolean    result = TRUE;
+
+  g_queue_push_tail(&queue, g_object_ref(self));
+
+  while (result && (node = g_queue_pop_head(&queue)))
+  {
+    CoilStructIter  it;
+    StructEntry    *entry;
+    PlanStep        step = {COIL_EXPANDABLE(node), coil_struct_get_path(node)};
+    guint           i;
+
+    if (!plan_expand(state, stack, &step, error))
+    {
+      g_object_unref(node);
+      result = FALSE;
+      break;
+    }
+
+    /* expanding links may change other structs, not this one */
+    coil_struct_iter_init(&it, node);
+
+    while (struct_iter_next_entry(&it, &entry))
+    {
+      if (entry->kind == STRUCT_VALUE_STRUCT)
+      {
+        CoilStruct *child = COIL_STRUCT(g_value_get_object(&entry->value));
+
+        if (!coil_struct_is_prototype(child))
+          g_queue_push_tail(&queue, g_object_ref(child));
+      }
+      else if (entry->kind == STRUCT_VALUE_EXPANDABLE
+        && G_VALUE_HOLDS(&entry->value, COIL_TYPE_LINK))
+      {
+        PlanStep link = {g_value_dup_object(&entry->value), entry->path};
+
+        coil_path_ref((CoilPath *)link.label);
+        g_array_append_val(items, link);
+      }
+    }
+
+    for (i = 0; i < items->len; i++)
+    {
+      PlanStep *link = &g_array_index(items, PlanStep, i);
+
+      if (result && !plan_expand(state, stack, link, error))
+        result = FALSE;
+
+      coil_path_unref((CoilPath *)link->label);
+      g_object_unref(link->node);
+    }
+
+    g_array_set_size(items, 0);
+    g_object_unref(node);
+  }
+
+  while ((node = g_queue_pop_head(&queue)))
+    g_object_unref(node);
+
+  g_array_free(items, TRUE);
+  g_array_free(stack, TRUE);
+  g_hash_table_destroy(state);
+
+  return result;
+}
+
+static gboolean
+struct_expand_items(CoilStruct  *self,
+                    gboolean     recursive,
+                    GError     **error)
+{
   CoilStructIter  it;
   CoilStruct     *container;
-  const GValue   *value;
+  StructEntry    *entry;
 
   if (!coil_struct_expand(self, error))
     return FALSE;
@@ -2197,12 +3241,12 @@ coil_struct_expand_items(CoilStruct  *self,
   container = coil_struct_get_container(self);
 
   coil_struct_iter_init(&it, self);
-  while (coil_struct_iter_next(&it, NULL, &value))
+  while (struct_iter_next_entry(&it, &entry))
   {
-    if (G_VALUE_HOLDS(value, COIL_TYPE_EXPANDABLE))
+    if (STRUCT_ENTRY_IS_EXPANDABLE(entry))
     {
       CoilExpandable *object;
-      object = COIL_EXPANDABLE(g_value_get_object(value));
+      object = COIL_EXPANDABLE(g_value_get_object(&entry->value));
 
       if (container && !struct_change_notify(container, error))
         return FALSE;
@@ -2212,7 +3256,7 @@ coil_struct_expand_items(CoilStruct  *self,
 
       if (recursive
           && COIL_IS_STRUCT(object)
-          && !coil_struct_expand_items(COIL_STRUCT(object), TRUE, error))
+          && !struct_expand_items(COIL_STRUCT(object), TRUE, error))
         return FALSE;
     }
   }
@@ -2220,6 +3264,103 @@ coil_struct_expand_items(CoilStruct  *self,
   return TRUE;
 }
 
+COIL_API(gboolean)
+coil_struct_expand_items(CoilStruct  *self,
+                         gboolean     recursive,
+                         GError     **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  /* leaves only includes and expressions to expand on demand */
+  if (recursive && !struct_expand_ordered(self, error))
+    return FALSE;
+
+  return struct_expand_items(self, recursive, error);
+}
+
+static void
+struct_collect_includes(CoilStruct *self,
+                        GPtrArray  *includes)
+{
+  CoilStructPrivate *const priv = self->priv;
+  CoilStructIter     it;
+  StructEntry       *entry;
+  GList             *list;
+
+  for (list = g_queue_peek_head_link(&priv->dependencies);
+       list; list = g_list_next(list))
+  {
+    CoilStruct *namespace;
+
+    if (!COIL_IS_INCLUDE(list->data))
+      continue;
+
+    g_ptr_array_add(includes, list->data);
+
+    /* includes of files loaded already */
+    g_object_get(list->data, "namespace", &namespace, NULL);
+
+    if (namespace)
+    {
+      struct_collect_includes(namespace, includes);
+      g_object_unref(namespace);
+    }
+  }
+
+  coil_struct_iter_init(&it, self);
+
+  while (struct_iter_next_entry(&it, &entry))
+  {
+    if (entry->kind == STRUCT_VALUE_STRUCT)
+    {
+      CoilStruct *node = COIL_STRUCT(g_value_get_object(&entry->value));
+
+      if (!coil_struct_is_prototype(node))
+        struct_collect_includes(node, includes);
+    }
+  }
+}
+
+/**
+ * coil_struct_preload_includes: Parse the files included in @self on
+ * up to @max_threads threads (-1 for no limit)
+ *
+ * Only the included files are parsed in parallel, a round for every
+ * level of nested includes. Each is a root of its own so the parses are
+ * independent. Nothing in @self is expanded: structs in a tree share one
+ * path table, extends and links are expanded in order on the calling
+ * thread by coil_struct_expand_items(), which then only merges the
+ * preloaded files and gives the same result as without preloading.
+ */
+COIL_API(gboolean)
+coil_struct_preload_includes(CoilStruct  *self,
+                             gint         max_threads,
+                             GError     **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  GPtrArray  *includes = g_ptr_array_new();
+  GHashTable *files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+  gint        loaded;
+
+  /* files included by the files of the last round are loaded next */
+  do
+  {
+    g_ptr_array_set_size(includes, 0);
+    struct_collect_includes(self, includes);
+
+    loaded = coil_include_preload(includes, files, max_threads, error);
+  } while (loaded > 0);
+
+  g_hash_table_destroy(files);
+  g_ptr_array_free(includes, TRUE);
+
+  return loaded == 0;
+}
+
 static const GValue *
 maybe_expand_value(CoilStruct    *self,
                    const GValue  *value,
@@ -2246,7 +3387,7 @@ maybe_expand_value(CoilStruct    *self,
 static CoilStruct *
 struct_lookup_container_internal(CoilStruct  *self,
                                  const gchar *path,
-                                 guint8       path_len,
+                                 guint        path_len,
                                  GError     **error)
 {
   g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
@@ -2255,68 +3396,64 @@ struct_lookup_container_internal(CoilStruct  *self,
 
   const StructEntry *entry;
   CoilStructPrivate *priv = self->priv;
-  const gchar       *key, *end;
-  guint              hash;
-  guint8             container_path_len;
+  PathScan           scan;
+  guint              container_path_len;
 
-  end = path + path_len;
-  key = memrchr(path, COIL_PATH_DELIM, path_len);
+  /* the container hash comes with finding the key */
+  path_scan(&scan, 0, path, path_len, PATH_SCAN_HASH);
 
-  g_assert(key != NULL);
+  g_assert(scan.n_keys > 0);
 
-  container_path_len = key - path;
+  container_path_len = scan.key_offset - 1;
 
   if (container_path_len == COIL_ROOT_PATH_LEN)
     return coil_struct_get_root(self);
 
-  hash = hash_absolute_path(path, container_path_len);
-
   entry = struct_table_lookup(priv->table,
-                              hash, /* container hash */
+                              scan.container_hash, /* container hash */
                               path, /* conatiner path */
                               container_path_len);
 
-  if (entry == NULL || entry->value == NULL)
+  if (entry == NULL || entry->kind == STRUCT_VALUE_EMPTY)
     return NULL;
 
-  if (G_UNLIKELY(!G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT)))
+  if (G_UNLIKELY(entry->kind != STRUCT_VALUE_STRUCT))
   {
     coil_struct_error(error, self,
         "Attempting to lookup value in entry '%.*s' which is not a struct. "
         "Entry is of type '%s'.",
-         path_len, path, G_VALUE_TYPE_NAME(entry->value));
+         path_len, path, G_VALUE_TYPE_NAME(&entry->value));
 
     return NULL;
   }
 
-  return COIL_STRUCT(g_value_get_object(entry->value));
+  return COIL_STRUCT(g_value_get_object(&entry->value));
 }
 
 
 static gboolean
 lookup_internal_expand(CoilStruct  *self,
-                       const gchar *path,
-                       guint8       path_len,
+                       CoilPath    *path,
                        GError     **error)
 {
   g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
   g_return_val_if_fail(path, FALSE);
-  g_return_val_if_fail(path_len > 0, FALSE);
+  g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(path), FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
   const GValue *container_value;
   CoilStruct   *container, *root;
-  guint8        lens[COIL_PATH_MAX_PARTS], i;
-  guint         hashes[COIL_PATH_MAX_PARTS];
+  const guint  *lens, *hashes;
+  guint         i, n;
   GError       *internal_error = NULL;
 
-  compute_path_hash_with_len(path, path_len, hashes, lens, &i);
+  n = coil_path_get_prefixes(path, &hashes, &lens);
 
-  for (--i; i > 0; i--)
+  for (i = n - 1; i > 0; i--)
   {
-    container_value = struct_lookup_internal(self,
+    container_value = struct_lookup_internal(self, NULL,
                                              hashes[i],
-                                             path,
+                                             path->path,
                                              lens[i],
                                              FALSE,
                                              FALSE,
@@ -2332,7 +3469,7 @@ lookup_internal_expand(CoilStruct  *self,
                   COIL_ERROR_VALUE,
                   "<%s> the item at '%.*s' is type %s, expected %s",
                   coil_struct_get_path(self)->path,
-                  path_len, path,
+                  (gint)lens[i], path->path,
                   G_VALUE_TYPE_NAME(container_value),
                   g_type_name(COIL_TYPE_STRUCT));
 
@@ -2353,6 +3490,26 @@ lookup_internal_expand(CoilStruct  *self,
     break;
   }
 
+  /* containers below share entries until they are expanded in turn */
+  for (i++; i > 1 && i < n; i++)
+  {
+    container_value = struct_lookup_internal(self, NULL,
+                                             hashes[i],
+                                             path->path,
+                                             lens[i],
+                                             FALSE,
+                                             FALSE,
+                                             error);
+
+    if (container_value == NULL
+      || !G_VALUE_HOLDS(container_value, COIL_TYPE_STRUCT))
+      break;
+
+    container = COIL_STRUCT(g_value_get_object(container_value));
+    if (!coil_struct_expand(container, error))
+      return FALSE;
+  }
+
   root = coil_struct_get_root(self);
   if (!coil_struct_expand(root, error))
     return FALSE;
@@ -2362,9 +3519,10 @@ lookup_internal_expand(CoilStruct  *self,
 
 static const GValue *
 struct_lookup_internal(CoilStruct     *self,
+                       CoilPath       *path_obj, /* optional, caches hashes */
                        guint           hash,
                        const gchar    *path,
-                       guint8          path_len,
+                       guint           path_len,
                        gboolean        expand_value,
                        gboolean        expand_container,
                        GError        **error)
@@ -2376,7 +3534,7 @@ struct_lookup_internal(CoilStruct     *self,
 
   CoilStructPrivate *const priv = self->priv;
   StructEntry       *entry;
-  const GValue      *result;
+  gboolean           expanded;
 
   entry = struct_table_lookup(priv->table, hash, path, path_len);
   if (entry == NULL)
@@ -2384,19 +3542,31 @@ struct_lookup_internal(CoilStruct     *self,
     if (!expand_container)
       return NULL;
 
-    if (!lookup_internal_expand(self, path, path_len, error))
+    if (path_obj)
+      expanded = lookup_internal_expand(self, path_obj, error);
+    else
+    {
+      CoilPath *p;
+
+      p = coil_path_take_strings((gchar *)path, path_len, NULL, 0,
+                                 COIL_STATIC_PATH | COIL_PATH_IS_ABSOLUTE);
+      expanded = lookup_internal_expand(self, p, error);
+      coil_path_unref(p);
+    }
+
+    if (!expanded)
       return NULL;
 
     entry = struct_table_lookup(priv->table, hash, path, path_len);
-    result = (entry) ? entry->value : NULL;
   }
-  else
-    result = entry->value;
 
-  if (expand_value && result)
-    return maybe_expand_value(self, result, error);
+  if (entry == NULL || entry->kind == STRUCT_VALUE_EMPTY)
+    return NULL;
 
-  return result;
+  if (expand_value && STRUCT_ENTRY_IS_EXPANDABLE(entry))
+    return maybe_expand_value(self, &entry->value, error);
+
+  return &entry->value;
 }
 
 COIL_API(const GValue *)
@@ -2420,7 +3590,7 @@ coil_struct_lookup_path(CoilStruct *self,
     return FALSE;
   }
 
-  result = struct_lookup_internal(self, hash,
+  result = struct_lookup_internal(self, path, hash,
                                   path->path, path->path_len,
                                   expand_value, TRUE, error);
 
@@ -2431,7 +3601,7 @@ coil_struct_lookup_path(CoilStruct *self,
 COIL_API(const GValue *)
 coil_struct_lookup_key_fast(CoilStruct  *self,
                             const gchar *key,
-                            guint8       key_len,
+                            guint        key_len,
                             gboolean     expand_value,
                             GError     **error)
 {
@@ -2444,16 +3614,21 @@ coil_struct_lookup_key_fast(CoilStruct  *self,
   CoilStructPrivate *const priv = self->priv;
   const CoilPath    *const p = priv->path;
   guint              hash = hash_relative_path(priv->hash, key, key_len);
+  const GValue      *value;
   gchar             *path;
-  guint8             path_len;
+  guint              path_len;
 
   COIL_PATH_QUICK_BUFFER(path, path_len,
                          p->path, p->path_len, /* container */
                          key, key_len);        /* key */
 
-  return struct_lookup_internal(self, hash,
-                                path, path_len,
-                                expand_value, TRUE, error);
+  value = struct_lookup_internal(self, NULL, hash,
+                                 path, path_len,
+                                 expand_value, TRUE, error);
+
+  COIL_PATH_QUICK_BUFFER_FREE(path, path_len);
+
+  return value;
 }
 
 COIL_API(const GValue *)
@@ -2473,14 +3648,14 @@ coil_struct_lookup_key(CoilStruct  *self,
     return FALSE;
 
   return coil_struct_lookup_key_fast(self,
-                                     key, (guint8)key_len,
+                                     key, key_len,
                                      expand_value, error);
 }
 
 COIL_API(const GValue *)
 coil_struct_lookup_fast(CoilStruct  *self,
                         const gchar *path,
-                        guint8       path_len,
+                        guint        path_len,
                         gboolean     expand_value,
                         GError     **error)
 {
@@ -2517,12 +3692,229 @@ coil_struct_lookup(CoilStruct  *self,
   g_return_val_if_fail(path_len, NULL);
   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
-  if (!coil_check_path(path, path_len, error))
+  CoilPath     *p;
+  const GValue *result;
+
+  p = coil_path_take_checked((gchar *)path, path_len,
+                             COIL_STATIC_PATH, error);
+  if (p == NULL)
+    return NULL;
+
+  result = coil_struct_lookup_path(self, p, expand_value, error);
+  coil_path_unref(p);
+
+  return result;
+}
+
+/*
+ * A prepared lookup holds the resolved path of a lookup and its hash so
+ * executing it skips validating, resolving and hashing the path. The
+ * entry found is kept with the version of the table it was found in and
+ * returned without probing the table again until the root changes.
+ */
+struct _CoilLookupHandle
+{
+  CoilStruct  *context;
+  CoilPath    *context_path; /* path of context when resolved */
+  CoilPath    *unresolved;   /* path as prepared, if relative */
+
+  StructTable *table;
+  CoilPath    *path;
+  guint        hash;
+
+  /* result of the last lookup, valid while table is at version */
+  StructEntry *entry;
+  guint        version;
+  gboolean     has_entry : 1;
+};
+
+static gboolean
+lookup_handle_resolve(CoilLookupHandle  *handle,
+                      GError           **error)
+{
+  g_return_val_if_fail(handle, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  CoilStructPrivate *const priv = handle->context->priv;
+  CoilPath          *path;
+  const guint       *hashes, *lens;
+  guint              hash;
+
+  path = (handle->unresolved) ? handle->unresolved : handle->path;
+  path = struct_resolve_path(handle->context, path, &hash, error);
+  if (path == NULL)
     return FALSE;
 
-  return coil_struct_lookup_fast(self,
-                                 path, (guint8)path_len,
-                                 expand_value, error);
+  path = coil_path_intern(path);
+
+  /* build the prefix hashes now so expanding on a miss hashes nothing */
+  coil_path_get_prefixes(path, &hashes, &lens);
+
+  coil_path_unref(handle->path);
+  handle->path = path;
+  handle->hash = hash;
+
+  if (handle->context_path)
+    coil_path_unref(handle->context_path);
+  handle->context_path = coil_path_ref(priv->path);
+
+  if (handle->table)
+    struct_table_unref(handle->table);
+  handle->table = struct_table_ref(priv->table);
+
+  handle->version = struct_table_get_version(priv->table);
+  handle->has_entry = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Prepare a lookup of @path in @self for repeated use with
+ * coil_lookup_exec(). The handle keeps a reference to @self and @path.
+ */
+COIL_API(CoilLookupHandle *)
+coil_lookup_prepare_path(CoilStruct  *self,
+                         CoilPath    *path,
+                         GError     **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  g_return_val_if_fail(!coil_struct_is_prototype(self), NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilLookupHandle *handle = g_slice_new0(CoilLookupHandle);
+
+  /* the handle outlives the buffer of a static path */
+  if (path->flags & COIL_STATIC_PATH)
+    path = coil_path_copy(path);
+  else
+    coil_path_ref(path);
+
+  handle->context = g_object_ref(self);
+  handle->path = path;
+
+  if (COIL_PATH_IS_RELATIVE(path))
+    handle->unresolved = coil_path_ref(path);
+
+  if (!lookup_handle_resolve(handle, error))
+  {
+    coil_lookup_free(handle);
+    return NULL;
+  }
+
+  return handle;
+}
+
+COIL_API(CoilLookupHandle *)
+coil_lookup_prepare(CoilStruct   *self,
+                    const gchar  *path_str,
+                    guint         path_len,
+                    GError      **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), NULL);
+  g_return_val_if_fail(path_str && *path_str, NULL);
+  g_return_val_if_fail(path_len, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilLookupHandle *handle;
+  CoilPath         *path;
+
+  path = coil_path_new_len(path_str, path_len, error);
+  if (path == NULL)
+    return NULL;
+
+  handle = coil_lookup_prepare_path(self, path, error);
+  coil_path_unref(path);
+
+  return handle;
+}
+
+/**
+ * TRUE if the root of the handle was changed or the context of the
+ * handle was moved since the handle was prepared or last executed.
+ */
+COIL_API(gboolean)
+coil_lookup_is_stale(const CoilLookupHandle *handle)
+{
+  g_return_val_if_fail(handle, TRUE);
+
+  const StructTable *const table = handle->context->priv->table;
+
+  return table != handle->table
+    || struct_table_get_version(table) != handle->version;
+}
+
+/**
+ * Execute a prepared lookup. Until the root changes the entry found by
+ * the last execution is returned directly, otherwise the table is probed
+ * once with the prepared hash.
+ */
+COIL_API(const GValue *)
+coil_lookup_exec(CoilLookupHandle  *handle,
+                 gboolean           expand_value,
+                 GError           **error)
+{
+  g_return_val_if_fail(handle, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  CoilStruct        *const context = handle->context;
+  CoilStructPrivate *const priv = context->priv;
+  const CoilPath    *path;
+  StructEntry       *entry;
+
+  if (G_LIKELY(handle->has_entry && !coil_lookup_is_stale(handle)))
+    entry = handle->entry;
+  else
+  {
+    /* context was moved, its path and table changed */
+    if ((priv->table != handle->table || priv->path != handle->context_path)
+      && !lookup_handle_resolve(handle, error))
+      return NULL;
+
+    path = handle->path;
+    entry = struct_table_lookup(priv->table, handle->hash,
+                                path->path, path->path_len);
+
+    if (entry == NULL)
+    {
+      if (!lookup_internal_expand(context, handle->path, error))
+        return NULL;
+
+      entry = struct_table_lookup(priv->table, handle->hash,
+                                  path->path, path->path_len);
+    }
+
+    handle->entry = entry;
+    handle->version = struct_table_get_version(priv->table);
+    handle->has_entry = TRUE;
+  }
+
+  if (entry == NULL || entry->kind == STRUCT_VALUE_EMPTY)
+    return NULL;
+
+  if (expand_value && STRUCT_ENTRY_IS_EXPANDABLE(entry))
+    return maybe_expand_value(context, &entry->value, error);
+
+  return &entry->value;
+}
+
+COIL_API(void)
+coil_lookup_free(CoilLookupHandle *handle)
+{
+  g_return_if_fail(handle);
+
+  if (handle->table)
+    struct_table_unref(handle->table);
+
+  if (handle->context_path)
+    coil_path_unref(handle->context_path);
+
+  if (handle->unresolved)
+    coil_path_unref(handle->unresolved);
+
+  coil_path_unref(handle->path);
+  g_object_unref(handle->context);
+  g_slice_free(CoilLookupHandle, handle);
 }
 
 COIL_API(GList *)
@@ -2649,11 +4041,11 @@ next:
 
   while (struct_iter_next_entry(&it, &entry))
   {
-    if (G_VALUE_HOLDS(entry->value, COIL_TYPE_STRUCT))
+    if (entry->kind == STRUCT_VALUE_STRUCT)
     {
       CoilStruct *node;
 
-      node = COIL_STRUCT(g_value_get_object(entry->value));
+      node = COIL_STRUCT(g_value_get_object(&entry->value));
       coil_struct_dependency_treev(node, tree,
                                    ntypes, allowed_types,
                                    &internal_error);
@@ -2720,6 +4112,95 @@ coil_struct_dependency_tree(CoilStruct *self,
   return result;
 }
 
+/*
+ * The content hash of a struct is the sum of a hash of each key and its
+ * value, which does not depend on the order of keys. A container keeps
+ * its hash only while the structs it holds keep theirs, so dropping the
+ * hash of a changed struct stops at the first container without one.
+ */
+static guint
+content_hash_mix(guint h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static void
+struct_drop_content_hash(CoilStruct *self)
+{
+  while (self && self->priv->has_content_hash)
+  {
+    self->priv->has_content_hash = FALSE;
+    self = coil_struct_get_container(self);
+  }
+}
+
+/**
+ * coil_struct_get_content_hash: Hash the keys and values of @self
+ *
+ * Structs equal by coil_struct_equals() have the same hash, whatever
+ * the order of their keys. The hash is kept until @self, or a value it
+ * holds or reads through a link or an expression, changes.
+ *
+ * @self: A CoilStruct instance.
+ * @hash: Return location for the hash.
+ * @error: A GError reference or NULL.
+ */
+COIL_API(gboolean)
+coil_struct_get_content_hash(CoilStruct *self,
+                             guint      *hash,
+                             GError    **error)
+{
+  g_return_val_if_fail(COIL_IS_STRUCT(self), FALSE);
+  g_return_val_if_fail(hash, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  CoilStructPrivate *const priv = self->priv;
+  StructEntry       *entry;
+  const CoilPath    *path;
+  guint              h, key_hash, value_hash;
+  guint32            i;
+
+  if (priv->has_content_hash)
+  {
+    *hash = priv->content_hash;
+    return TRUE;
+  }
+
+  if (!struct_needs_expand(self)
+      && !coil_struct_expand(self, error))
+    return FALSE;
+
+  h = priv->size;
+
+  for (i = 0; i < priv->entries.len; i++)
+  {
+    entry = priv->entries.items[i];
+    if (entry == NULL)
+      continue;
+
+    path = entry->path;
+    key_hash = hash_relative_path(0, path->key, path->key_len);
+
+    if (!coil_value_hash(STRUCT_ENTRY_VALUE(entry), &value_hash, error))
+      return FALSE;
+
+    h += content_hash_mix(key_hash ^ content_hash_mix(value_hash));
+  }
+
+  priv->content_hash = h;
+  priv->has_content_hash = TRUE;
+
+  *hash = h;
+
+  return TRUE;
+}
+
 COIL_API(gint)
 coil_struct_get_size(CoilStruct *self,
                      GError    **error)
@@ -2734,6 +4215,115 @@ coil_struct_get_size(CoilStruct *self,
   return self->priv->size;
 }
 
+static void
+count_value_stats(const GValue    *value,
+                  CoilStructStats *stats);
+
+static void
+count_struct_stats(CoilStruct      *self,
+                   CoilStructStats *stats)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+  g_return_if_fail(stats);
+
+  CoilStructPrivate *const priv = self->priv;
+  StructEntry       *entry;
+  GList             *list;
+  guint32            i;
+
+  stats->structs++;
+
+  if (priv->is_prototype)
+    stats->prototypes++;
+
+  if (!g_queue_is_empty(&priv->dependencies) && !struct_needs_expand(self))
+    stats->shared++;
+
+  for (list = g_queue_peek_head_link(&priv->dependencies);
+       list; list = g_list_next(list))
+  {
+    if (COIL_IS_INCLUDE(list->data))
+      stats->includes++;
+    else if (COIL_IS_LINK(list->data))
+      stats->links++;
+  }
+
+  /* walk entries directly, prototypes can not be iterated */
+  for (i = 0; i < priv->entries.len; i++)
+  {
+    entry = priv->entries.items[i];
+    if (entry == NULL)
+      continue;
+
+    stats->entries++;
+
+    if (entry->kind != STRUCT_VALUE_EMPTY)
+      count_value_stats(&entry->value, stats);
+  }
+}
+
+static void
+count_value_stats(const GValue    *value,
+                  CoilStructStats *stats)
+{
+  g_return_if_fail(G_IS_VALUE(value));
+  g_return_if_fail(stats);
+
+  if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+    count_struct_stats(COIL_STRUCT(g_value_get_object(value)), stats);
+  else if (G_VALUE_HOLDS(value, COIL_TYPE_LINK))
+    stats->links++;
+  else if (G_VALUE_HOLDS(value, COIL_TYPE_EXPR))
+    stats->expressions++;
+  else if (G_VALUE_HOLDS(value, COIL_TYPE_LIST))
+  {
+    const GValueArray *arr = (GValueArray *)g_value_get_boxed(value);
+    guint              i;
+
+    for (i = 0; arr && i < arr->n_values; i++)
+      count_value_stats(g_value_array_get_nth((GValueArray *)arr, i), stats);
+  }
+}
+
+/**
+ * Collect statistics for the root of @self.
+ *
+ * Counts structs, entries and unexpanded values in the whole tree and
+ * reports the shared path table. Nothing is expanded, so call after
+ * expansion to see what a fully expanded root costs.
+ */
+COIL_API(void)
+coil_struct_get_stats(CoilStruct      *self,
+                      CoilStructStats *stats)
+{
+  g_return_if_fail(COIL_IS_STRUCT(self));
+  g_return_if_fail(stats);
+
+  CoilStruct       *root = coil_struct_get_root(self);
+  StructTableStats  table;
+  guint             i;
+
+  memset(stats, 0, sizeof(*stats));
+
+  count_struct_stats(root, stats);
+  struct_table_get_stats(root->priv->table, &table);
+
+  stats->table.size = table.size;
+  stats->table.buckets = table.buckets;
+  stats->table.deleted = table.deleted;
+
+  for (i = 0; i <= STRUCT_TABLE_CHAIN_HISTOGRAM; i++)
+    stats->table.chains[MIN(i, COIL_STRUCT_STATS_CHAINS - 1)]
+      += table.chains[i];
+
+  stats->table.max_chain = table.max_chain;
+  stats->table.rehashes = table.rehashes;
+  stats->table.grows = table.grows;
+  stats->table.shrinks = table.shrinks;
+  stats->table.memory = table.memory;
+  stats->table.region = table.region;
+}
+
 /* Only call from struct_build_string_internal() */
 static void
 _struct_build_flat_string(CoilStruct       *self,
@@ -2748,7 +4338,7 @@ _struct_build_flat_string(CoilStruct       *self,
   g_return_if_fail(!coil_struct_is_prototype(self));
 
   CoilStructIter  it;
-  const GValue   *value;
+  StructEntry    *entry;
   const CoilPath *path;
   const CoilPath *context_path = coil_struct_get_path(format->context);
   const guint     path_offset = context_path->path_len + 1;
@@ -2756,17 +4346,19 @@ _struct_build_flat_string(CoilStruct       *self,
 
   coil_struct_iter_init(&it, self);
 
-  while (coil_struct_iter_next(&it, &path, &value))
+  while (struct_iter_next_entry(&it, &entry))
   {
-    if (G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+    if (entry->kind == STRUCT_VALUE_STRUCT)
     {
-      CoilStruct *node = COIL_STRUCT(g_value_get_object(value));
+      CoilStruct *node = COIL_STRUCT(g_value_get_object(&entry->value));
       struct_build_string_internal(node, buffer, format, &internal_error);
     }
     else
     {
+      path = entry->path;
       g_string_append_printf(buffer, "%s: ", path->path + path_offset);
-      coil_value_build_string(value, buffer, format, &internal_error);
+      coil_value_build_string(STRUCT_ENTRY_VALUE(entry), buffer,
+                              format, &internal_error);
       g_string_append_c(buffer, '\n');
     }
 
@@ -2983,6 +4575,15 @@ coil_struct_copy_valist(CoilStruct  *self,
   if (copy == NULL)
     return NULL;
 
+  /* share entries with self until either is changed, then copy all */
+  if (struct_can_share(copy, self))
+  {
+    if (!coil_struct_add_dependency(copy, self, error))
+      goto error;
+
+    return copy;
+  }
+
   if (!coil_struct_expand_items(self, TRUE, error))
     goto error;
 
@@ -3028,6 +4629,24 @@ struct_entry_key_cmp(const StructEntry *self,
   return strcmp(spath->key, opath->key);
 }
 
+/* entries of vector in order as a newly allocated GList */
+static GList *
+struct_entry_vector_copy(const StructEntryVector *vector)
+{
+  g_return_val_if_fail(vector, NULL);
+
+  GList   *result = NULL;
+  guint32  i;
+
+  for (i = vector->len; i-- > 0;)
+  {
+    if (vector->items[i])
+      result = g_list_prepend(result, vector->items[i]);
+  }
+
+  return result;
+}
+
 COIL_API(gboolean)
 coil_struct_equals(gconstpointer   obj,
                    gconstpointer   other_obj,
@@ -3040,6 +4659,7 @@ coil_struct_equals(gconstpointer   obj,
   CoilStruct         *self = COIL_STRUCT(obj), *other = COIL_STRUCT(other_obj);
   CoilStructPrivate  *const spriv = self->priv, *const opriv = other->priv;
   register GList     *lp1 = NULL, *lp2 = NULL;
+  guint               shash, ohash;
 
   if (self == other)
     return TRUE;
@@ -3051,13 +4671,19 @@ coil_struct_equals(gconstpointer   obj,
     || spriv->size != opriv->size)
     return FALSE;
 
+  /* only structs with the same contents hash alike, those are compared */
+  if (!coil_struct_get_content_hash(self, &shash, error)
+    || !coil_struct_get_content_hash(other, &ohash, error)
+    || shash != ohash)
+    return FALSE;
+
   // All keys are first-order ok to sort
   // XXX: compare should be order-independent
-  lp1 = g_queue_peek_head_link(&spriv->entries);
-  lp2 = g_queue_peek_head_link(&opriv->entries);
+  lp1 = struct_entry_vector_copy(&spriv->entries);
+  lp2 = struct_entry_vector_copy(&opriv->entries);
 
-  lp1 = g_list_sort(g_list_copy(lp1), (GCompareFunc)struct_entry_key_cmp);
-  lp2 = g_list_sort(g_list_copy(lp2), (GCompareFunc)struct_entry_key_cmp);
+  lp1 = g_list_sort(lp1, (GCompareFunc)struct_entry_key_cmp);
+  lp2 = g_list_sort(lp2, (GCompareFunc)struct_entry_key_cmp);
 
   // Loop foreach equal key
   while (lp1 != NULL && lp2 != NULL)
@@ -3077,8 +4703,8 @@ coil_struct_equals(gconstpointer   obj,
       || strcmp(p1->key, p2->key))
       goto done;
 
-    v1 = e1->value;
-    v2 = e2->value;
+    v1 = STRUCT_ENTRY_VALUE(e1);
+    v2 = STRUCT_ENTRY_VALUE(e2);
 
     if (coil_value_compare(v1, v2, error))
       goto done;
@@ -3106,6 +4732,9 @@ coil_struct_init (CoilStruct *self)
 {
   g_return_if_fail(COIL_IS_STRUCT(self));
   self->priv = COIL_STRUCT_GET_PRIVATE(self);
+
+  const StructEntryVector empty = STRUCT_ENTRY_VECTOR_INIT;
+  self->priv->entries = empty;
 }
 
 COIL_API(CoilStruct *)
@@ -3161,11 +4790,8 @@ coil_struct_new_valist(const gchar *first_property_name,
     }
 
     /* container may be an ancestor, we want the direct container */
-    container = coil_struct_create_containers_fast(self,
-                                                   priv->path->path,
-                                                   COIL_PATH_CONTAINER_LEN(priv->path),
-                                                   priv->is_prototype,
-                                                   FALSE, error);
+    container = struct_create_path_container(self, priv->path,
+                                             priv->is_prototype, error);
 
     if (container == NULL)
       goto error;
@@ -3178,7 +4804,8 @@ coil_struct_new_valist(const gchar *first_property_name,
 
     /* XXX: add self to the tree now */
     coil_value_init(value, COIL_TYPE_STRUCT, set_object, self);
-    if (!struct_insert_internal(container, path, value, priv->hash, TRUE, error))
+    if (!struct_insert_internal(container, path, value, priv->hash,
+                                TRUE, FALSE, error))
       goto error;
   }
   else if (!container)
@@ -3221,7 +4848,16 @@ coil_struct_finalize(GObject *object)
   CoilStruct        *const self = COIL_STRUCT(object);
   CoilStructPrivate *const priv = self->priv;
 
+  /* dependents hold a reference, anything left here was emptied */
+  while (priv->observers)
+    observer_unlink(priv->observers);
+
+  /* heirs may inherit through a link, which holds no reference */
+  while (priv->heirs)
+    observer_unlink(priv->heirs);
+
   coil_path_unref(priv->path);
+  struct_entry_vector_clear(&priv->entries);
   struct_table_unref(priv->table);
 
   G_OBJECT_CLASS(coil_struct_parent_class)->finalize(object);
@@ -3260,7 +4896,11 @@ coil_struct_set_property(GObject      *object,
       break;
 
     case PROP_IS_ACCUMULATING:
-      priv->is_accumulating = g_value_get_boolean(value);
+      /* same as coil_struct_begin_batch() and coil_struct_end_batch() */
+      if (g_value_get_boolean(value))
+        priv->batch_depth++;
+      else if (priv->batch_depth > 0)
+        priv->batch_depth--;
       break;
 
     default:
@@ -3300,7 +4940,7 @@ coil_struct_get_property(GObject      *object,
       break;
 
     case PROP_IS_ACCUMULATING:
-      g_value_set_boolean(value, priv->is_accumulating);
+      g_value_set_boolean(value, priv->batch_depth > 0);
       break;
 
     default:
@@ -3380,6 +5020,8 @@ coil_struct_class_init (CoilStructClass *klass)
                   g_cclosure_marshal_VOID__VOID,
                   G_TYPE_NONE, 0, NULL);
 
+  /* emitted before @self or a struct in it changes, the handler may
+   * return a GError to stop the change */
   struct_signals[MODIFY] =
     g_signal_newv("modify",
                   G_TYPE_FROM_CLASS(klass),
@@ -10,12 +10,17 @@ typedef struct _CoilStruct        CoilStruct;
 typedef struct _CoilStructClass   CoilStructClass;
 typedef struct _CoilStructPrivate CoilStructPrivate;
 typedef struct _CoilStructIter    CoilStructIter;
+typedef struct _CoilStructStats   CoilStructStats;
+typedef struct _CoilStructItem    CoilStructItem;
+typedef struct _CoilLookupHandle  CoilLookupHandle;
 
 #include "path.h"
 #include "expandable.h"
 #include "value.h"
+#include "region.h"
 
-#include "struct_table.h"
+/* length of the chain histogram in CoilStructStats */
+#define COIL_STRUCT_STATS_CHAINS 9
 
 #define COIL_TYPE_STRUCT              \
         (coil_struct_get_type())
@@ -49,12 +54,54 @@ struct _CoilStructClass
 struct _CoilStructIter
 {
   CoilStruct *node;
-  GList      *position;
+  guint32     position;
 #if COIL_DEBUG
   guint       version;
 #endif
 };
 
+struct _CoilStructStats
+{
+  guint            structs;
+  guint            prototypes; /* structs still pending definition */
+  guint            shared;     /* structs not expanded, entries not copied */
+  guint            entries;    /* keys in all structs */
+  guint            links;
+  guint            expressions;
+  guint            includes;
+
+  /* the path table shared by the whole tree */
+  struct
+  {
+    guint          size;     /* entries, @root included */
+    guint          buckets;
+    guint          deleted;  /* tombstones, open addressing only */
+
+    /*
+     * chained: number of buckets holding n entries
+     * open addressing: number of entries found after probing n groups
+     * the last counts everything at least that long
+     */
+    guint          chains[COIL_STRUCT_STATS_CHAINS];
+    guint          max_chain;
+
+    guint          rehashes;
+    guint          grows;
+    guint          shrinks;
+
+    gsize          memory;
+    gsize          region;   /* held by the region of the table, if any */
+  } table;
+};
+
+/* a path and value for coil_struct_insert_batch(), both stolen */
+struct _CoilStructItem
+{
+  gchar  *path;
+  guint   path_len;
+  GValue *value;
+};
+
 typedef gboolean (*CoilStructFunc)(CoilStruct *, gpointer);
 
 G_BEGIN_DECLS
@@ -90,7 +137,14 @@ coil_struct_create_containers(CoilStruct  *self,
 CoilStruct *
 coil_struct_create_containers_fast(CoilStruct  *self,
                                    const gchar *path,
-                                   guint8       path_len,
+                                   guint        path_len,
+                                   gboolean     prototype,
+                                   gboolean     has_previous_lookup,
+                                   GError     **error);
+
+CoilStruct *
+coil_struct_create_containers_path(CoilStruct  *self,
+                                   CoilPath    *path,
                                    gboolean     prototype,
                                    gboolean     has_previous_lookup,
                                    GError     **error);
@@ -120,6 +174,9 @@ coil_struct_is_descendent(const CoilStruct *descendent,
 CoilStruct *
 coil_struct_get_root(const CoilStruct *self);
 
+CoilRegion *
+coil_struct_get_region(const CoilStruct *self);
+
 CoilStruct *
 coil_struct_get_container(const CoilStruct *self);
 
@@ -154,7 +211,7 @@ coil_struct_insert(CoilStruct  *self,
 gboolean
 coil_struct_insert_fast(CoilStruct  *self,
                         gchar       *path_str, /* steals */
-                        guint8       path_len,
+                        guint        path_len,
                         GValue      *value, /* steals */
                         gboolean     replace,
                         GError     **error);
@@ -166,6 +223,13 @@ coil_struct_insert_key(CoilStruct   *self,
                        gboolean      replace,
                        GError      **error);
 
+gboolean
+coil_struct_insert_batch(CoilStruct     *self,
+                         CoilStructItem *items, /* steals contents */
+                         guint           n_items,
+                         gboolean        replace,
+                         GError        **error);
+
 gboolean
 coil_struct_delete_path(CoilStruct *self,
                         CoilPath   *path,
@@ -195,7 +259,7 @@ coil_struct_mark_deleted_path(CoilStruct *self,
 gboolean
 coil_struct_mark_deleted_fast(CoilStruct  *self,
                               gchar       *path_str, /* steal */
-                              guint8       path_len,
+                              guint        path_len,
                               gboolean     force,
                               GError     **error);
 
@@ -262,6 +326,27 @@ coil_struct_merge(CoilStruct *src,
                   CoilStruct *dst,
                   GError    **error);
 
+void
+coil_struct_begin_batch(CoilStruct *self);
+
+void
+coil_struct_end_batch(CoilStruct *self);
+
+void
+coil_struct_set_loading(CoilStruct *self,
+                        gboolean    is_loading);
+
+gboolean
+coil_struct_add_reader(CoilStruct  *self,
+                       const gchar *path,
+                       guint        path_len,
+                       gpointer     reader,
+                       GError     **error);
+
+void
+coil_struct_invalidate_readers(CoilStruct    *self,
+                               gconstpointer  object);
+
 gboolean
 coil_struct_expand(CoilStruct *self,
                    GError    **error);
@@ -271,6 +356,11 @@ coil_struct_expand_items(CoilStruct  *self,
                          gboolean     recursive,
                          GError     **error);
 
+gboolean
+coil_struct_preload_includes(CoilStruct  *self,
+                             gint         max_threads,
+                             GError     **error);
+
 const GValue *
 coil_struct_lookup_path(CoilStruct *self,
                         CoilPath   *path,
@@ -287,7 +377,7 @@ coil_struct_lookup_key(CoilStruct  *self,
 const GValue *
 coil_struct_lookup_fast(CoilStruct  *self,
                         const gchar *path_str,
-                        guint8       path_len,
+                        guint        path_len,
                         gboolean     expand_value,
                         GError     **error);
 
@@ -298,6 +388,28 @@ coil_struct_lookup(CoilStruct  *self,
                    gboolean     expand_value,
                    GError     **error);
 
+CoilLookupHandle *
+coil_lookup_prepare_path(CoilStruct  *self,
+                         CoilPath    *path,
+                         GError     **error);
+
+CoilLookupHandle *
+coil_lookup_prepare(CoilStruct   *self,
+                    const gchar  *path_str,
+                    guint         path_len,
+                    GError      **error);
+
+gboolean
+coil_lookup_is_stale(const CoilLookupHandle *handle);
+
+const GValue *
+coil_lookup_exec(CoilLookupHandle  *handle,
+                 gboolean           expand_value,
+                 GError           **error);
+
+void
+coil_lookup_free(CoilLookupHandle *handle);
+
 GList *
 coil_struct_get_paths(CoilStruct *self,
                       GError    **error);
@@ -327,6 +439,15 @@ gint
 coil_struct_get_size(CoilStruct *self,
                      GError    **error);
 
+gboolean
+coil_struct_get_content_hash(CoilStruct *self,
+                             guint      *hash,
+                             GError    **error);
+
+void
+coil_struct_get_stats(CoilStruct      *self,
+                      CoilStructStats *stats);
+
 void
 coil_struct_build_string(CoilStruct       *self,
                          GString          *const buffer,
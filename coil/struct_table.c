@@ -6,62 +6,557 @@
 
 #include "common.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+#if COIL_OPEN_ADDRESSING && defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 #include "struct.h"
+#include "struct_table.h"
+#include "region.h"
 
 #define DEFAULT_MAX 255 // max number of buckets (2^n - 1)
 
-#define HASH_BYTE(hash, byte) hash = (hash * 33 + (byte))
+struct _StructTable
+{
+  guint         max;
+  guint         size;
+
+  volatile gint ref_count;
+
+  /* bumped whenever an entry is added, removed or replaced */
+  guint         version;
+
+  /* entries expected soon, the table is not shrunk below them */
+  guint         reserved;
+
+  /* resize counters, see struct_table_get_stats */
+  guint         rehashes;
+  guint         grows;
+  guint         shrinks;
+
+  /* entry pool, see alloc_entry */
+  gpointer     *chunks;
+  guint         n_chunks;
+  guint32       pool_len;
+  guint32       free_head;
+
+#if COIL_REGION_ALLOC
+  /* backs the entry pool and parsed values, see struct_table_get_region */
+  CoilRegion   *region;
+#endif
+
+#if COIL_OPEN_ADDRESSING
+  guint         deleted; /* tombstones */
+  guint8       *ctrl;    /* one control byte per slot */
+  guint32      *slot;
+#else
+  guint32      *bucket;
+
+  /* previous buckets while an incremental resize is in progress */
+  guint32      *old_bucket;
+  guint         old_max;
+  guint         migrate_pos;
+#endif
+};
+
+/*
+ * Path hashes are built one key at a time. The hash of @root is 0 and
+ * the hash of "@root.a.b" is key "b" hashed on top of the hash of
+ * "@root.a", so the hash of any path can be derived from the hash of
+ * one of its containers. Keys are consumed 8 bytes per step and mixed
+ * with a per process seed so colliding keys can not be precomputed.
+ * The key length is mixed in last so a key can be hashed while it is
+ * being scanned for its end.
+ */
+static guint64 hash_seed = 0;
+
+#define HASH_PRIME_1 G_GUINT64_CONSTANT(0x9E3779B185EBCA87)
+#define HASH_PRIME_2 G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#define HASH_INIT(container_hash) \
+  (hash_seed ^ (((guint64)(container_hash) << 32) * HASH_PRIME_1))
+
+#define HASH_WORD(h, word) \
+  h = HASH_ROTL((h) ^ ((word) * HASH_PRIME_2), 31) * HASH_PRIME_1
+
+void
+hash_path_seed_init(void)
+{
+  const gchar *seed_str = g_getenv("COIL_HASH_SEED");
+
+  /* fixed seed for reproducing chain lengths or benchmarks */
+  if (seed_str && *seed_str)
+    hash_seed = g_ascii_strtoull(seed_str, NULL, 0);
+  else
+    hash_seed = ((guint64)g_random_int() << 32) | g_random_int();
+}
+
+static inline guint
+hash_final(guint64 h,
+           guint   n)
+{
+  guint hash;
+
+  HASH_WORD(h, (guint64)n);
+
+  h ^= h >> 33;
+  h *= HASH_PRIME_2;
+  h ^= h >> 29;
+
+  hash = (guint)(h ^ (h >> 32));
+
+  /* 0 is reserved for @root */
+  return hash ? hash : 1;
+}
+
+/*
+ * Paths are scanned a word at a time. Delimiters are found with the
+ * exact zero byte test on the word xor'd with a word of delimiters,
+ * which has no false positives so the first delimiter can be taken from
+ * either end of the mask regardless of byte order.
+ */
+#define WORD_ONES G_GUINT64_CONSTANT(0x0101010101010101)
+#define WORD_LOW7 G_GUINT64_CONSTANT(0x7F7F7F7F7F7F7F7F)
+
+#define WORD_DELIMS (WORD_ONES * (guchar)COIL_PATH_DELIM)
 
 static inline guint
-hash_bytes(guint         hash,
-           const guchar *byte,
-           guint         n)
+word_first_delim(guint64 word)
 {
-  g_return_val_if_fail(byte, 0);
-  g_return_val_if_fail(*byte, 0);
-  g_return_val_if_fail(n > 0, 0);
+  guint64 x = word ^ WORD_DELIMS, mask;
+
+  /* high bit set in each byte of x that is zero */
+  mask = ~(((x & WORD_LOW7) + WORD_LOW7) | x | WORD_LOW7);
 
-  do
+  if (mask == 0)
+    return sizeof(word);
+
+#if defined(__GNUC__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return __builtin_ctzll(mask) >> 3;
+#elif defined(__GNUC__) && G_BYTE_ORDER == G_BIG_ENDIAN
+  return __builtin_clzll(mask) >> 3;
+#else
   {
-    HASH_BYTE(hash, *byte++);
-  } while (--n > 0);
+    const guchar *bytes = (const guchar *)&word;
+    guint         i;
 
-  return hash;
+    for (i = 0; bytes[i] != COIL_PATH_DELIM; i++);
+
+    return i;
+  }
+#endif
+}
+
+/* keep the first n bytes of word in memory order */
+static inline guint64
+word_prefix(guint64 word,
+            guint   n)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return word & ((G_GUINT64_CONSTANT(1) << (n << 3)) - 1);
+#else
+  return word & ~(G_MAXUINT64 >> (n << 3));
+#endif
+}
+
+/* character classes of COIL_KEY_REGEX, "-*[a-zA-Z_][\w-]*" */
+enum
+{
+  KEY_CHAR  = 1 << 0, /* [\w-] */
+  KEY_START = 1 << 1, /* [a-zA-Z_] */
+  KEY_WIDE  = 1 << 2, /* in a non-ASCII character, \w is up to GRegex */
+};
+
+#define C KEY_CHAR
+#define L (KEY_CHAR | KEY_START)
+#define W KEY_WIDE
+
+static const guint8 key_char_class[256] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, C, 0, 0,
+  C, C, C, C, C, C, C, C, C, C, 0, 0, 0, 0, 0, 0,
+  0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+  L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, L,
+  0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+  L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, 0,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+  W, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W
+};
+
+#undef C
+#undef L
+#undef W
+
+/*
+ * Match @str against ^@pattern$ with GRegex, the way keys and paths were
+ * validated before the tables above. Only strings with non-ASCII key
+ * characters come here, \w takes Unicode letters and digits.
+ */
+static gboolean
+regex_match(gsize       *regex,
+            const gchar *pattern,
+            const gchar *str,
+            guint        len)
+{
+  /* includes may be parsed on other threads */
+  if (g_once_init_enter(regex))
+    g_once_init_leave(regex, (gsize)g_regex_new(pattern, G_REGEX_OPTIMIZE,
+                                                G_REGEX_MATCH_NOTEMPTY,
+                                                NULL));
+
+  /* GRegex does not define matching on invalid UTF-8 */
+  return g_utf8_validate(str, len, NULL)
+    && g_regex_match_full((GRegex *)*regex, str, len, 0, 0, NULL, NULL);
+}
+
+/*
+ * Length of the newline sequence ending s, if any. '$' in the key and
+ * path regexes matches before a final newline and GRegex recognizes any
+ * Unicode newline sequence by default, so validation ignores it too.
+ */
+static inline guint
+final_newline_len(const guchar *s,
+                  guint         len)
+{
+  const guchar *end = s + len;
+
+  if (len == 0)
+    return 0;
+
+  switch (end[-1])
+  {
+    case '\n':
+      return (len > 1 && end[-2] == '\r') ? 2 : 1;
+    case '\r':
+    case '\v':
+    case '\f':
+      return 1;
+    case 0x85: /* U+0085 */
+      return (len > 1 && end[-2] == 0xC2) ? 2 : 0;
+    case 0xA8: /* U+2028 */
+    case 0xA9: /* U+2029 */
+      return (len > 2 && end[-3] == 0xE2 && end[-2] == 0x80) ? 3 : 0;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * Scan one key of a path starting at s, up to the next delimiter or end.
+ * The key is hashed on top of container_hash into *hash and checked
+ * against COIL_KEY_REGEX into *valid, either may be NULL to skip it.
+ * Bytes from valid_end on (a final newline) are ignored when validating.
+ * *wide is set when the key has non-ASCII characters the tables cannot
+ * tell about, the caller matches those against the regex.
+ */
+static inline const guchar *
+scan_key(const guchar *s,
+         const guchar *end,
+         const guchar *valid_end,
+         guint         container_hash,
+         guint        *hash,
+         gboolean     *valid,
+         gboolean     *wide)
+{
+  const guchar *const start = s;
+  guint64             h = HASH_INIT(container_hash), word;
+  guint               n, i;
+  gboolean            need_start = TRUE;
+
+  for (;;)
+  {
+    gsize left = end - s;
+
+    if (G_LIKELY(left >= sizeof(word)))
+    {
+      memcpy(&word, s, sizeof(word));
+      n = word_first_delim(word);
+    }
+    else
+    {
+      /* zero padding is never a delimiter */
+      word = 0;
+      memcpy(&word, s, left);
+      n = MIN(word_first_delim(word), left);
+    }
+
+    if (valid && *valid)
+    {
+      for (i = 0; i < n; i++)
+      {
+        const guint8 cls = key_char_class[s[i]];
+
+        if (s + i >= valid_end)
+          break;
+
+        if (G_UNLIKELY(need_start))
+        {
+          if (s[i] == '-')
+            continue;
+
+          need_start = FALSE;
+
+          if (!(cls & KEY_START))
+            *valid = FALSE;
+        }
+        else if (G_UNLIKELY(cls & KEY_WIDE))
+          *wide = TRUE;
+        else if (!(cls & KEY_CHAR))
+          *valid = FALSE;
+      }
+    }
+
+    if (n < sizeof(word))
+    {
+      if (hash && n > 0)
+        HASH_WORD(h, word_prefix(word, n));
+
+      s += n;
+      break;
+    }
+
+    if (hash)
+      HASH_WORD(h, word);
+
+    s += sizeof(word);
+  }
+
+  /* empty or only dashes */
+  if (valid && need_start)
+    *valid = FALSE;
+
+  if (hash)
+    *hash = hash_final(h, s - start);
+
+  return s;
+}
+
+static inline void
+scan_add_prefix(PathScan *scan,
+                guint     n,
+                guint     hash,
+                guint     len)
+{
+  if (G_UNLIKELY(n >= scan->size))
+  {
+    guint size = scan->size * 2;
+
+    if (scan->hashes == scan->inline_hashes)
+    {
+      scan->hashes = g_new(guint, size);
+      scan->lens = g_new(guint, size);
+      memcpy(scan->hashes, scan->inline_hashes, n * sizeof(guint));
+      memcpy(scan->lens, scan->inline_lens, n * sizeof(guint));
+    }
+    else
+    {
+      scan->hashes = g_renew(guint, scan->hashes, size);
+      scan->lens = g_renew(guint, scan->lens, size);
+    }
+
+    scan->size = size;
+  }
+
+  scan->hashes[n] = hash;
+  scan->lens[n] = len;
+}
+
+/**
+ * Scan @path once, finding its keys and optionally hashing and validating
+ * them on the way.
+ *
+ * Absolute paths are hashed from @root, whose hash is 0. Relative paths
+ * are hashed on top of @container_hash, skipping the leading delimiters
+ * of a back reference. With PATH_SCAN_PREFIXES the hash and length of
+ * every prefix is recorded, see PathScan. With PATH_SCAN_VALIDATE
+ * @scan->valid tells if @path matches COIL_PATH_REGEX; paths with
+ * non-ASCII key characters are checked against the regex itself.
+ *
+ * Free with path_scan_clear() when prefixes were recorded.
+ */
+void
+path_scan(PathScan      *scan,
+          guint          container_hash,
+          const gchar   *path,
+          guint          path_len,
+          PathScanFlags  flags)
+{
+  g_return_if_fail(scan);
+  g_return_if_fail(path);
+
+  const guchar *const begin = (const guchar *)path;
+  const guchar *const end = begin + path_len;
+  const guchar       *s = begin, *key, *valid_end = NULL;
+  guint               hash = container_hash, key_hash;
+  gboolean            valid = TRUE, wide = FALSE, absolute = FALSE;
+  gboolean           *validp = (flags & PATH_SCAN_VALIDATE) ? &valid : NULL;
+  guint              *hashp = (flags & (PATH_SCAN_HASH | PATH_SCAN_PREFIXES))
+                            ? &key_hash : NULL;
+
+  scan->n_keys = 0;
+  scan->hashes = scan->inline_hashes;
+  scan->lens = scan->inline_lens;
+  scan->size = PATH_SCAN_INLINE;
+
+  if (validp)
+    valid_end = end - final_newline_len(begin, path_len);
+
+  if (path_len > 0 && *s == COIL_SPECIAL_CHAR)
+  {
+    /* the first key after '@' is @root which is not hashed */
+    s = scan_key(s + 1, end, valid_end, 0, NULL, validp, &wide);
+    absolute = TRUE;
+    hash = 0;
+  }
+  else if (path_len > 1 && s[0] == COIL_PATH_DELIM
+      && s[1] == COIL_PATH_DELIM)
+  {
+    while (s < end && *s == COIL_PATH_DELIM)
+      s++;
+  }
+
+  scan->container_hash = hash;
+  scan->key_offset = absolute ? 1 : s - begin;
+
+  if (flags & PATH_SCAN_PREFIXES)
+    scan_add_prefix(scan, 0, hash, s - begin);
+
+  if (!absolute || s < end)
+  {
+    /* step over the delimiter after @root */
+    if (absolute)
+      s++;
+
+    for (;;)
+    {
+      key = s;
+      s = scan_key(s, end, valid_end, hash, hashp, validp, &wide);
+
+      if (s > key)
+      {
+        scan->container_hash = hash;
+        scan->key_offset = key - begin;
+        scan->n_keys++;
+
+        if (hashp)
+          hash = key_hash;
+
+        if (flags & PATH_SCAN_PREFIXES)
+          scan_add_prefix(scan, scan->n_keys, hash, s - begin);
+      }
+      else
+        valid = FALSE; /* empty key */
+
+      if (s >= end)
+        break;
+
+      s++;
+    }
+  }
+
+  if (G_UNLIKELY(valid && wide && validp))
+  {
+    static gsize path_regex = 0;
+
+    valid = regex_match(&path_regex, "^"COIL_PATH_REGEX"$", path, path_len);
+  }
+
+  scan->hash = hash;
+  scan->valid = valid;
+}
+
+/**
+ * TRUE if @key matches COIL_KEY_REGEX. Like path_scan() this checks a
+ * word at a time against the key character classes so it is cheap
+ * enough to run on every insert. Keys with non-ASCII characters are
+ * matched against COIL_KEY_REGEX itself.
+ */
+gboolean
+path_scan_key(const gchar *key,
+              guint        key_len)
+{
+  g_return_val_if_fail(key, FALSE);
+
+  const guchar *const begin = (const guchar *)key;
+  const guchar *const end = begin + key_len;
+  const guchar       *s;
+  gboolean            valid = TRUE, wide = FALSE;
+
+  /* a delimiter ends the scan early and is not a key character */
+  s = scan_key(begin, end, end - final_newline_len(begin, key_len),
+               0, NULL, &valid, &wide);
+
+  if (!valid || s != end)
+    return FALSE;
+
+  if (G_UNLIKELY(wide))
+  {
+    static gsize key_regex = 0;
+
+    return regex_match(&key_regex, "^"COIL_KEY_REGEX"$", key, key_len);
+  }
+
+  return TRUE;
+}
+
+void
+path_scan_clear(PathScan *scan)
+{
+  g_return_if_fail(scan);
+
+  if (scan->hashes != scan->inline_hashes)
+  {
+    g_free(scan->hashes);
+    g_free(scan->lens);
+  }
+
+  scan->hashes = scan->inline_hashes;
+  scan->lens = scan->inline_lens;
 }
 
 inline guint
 hash_absolute_path(const gchar *path,
-                   guint8       path_len)
+                   guint        path_len)
 {
   g_return_val_if_fail(path, 0);
   g_return_val_if_fail(*path == '@', 0); /* must be absolute */
   g_return_val_if_fail(path_len > 0, 0);
 
-  path += COIL_ROOT_PATH_LEN;
-  path_len -= COIL_ROOT_PATH_LEN;
+  PathScan scan;
 
-  if (path_len > 0)
-    return hash_bytes(0, (guchar *)path, path_len);
+  path_scan(&scan, 0, path, path_len, PATH_SCAN_HASH);
 
-  return 0;
+  return scan.hash;
 }
 
 inline guint
 hash_relative_path(guint        container_hash,
                    const gchar *path,
-                   guint8       path_len)
+                   guint        path_len)
 {
   g_return_val_if_fail(path, 0);
   g_return_val_if_fail(*path, 0);
   g_return_val_if_fail(*path != '@', 0);
   g_return_val_if_fail(path_len > 0, 0);
 
-  if (path[0] != COIL_PATH_DELIM)
-    HASH_BYTE(container_hash, COIL_PATH_DELIM);
+  PathScan scan;
 
-  return hash_bytes(container_hash, (guchar *)path, path_len);
+  path_scan(&scan, container_hash, path, path_len, PATH_SCAN_HASH);
+
+  return scan.hash;
 }
 
 /**
@@ -75,7 +570,7 @@ compute_real_max(guint size)
   g_return_val_if_fail(size > 0, 0);
 
 #ifdef __GNUC__
-  size = G_MAXUINT >> __builtin_clzl(size);
+  size = G_MAXUINT >> __builtin_clz(size);
 #else
   size |= size >> 1;
   size |= size >> 2;
@@ -87,70 +582,1037 @@ compute_real_max(guint size)
   return size | DEFAULT_MAX;
 }
 
-StructTable *
-struct_table_new_sized(gsize size)
+
+/*
+ * Entries of a table live in a pool of fixed size chunks which are never
+ * moved, so entry pointers stay valid until the entry is destroyed while
+ * buckets can link entries with 32 bit indices.
+ *
+ * Chunks are aligned to their size and the first slot of each chunk holds
+ * its chunk number, which gives the index of an entry from its address.
+ */
+#define CHUNK_BYTES 8192
+#define CHUNK_ENTRIES ((guint32)(CHUNK_BYTES / sizeof(StructEntry)) - 1)
+
+typedef struct _EntryChunk
 {
-  g_return_val_if_fail(size > 0, NULL);
+  guint32 chunk_no;
+} EntryChunk;
 
-  StructTable *table;
+static inline StructEntry *
+pool_entry(const StructTable *table,
+           guint32            idx)
+{
+  StructEntry *chunk = table->chunks[idx / CHUNK_ENTRIES];
 
-  table = g_new(StructTable, 1);
-  table->max = compute_real_max(size); /* max always (2^n)-1 */
-  table->bucket = g_new0(StructEntry *, table->max + 1);
-  table->ref_count = 1;
-  table->size = 0;
+  return &chunk[1 + idx % CHUNK_ENTRIES];
+}
 
-  return table;
+static inline guint32
+pool_index(const StructEntry *entry)
+{
+  const StructEntry *chunk;
+
+  chunk = (const StructEntry *)((gsize)entry & ~(gsize)(CHUNK_BYTES - 1));
+
+  return ((const EntryChunk *)chunk)->chunk_no * CHUNK_ENTRIES
+    + (guint32)(entry - chunk - 1);
 }
 
-StructTable *
-struct_table_new(void)
+static void
+pool_init(StructTable *table)
 {
-  return struct_table_new_sized(DEFAULT_MAX);
+  g_return_if_fail(table);
+
+  table->chunks = NULL;
+  table->n_chunks = 0;
+  table->pool_len = 0;
+  table->free_head = STRUCT_ENTRY_NONE;
+#if COIL_REGION_ALLOC
+  table->region = NULL;
+#endif
 }
 
+#if COIL_REGION_ALLOC
+#define CHUNKS_PER_BLOCK (COIL_REGION_BLOCK_BYTES / CHUNK_BYTES)
+#endif
+
 static void
-struct_table_rehash(StructTable *table,
-                    guint        max)
+pool_add_chunk(StructTable *table)
 {
   g_return_if_fail(table);
-  g_return_if_fail(max > 0);
-  g_return_if_fail(max == compute_real_max(max));
 
-  guint        n;
-  StructEntry *entry, *next, **old, **new;
+  gpointer chunk;
 
-  if (table->max == max)
-    return;
+#if COIL_REGION_ALLOC
+  /* take whole blocks so chunks stay aligned without padding */
+  if (table->n_chunks % CHUNKS_PER_BLOCK == 0)
+    chunk = coil_region_alloc_aligned(struct_table_get_region(table),
+                                      COIL_REGION_BLOCK_BYTES,
+                                      COIL_REGION_BLOCK_BYTES);
+  else
+    chunk = (gchar *)table->chunks[table->n_chunks - 1] + CHUNK_BYTES;
+#else
+  if (posix_memalign(&chunk, CHUNK_BYTES, CHUNK_BYTES) != 0)
+    g_error("%s: failed to allocate %d bytes", G_STRLOC, CHUNK_BYTES);
+#endif
 
-  new = g_new0(StructEntry *, max + 1);
+  /* grow chunk array by powers of 2 */
+  if ((table->n_chunks & (table->n_chunks - 1)) == 0)
+    table->chunks = g_renew(gpointer, table->chunks,
+                            MAX(table->n_chunks << 1, 1));
 
-  if (table->size > 0)
-    for (n = table->max, old = &table->bucket[n];
-         n-- > 0; old = &table->bucket[n])
-    {
-      for (entry = *old;
-           entry; entry = next)
-      {
-        guint idx = entry->hash & max;
+  ((EntryChunk *)chunk)->chunk_no = table->n_chunks;
+  table->chunks[table->n_chunks++] = chunk;
+}
 
-        next = entry->next;
-        entry->next = new[idx];
-        new[idx] = entry;
-      }
-    }
+static StructEntry *
+alloc_entry(StructTable *table)
+{
+  g_return_val_if_fail(table, NULL);
 
-  g_free(table->bucket);
-  table->bucket = new;
-  table->max = max;
+  StructEntry *entry;
+
+  if (table->free_head != STRUCT_ENTRY_NONE)
+  {
+    entry = pool_entry(table, table->free_head);
+    table->free_head = entry->next;
+  }
+  else
+  {
+    if (G_UNLIKELY(table->pool_len == STRUCT_ENTRY_NONE))
+      g_error("%s: too many entries", G_STRLOC);
+
+    if (table->pool_len % CHUNK_ENTRIES == 0)
+      pool_add_chunk(table);
+
+    entry = pool_entry(table, table->pool_len++);
+  }
+
+  entry->next = STRUCT_ENTRY_NONE;
+  entry->order = STRUCT_ENTRY_NONE;
+  entry->path = NULL;
+  entry->kind = STRUCT_VALUE_EMPTY;
+  entry->inherited = FALSE;
+
+  return entry;
 }
 
-guint
-struct_table_get_size(const StructTable *table)
+static StructValueKind
+value_kind(const GValue *value)
 {
-  g_return_val_if_fail(table, 0);
+  GType type = G_VALUE_TYPE(value);
+
+  /* none of the fundamental types are expandable */
+  if (G_TYPE_IS_FUNDAMENTAL(type))
+    return STRUCT_VALUE_SCALAR;
+
+  if (g_type_is_a(type, COIL_TYPE_STRUCT))
+    return STRUCT_VALUE_STRUCT;
+
+  if (g_type_is_a(type, COIL_TYPE_EXPANDABLE))
+    return STRUCT_VALUE_EXPANDABLE;
+
+  return STRUCT_VALUE_SCALAR;
+}
+
+/*
+ * Store @value in @entry, replacing any value it holds. The contents of
+ * @value are moved into the entry and @value itself is freed, it may be
+ * NULL to leave the entry empty.
+ */
+void
+struct_entry_set_value(const StructTable *table,
+                       StructEntry       *entry,
+                       GValue            *value) /* steals */
+{
+  g_return_if_fail(table);
+  g_return_if_fail(entry);
+
+  if (entry->kind != STRUCT_VALUE_EMPTY)
+    g_value_unset(&entry->value);
+
+  if (value == NULL)
+  {
+    entry->kind = STRUCT_VALUE_EMPTY;
+    return;
+  }
+
+  entry->kind = value_kind(value);
+  memcpy(&entry->value, value, sizeof(GValue));
+
+#if COIL_REGION_ALLOC
+  /* released with the region */
+  if (table->region && coil_region_contains(table->region, value))
+    return;
+#endif
+
+  g_slice_free(GValue, value);
+}
+
+static void
+clear_entry(StructTable *table,
+            StructEntry *entry)
+{
+  g_return_if_fail(entry);
+
+  if (G_LIKELY(entry->path))
+  {
+    coil_path_unref(entry->path);
+    entry->path = NULL;
+  }
+
+  if (entry->kind != STRUCT_VALUE_EMPTY)
+  {
+    g_value_unset(&entry->value);
+    entry->kind = STRUCT_VALUE_EMPTY;
+  }
+
+  entry->next = STRUCT_ENTRY_NONE;
+}
+
+/* return entry to the pool without touching path or value */
+static void
+release_entry(StructTable *table,
+              StructEntry *entry)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(entry);
+
+  entry->path = NULL;
+  entry->kind = STRUCT_VALUE_EMPTY;
+  entry->next = table->free_head;
+  table->free_head = pool_index(entry);
+}
+
+static void
+destroy_entry(StructTable *table,
+              StructEntry *entry)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(entry);
+
+  clear_entry(table, entry);
+  release_entry(table, entry);
+}
+
+static void
+pool_destroy(StructTable *table)
+{
+  g_return_if_fail(table);
+
+  guint32 n;
+
+  /* free entries are released with a NULL path */
+  for (n = 0; n < table->pool_len; n++)
+  {
+    StructEntry *entry = pool_entry(table, n);
+
+    if (entry->path)
+      clear_entry(table, entry);
+  }
+
+#if COIL_REGION_ALLOC
+  /* chunks of entries go with the region */
+  if (table->region)
+    coil_region_free(table->region);
+#else
+  guint i;
+
+  for (i = 0; i < table->n_chunks; i++)
+    free(table->chunks[i]);
+#endif
+
+  g_free(table->chunks);
+  pool_init(table);
+}
+
+static gsize
+pool_get_memory(const StructTable *table)
+{
+  g_return_val_if_fail(table, 0);
+
+  guint capacity = 1;
+  gsize chunk_bytes;
+
+  while (capacity < table->n_chunks)
+    capacity <<= 1;
+
+#if COIL_REGION_ALLOC
+  /* chunks are carved from whole region blocks */
+  chunk_bytes = (table->n_chunks + CHUNKS_PER_BLOCK - 1)
+              / CHUNKS_PER_BLOCK * COIL_REGION_BLOCK_BYTES;
+#else
+  chunk_bytes = table->n_chunks * CHUNK_BYTES;
+#endif
+
+  return chunk_bytes
+    + (table->n_chunks ? capacity * sizeof(gpointer) : 0);
+}
+
+static void
+count_rehash(StructTable *table,
+             guint        max)
+{
+  g_return_if_fail(table);
+
+  table->rehashes++;
+
+  if (max > table->max)
+    table->grows++;
+  else if (max < table->max)
+    table->shrinks++;
+}
+
+/* entry at the head of a bucket chain or slot, NULL if none */
+#define LINK_ENTRY(table, link) \
+  ((link) == STRUCT_ENTRY_NONE ? NULL : pool_entry((table), (link)))
+
+/* copy length and last bytes of the path of @entry into the entry */
+static inline void
+entry_update_key(StructEntry *entry)
+{
+  const CoilPath *p = entry->path;
+  guint           n = MIN(p->path_len, STRUCT_ENTRY_TAIL_LEN);
+
+  entry->path_len = p->path_len;
+  memset(entry->path_tail, 0, STRUCT_ENTRY_TAIL_LEN);
+  memcpy(entry->path_tail, p->path + p->path_len - n, n);
+}
+
+/*
+ * Siblings share everything but the key at the end of the path, so hash,
+ * length and the path tail reject nearly every candidate before the path
+ * itself has to be loaded.
+ */
+static inline gboolean
+entry_matches(const StructEntry *entry,
+              guint              hash,
+              const gchar       *path,
+              guint              path_len)
+{
+  guint n;
+
+  if (entry->hash != hash || entry->path_len != path_len)
+    return FALSE;
+
+  n = MIN(path_len, STRUCT_ENTRY_TAIL_LEN);
+
+  if (memcmp(entry->path_tail, path + path_len - n, n) != 0)
+    return FALSE;
+
+  return memcmp(entry->path->path, path, path_len - n) == 0;
+}
+
+#if COIL_OPEN_ADDRESSING
+
+/*
+ * Open addressing backend.
+ *
+ * Every slot has one control byte which is either empty, deleted or a 7 bit
+ * tag taken from the mixed hash. Slots are probed in groups of 16 control
+ * bytes, compared with a single SSE2 instruction where available, so a miss
+ * rarely has to dereference the entry or its path at all.
+ */
+
+#define GROUP_WIDTH 16
+#define GROUP_MASK (GROUP_WIDTH - 1)
+
+#define CTRL_EMPTY   ((guint8)0x80)
+#define CTRL_DELETED ((guint8)0xFE)
+
+#define CTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+#define NO_SLOT G_MAXUINT
+
+/* grow before more than 7/8 of the slots are used (including tombstones) */
+#define LOAD_EXCEEDED(table, used) \
+  (((guint64)(used) << 3) > ((guint64)(table)->max + 1) * 7)
+
+/* spread the path hash so both the slot index and the tag get good bits */
+static inline guint
+mix_hash(guint hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6B;
+  hash ^= hash >> 13;
+
+  return hash;
+}
+
+#define HASH_TAG(mixed) ((guint8)((mixed) >> 25))
+
+/*
+ * Groups are always aligned to GROUP_WIDTH and probed with triangular
+ * steps. The number of groups is a power of 2 so each group is visited
+ * exactly once before the sequence wraps around.
+ */
+#define PROBE_START(table, mixed) ((mixed) & (table)->max & ~GROUP_MASK)
+#define PROBE_NEXT(table, pos, step) \
+  (((pos) + (step) * GROUP_WIDTH) & (table)->max)
+
+#define PROBE_LIMIT(table) (((table)->max >> 4) + 1)
+
+/** bitmask of slots in the group at @ctrl with control byte @byte */
+static inline guint
+group_match(const guint8 *ctrl,
+            guint8        byte)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+#else
+  guint i, mask = 0;
+
+  for (i = 0; i < GROUP_WIDTH; i++)
+    if (ctrl[i] == byte)
+      mask |= 1 << i;
+
+  return mask;
+#endif
+}
+
+/** bitmask of slots in the group at @ctrl which are empty or deleted */
+static inline guint
+group_match_free(const guint8 *ctrl)
+{
+#ifdef __SSE2__
+  /* only empty and deleted control bytes have the high bit set */
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+  guint i, mask = 0;
+
+  for (i = 0; i < GROUP_WIDTH; i++)
+    if (!CTRL_IS_FULL(ctrl[i]))
+      mask |= 1 << i;
+
+  return mask;
+#endif
+}
+
+static inline guint
+mask_next_bit(guint *mask)
+{
+  guint bit = g_bit_nth_lsf(*mask, -1);
+
+  *mask &= *mask - 1;
+
+  return bit;
+}
+
+static void
+alloc_slots(StructTable *table,
+            guint        max)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(max == compute_real_max(max));
+
+  table->max = max;
+  table->ctrl = g_malloc(max + 1);
+  table->slot = g_new(guint32, max + 1);
+  table->deleted = 0;
+
+  memset(table->ctrl, CTRL_EMPTY, max + 1);
+}
+
+StructTable *
+struct_table_new_sized(gsize size)
+{
+  g_return_val_if_fail(size > 0, NULL);
+
+  StructTable *table;
+
+  table = g_new(StructTable, 1);
+  alloc_slots(table, compute_real_max(size)); /* max always (2^n)-1 */
+  pool_init(table);
+  table->ref_count = 1;
+  table->size = 0;
+  table->rehashes = table->grows = table->shrinks = 0;
+  table->version = 0;
+  table->reserved = 0;
+
+  return table;
+}
+
+static guint
+find_slot(const StructTable *table,
+          guint              hash,
+          const gchar       *path,
+          guint              path_len)
+{
+  g_return_val_if_fail(table, NO_SLOT);
+  g_return_val_if_fail(path, NO_SLOT);
+  g_return_val_if_fail(*path == '@', NO_SLOT);
+  g_return_val_if_fail(path_len > 0, NO_SLOT);
+
+  guint  mixed = mix_hash(hash);
+  guint8 tag = HASH_TAG(mixed);
+  guint  pos, step;
+
+  for (pos = PROBE_START(table, mixed), step = 1;
+       step <= PROBE_LIMIT(table);
+       pos = PROBE_NEXT(table, pos, step), step++)
+  {
+    const guint8 *group = &table->ctrl[pos];
+    guint         mask = group_match(group, tag);
+
+    while (mask)
+    {
+      guint              idx = pos + mask_next_bit(&mask);
+      const StructEntry *entry = pool_entry(table, table->slot[idx]);
+
+      if (entry_matches(entry, hash, path, path_len))
+        return idx;
+    }
+
+    /* a probe never continues past a group with an empty slot */
+    if (group_match(group, CTRL_EMPTY))
+      break;
+  }
+
+  return NO_SLOT;
+}
+
+static guint
+find_slot_with_entry(const StructTable *table,
+                     const StructEntry *entry)
+{
+  g_return_val_if_fail(table, NO_SLOT);
+  g_return_val_if_fail(entry, NO_SLOT);
+
+  guint   mixed = mix_hash(entry->hash);
+  guint8  tag = HASH_TAG(mixed);
+  guint32 entry_idx = pool_index(entry);
+  guint   pos, step;
+
+  for (pos = PROBE_START(table, mixed), step = 1;
+       step <= PROBE_LIMIT(table);
+       pos = PROBE_NEXT(table, pos, step), step++)
+  {
+    const guint8 *group = &table->ctrl[pos];
+    guint         mask = group_match(group, tag);
+
+    while (mask)
+    {
+      guint idx = pos + mask_next_bit(&mask);
+
+      if (table->slot[idx] == entry_idx)
+        return idx;
+    }
+
+    if (group_match(group, CTRL_EMPTY))
+      break;
+  }
+
+  return NO_SLOT;
+}
+
+/** find the first empty or deleted slot in the probe sequence of @hash */
+static guint
+find_free_slot(const StructTable *table,
+               guint              hash)
+{
+  g_return_val_if_fail(table, NO_SLOT);
+
+  guint mixed = mix_hash(hash);
+  guint pos, step;
+
+  for (pos = PROBE_START(table, mixed), step = 1;
+       step <= PROBE_LIMIT(table);
+       pos = PROBE_NEXT(table, pos, step), step++)
+  {
+    guint mask = group_match_free(&table->ctrl[pos]);
+
+    if (mask)
+      return pos + mask_next_bit(&mask);
+  }
+
+  g_assert_not_reached();
+  return NO_SLOT;
+}
+
+static void
+occupy_slot(StructTable *table,
+            guint        idx,
+            StructEntry *entry)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(idx <= table->max);
+  g_return_if_fail(entry);
+
+  if (table->ctrl[idx] == CTRL_DELETED)
+    table->deleted--;
+
+  table->ctrl[idx] = HASH_TAG(mix_hash(entry->hash));
+  table->slot[idx] = pool_index(entry);
+  table->size++;
+}
+
+static StructEntry *
+vacate_slot(StructTable *table,
+            guint        idx)
+{
+  g_return_val_if_fail(table, NULL);
+
+  StructEntry *entry;
+
+  if (idx == NO_SLOT)
+    return NULL;
+
+  g_return_val_if_fail(CTRL_IS_FULL(table->ctrl[idx]), NULL);
+
+  entry = pool_entry(table, table->slot[idx]);
+
+  /* if the group still has an empty slot no probe has ever passed it, so
+   * this slot can become empty again instead of leaving a tombstone */
+  if (group_match(&table->ctrl[idx & ~GROUP_MASK], CTRL_EMPTY))
+    table->ctrl[idx] = CTRL_EMPTY;
+  else
+  {
+    table->ctrl[idx] = CTRL_DELETED;
+    table->deleted++;
+  }
+
+  table->size--;
+
+  return entry;
+}
+
+static void
+struct_table_rehash(StructTable *table,
+                    guint        max)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(max > 0);
+  g_return_if_fail(max == compute_real_max(max));
+
+  guint         n, old_max = table->max;
+  guint8       *old_ctrl = table->ctrl;
+  guint32      *old_slot = table->slot;
+
+  /* also called with the same max to purge tombstones */
+  count_rehash(table, max);
+  alloc_slots(table, max);
+  table->size = 0;
+
+  for (n = 0; n <= old_max; n++)
+  {
+    if (CTRL_IS_FULL(old_ctrl[n]))
+    {
+      StructEntry *entry = pool_entry(table, old_slot[n]);
+
+      occupy_slot(table, find_free_slot(table, entry->hash), entry);
+    }
+  }
+
+  g_free(old_ctrl);
+  g_free(old_slot);
+}
+
+void
+struct_table_resize(StructTable *table,
+                   guint         size)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(size > 0);
+
+  guint max;
+
+  /* leave enough room for size entries under the 7/8 load limit */
+  max = compute_real_max(size + size / 7 + 1);
+
+  if (max != table->max)
+    struct_table_rehash(table, max);
+}
+
+/*
+ * Room for @n more entries without growing. The table does not shrink
+ * below it until struct_table_release() is called with the reservation
+ * returned, when the operation adding the entries is done.
+ */
+guint
+struct_table_reserve(StructTable *table,
+                     guint        n)
+{
+  g_return_val_if_fail(table, 0);
+
+  guint size = table->size + n;
+  guint previous = table->reserved;
+
+  if (n == 0)
+    return previous;
+
+  if (LOAD_EXCEEDED(table, size + table->deleted))
+    struct_table_resize(table, size);
+
+  table->reserved = MAX(previous, size);
+
+  return previous;
+}
+
+static void
+struct_table_calibrate(StructTable *table)
+{
+  g_return_if_fail(table);
+
+  if (LOAD_EXCEEDED(table, table->size + table->deleted))
+  {
+    if (LOAD_EXCEEDED(table, table->size << 1))
+      /* grow by factor of 2 and prevent overflow issues */
+      struct_table_rehash(table, (table->max << 1) | table->max);
+    else
+      /* mostly tombstones, rebuild at the same size */
+      struct_table_rehash(table, table->max);
+  }
+  else if (table->size <= table->max >> 2
+      && table->size > DEFAULT_MAX
+      && table->reserved == 0)
+    struct_table_rehash(table, (table->max >> 1) | DEFAULT_MAX);
+}
+
+/* end the reservation made by struct_table_reserve() */
+void
+struct_table_release(StructTable *table,
+                     guint        previous)
+{
+  g_return_if_fail(table);
+
+  table->reserved = previous;
+  struct_table_calibrate(table);
+}
+
+StructEntry *
+struct_table_insert(StructTable *table,
+                    guint        hash,
+                    CoilPath    *path, /* steals */
+                    GValue      *value) /* steals */
+{
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(path), NULL);
+
+  StructEntry *entry;
+  guint        idx;
+
+  idx = find_slot(table, hash, path->path, path->path_len);
+
+  if (idx != NO_SLOT)
+  {
+    entry = pool_entry(table, table->slot[idx]);
+    clear_entry(table, entry);
+  }
+  else
+  {
+    entry = alloc_entry(table);
+    entry->hash = hash;
+    occupy_slot(table, find_free_slot(table, hash), entry);
+  }
+
+  entry->path = path;
+  struct_entry_set_value(table, entry, value);
+  entry_update_key(entry);
+  table->version++;
+
+  struct_table_calibrate(table);
+
+  return entry;
+}
+
+void
+struct_table_insert_entry(StructTable *table,
+                          StructEntry *entry)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(entry);
+  g_return_if_fail(entry->hash);
+  g_return_if_fail(entry->path);
+
+  guint idx;
+
+  idx = find_slot(table,
+                  entry->hash,
+                  entry->path->path,
+                  entry->path->path_len);
+
+  entry->next = STRUCT_ENTRY_NONE;
+  entry_update_key(entry);
+  table->version++;
+
+  if (idx != NO_SLOT)
+  {
+    /* takes the place of the entry of the same path */
+    StructEntry *old = pool_entry(table, table->slot[idx]);
+
+    table->slot[idx] = pool_index(entry);
+
+    if (old != entry)
+      destroy_entry(table, old);
+  }
+  else
+  {
+    occupy_slot(table, find_free_slot(table, entry->hash), entry);
+    struct_table_calibrate(table);
+  }
+}
+
+StructEntry *
+struct_table_lookup(StructTable *table,
+                    guint        hash,
+                    const gchar *path,
+                    guint        path_len)
+{
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(*path == '@', NULL);
+  g_return_val_if_fail(path_len > 0, NULL);
+
+  guint idx;
+
+  idx = find_slot(table, hash, path, path_len);
+
+  return (idx != NO_SLOT) ? pool_entry(table, table->slot[idx]) : NULL;
+}
+
+StructEntry *
+struct_table_remove(StructTable *table,
+                    guint        hash,
+                    const gchar *path,
+                    guint        path_len)
+{
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(path, NULL);
+  g_return_val_if_fail(*path == '@', NULL);
+  g_return_val_if_fail(path_len > 0, NULL);
+
+  guint idx;
+
+  idx = find_slot(table, hash, path, path_len);
+  table->version++;
+
+  return vacate_slot(table, idx);
+}
+
+StructEntry *
+struct_table_remove_entry(StructTable *table,
+                          StructEntry *entry)
+{
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(entry, NULL);
+
+  guint idx;
+
+  idx = find_slot_with_entry(table, entry);
+  table->version++;
+
+  return vacate_slot(table, idx);
+}
+
+static gsize
+index_get_memory(const StructTable *table)
+{
+  return (table->max + 1) * (sizeof(guint8) + sizeof(guint32));
+}
+
+static void
+index_get_stats(const StructTable *table,
+                StructTableStats  *stats)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(stats);
+
+  guint n;
+
+  stats->buckets = table->max + 1;
+  stats->deleted = table->deleted;
+
+  for (n = 0; n <= table->max; n++)
+  {
+    guint mixed, pos, step;
+
+    if (!CTRL_IS_FULL(table->ctrl[n]))
+      continue;
+
+    /* groups probed before reaching the group of slot n */
+    mixed = mix_hash(pool_entry(table, table->slot[n])->hash);
+
+    for (pos = PROBE_START(table, mixed), step = 1;
+         pos != (n & ~GROUP_MASK);
+         pos = PROBE_NEXT(table, pos, step), step++);
+
+    stats->chains[MIN(step, STRUCT_TABLE_CHAIN_HISTOGRAM)]++;
+    stats->max_chain = MAX(stats->max_chain, step);
+  }
+}
+
+void
+struct_table_destroy(StructTable *table)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(table->ref_count <= 1);
+
+  pool_destroy(table);
+
+  g_free(table->ctrl);
+  g_free(table->slot);
+  g_free(table);
+}
+
+#else /* chained */
+
+/*
+ * Growing or shrinking does not move every entry at once. The previous
+ * bucket array is kept in old_bucket and each insert or remove
+ * migrates a few of its buckets into the new array, starting from
+ * bucket 0. Buckets below migrate_pos have been moved, the rest are
+ * still searched in the old array until the migration finishes.
+ * Lookups only search, so readers never modify the table.
+ */
+
+/* buckets migrated per insert or remove */
+#define MIGRATE_STEP 4
+
+/* empty buckets skipped per operation before giving up on this step */
+#define MIGRATE_EMPTY_VISITS (MIGRATE_STEP * 8)
+
+#define TABLE_IS_MIGRATING(table) ((table)->old_bucket != NULL)
+
+/* old bucket for hash has not been moved to the new array yet */
+#define OLD_BUCKET_PENDING(table, hash) \
+  (TABLE_IS_MIGRATING(table) \
+   && ((hash) & (table)->old_max) >= (table)->migrate_pos)
+
+static guint32 *
+alloc_buckets(guint max)
+{
+  guint32 *bucket = g_new(guint32, max + 1);
+
+  /* STRUCT_ENTRY_NONE in every bucket */
+  memset(bucket, 0xFF, (max + 1) * sizeof(guint32));
+
+  return bucket;
+}
+
+StructTable *
+struct_table_new_sized(gsize size)
+{
+  g_return_val_if_fail(size > 0, NULL);
+
+  StructTable *table;
+
+  table = g_new(StructTable, 1);
+  table->max = compute_real_max(size); /* max always (2^n)-1 */
+  table->bucket = alloc_buckets(table->max);
+  table->old_bucket = NULL;
+  table->old_max = 0;
+  table->migrate_pos = 0;
+  table->ref_count = 1;
+  table->size = 0;
+  table->rehashes = table->grows = table->shrinks = 0;
+  table->version = 0;
+  table->reserved = 0;
+  pool_init(table);
+
+  return table;
+}
+
+static void
+migrate_bucket(StructTable *table,
+               guint        n)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(TABLE_IS_MIGRATING(table));
+  g_return_if_fail(n <= table->old_max);
+
+  guint32 link, next;
+
+  for (link = table->old_bucket[n];
+       link != STRUCT_ENTRY_NONE; link = next)
+  {
+    StructEntry *entry = pool_entry(table, link);
+    guint        idx = entry->hash & table->max;
+
+    next = entry->next;
+    entry->next = table->bucket[idx];
+    table->bucket[idx] = link;
+  }
+
+  table->old_bucket[n] = STRUCT_ENTRY_NONE;
+}
+
+static void
+finish_migration(StructTable *table)
+{
+  g_return_if_fail(table);
+
+  g_free(table->old_bucket);
+  table->old_bucket = NULL;
+  table->old_max = 0;
+  table->migrate_pos = 0;
+}
+
+/**
+ * Move up to MIGRATE_STEP non-empty buckets from the old bucket array.
+ *
+ * Moves everything that is left when @all is TRUE.
+ */
+static void
+struct_table_migrate(StructTable *table,
+                     gboolean     all)
+{
+  g_return_if_fail(table);
+
+  guint moved = 0, visits = 0;
+
+  if (!TABLE_IS_MIGRATING(table))
+    return;
+
+  while (table->migrate_pos <= table->old_max)
+  {
+    guint n = table->migrate_pos;
+
+    if (!all)
+    {
+      if (table->old_bucket[n] == STRUCT_ENTRY_NONE)
+      {
+        if (++visits > MIGRATE_EMPTY_VISITS)
+          return;
+      }
+      else if (++moved > MIGRATE_STEP)
+        return;
+    }
+
+    migrate_bucket(table, n);
+    table->migrate_pos++;
+  }
+
+  finish_migration(table);
+}
+
+static void
+struct_table_rehash(StructTable *table,
+                    guint        max)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(max > 0);
+  g_return_if_fail(max == compute_real_max(max));
+
+  if (table->max == max)
+    return;
+
+  /* only one migration at a time */
+  struct_table_migrate(table, TRUE);
+  count_rehash(table, max);
 
-  return table->size;
+  table->old_bucket = table->bucket;
+  table->old_max = table->max;
+  table->migrate_pos = 0;
+
+  table->bucket = alloc_buckets(max);
+  table->max = max;
+
+  if (table->size == 0)
+    finish_migration(table);
 }
 
 void
@@ -166,6 +1628,31 @@ struct_table_resize(StructTable *table,
   struct_table_rehash(table, max);
 }
 
+/*
+ * Room for @n more entries without growing. The table does not shrink
+ * below it until struct_table_release() is called with the reservation
+ * returned, when the operation adding the entries is done.
+ */
+guint
+struct_table_reserve(StructTable *table,
+                     guint        n)
+{
+  g_return_val_if_fail(table, 0);
+
+  guint size = table->size + n;
+  guint previous = table->reserved;
+
+  if (n == 0)
+    return previous;
+
+  if (size > table->max)
+    struct_table_resize(table, size);
+
+  table->reserved = MAX(previous, size);
+
+  return previous;
+}
+
 /** grow by factor of 2 */
 static void
 struct_table_grow(StructTable *table)
@@ -191,94 +1678,85 @@ struct_table_shrink(StructTable *table)
   struct_table_rehash(table, max);
 }
 
-static StructEntry *
-alloc_entry(StructTable *table)
-{
-  g_return_val_if_fail(table, NULL);
-
-  StructEntry *entry;
-
-  entry = g_slice_new(StructEntry);
-  entry->next = NULL;
-
-  return entry;
-}
-
-static void
-clear_entry(StructEntry *entry)
+static guint32 *
+find_chain_link(const StructTable *table,
+                guint32           *link,
+                guint              hash,
+                const gchar       *path,
+                guint              path_len)
 {
-  g_return_if_fail(entry);
-
-  if (G_LIKELY(entry->path))
+  for (; *link != STRUCT_ENTRY_NONE; link = &pool_entry(table, *link)->next)
   {
-    coil_path_unref(entry->path);
-    entry->path = NULL;
-  }
+    const StructEntry *entry = pool_entry(table, *link);
 
-  if (entry->value)
-  {
-    coil_value_free(entry->value);
-    entry->value = NULL;
+    if (entry_matches(entry, hash, path, path_len))
+      break;
   }
 
-  entry->next = NULL;
-}
-
-static void
-destroy_entry(StructEntry *entry)
-{
-  g_return_if_fail(entry);
-
-  clear_entry(entry);
-  g_slice_free(StructEntry, entry);
+  return link;
 }
 
-static StructEntry **
+/**
+ * Find the link holding the index of the entry matching @path.
+ *
+ * If there is no such entry the returned link is the end of the chain in
+ * the current bucket array, where a new entry should be added.
+ */
+static guint32 *
 find_bucket(StructTable  *table,
             guint         hash,
             const gchar  *path,
-            guint8        path_len)
+            guint         path_len)
 {
   g_return_val_if_fail(table, NULL);
   g_return_val_if_fail(path, NULL);
   g_return_val_if_fail(*path == '@', NULL);
   g_return_val_if_fail(path_len > 0, NULL);
 
-  StructEntry *entry, **bucket;
-  guint        idx = hash & table->max;
+  guint32 *link, *old;
 
-  for (bucket = &table->bucket[idx], entry = *bucket;
-       entry; bucket = &entry->next, entry = *bucket)
-  {
-    const CoilPath *p = entry->path;
+  link = find_chain_link(table, &table->bucket[hash & table->max],
+                         hash, path, path_len);
 
-    if (entry->hash == hash
-      && p->path_len == path_len
-      && memcmp(p->path, path, path_len) == 0)
-        break;
+  if (*link == STRUCT_ENTRY_NONE && OLD_BUCKET_PENDING(table, hash))
+  {
+    old = find_chain_link(table, &table->old_bucket[hash & table->old_max],
+                          hash, path, path_len);
+    if (*old != STRUCT_ENTRY_NONE)
+      return old;
   }
 
-  return bucket;
+  return link;
+}
+
+static guint32 *
+find_entry_link(const StructTable *table,
+                guint32           *link,
+                guint32            entry_idx)
+{
+  while (*link != STRUCT_ENTRY_NONE && *link != entry_idx)
+    link = &pool_entry(table, *link)->next;
+
+  return link;
 }
 
-static StructEntry **
+static guint32 *
 find_bucket_with_entry(StructTable *table,
                        StructEntry *entry)
 {
   g_return_val_if_fail(table, NULL);
   g_return_val_if_fail(entry, NULL);
 
-  StructEntry *e, **bucket;
-  guint        idx = entry->hash & table->max;
+  guint32 *link, idx = pool_index(entry);
 
-  for (bucket = &table->bucket[idx], e = *bucket;
-       e; bucket = &e->next, e = *bucket)
-  {
-    if (e == entry)
-      break;
-  }
+  link = find_entry_link(table, &table->bucket[entry->hash & table->max], idx);
 
-  return bucket;
+  if (*link == STRUCT_ENTRY_NONE && OLD_BUCKET_PENDING(table, entry->hash))
+    link = find_entry_link(table,
+                           &table->old_bucket[entry->hash & table->old_max],
+                           idx);
+
+  return link;
 }
 
 static void
@@ -286,13 +1764,29 @@ struct_table_calibrate(StructTable *table)
 {
   g_return_if_fail(table);
 
+  /* let a running migration finish before resizing again */
+  if (TABLE_IS_MIGRATING(table))
+    return;
+
   if (table->size > table->max)
     struct_table_grow(table);
   else if (table->size <= table->max >> 1
-      && table->size > DEFAULT_MAX)
+      && table->size > DEFAULT_MAX
+      && table->reserved == 0)
     struct_table_shrink(table);
 }
 
+/* end the reservation made by struct_table_reserve() */
+void
+struct_table_release(StructTable *table,
+                     guint        previous)
+{
+  g_return_if_fail(table);
+
+  table->reserved = previous;
+  struct_table_calibrate(table);
+}
+
 
 StructEntry *
 struct_table_insert(StructTable *table,
@@ -304,21 +1798,30 @@ struct_table_insert(StructTable *table,
   g_return_val_if_fail(path, NULL);
   g_return_val_if_fail(COIL_PATH_IS_ABSOLUTE(path), NULL);
 
-  StructEntry *entry, **bucket;
+  StructEntry *entry;
+  guint32     *link;
 
-  bucket = find_bucket(table, hash, path->path, path->path_len);
+  struct_table_migrate(table, FALSE);
+  link = find_bucket(table, hash, path->path, path->path_len);
 
-  if (*bucket == NULL)
-    *bucket = alloc_entry(table);
+  if (*link == STRUCT_ENTRY_NONE)
+  {
+    entry = alloc_entry(table);
+    *link = pool_index(entry);
+    table->size++;
+  }
   else
-    clear_entry(*bucket);
+  {
+    entry = pool_entry(table, *link);
+    clear_entry(table, entry);
+  }
 
-  entry = *bucket;
   entry->hash = hash;
   entry->path = path;
-  entry->value = value;
+  struct_entry_set_value(table, entry, value);
+  entry_update_key(entry);
+  table->version++;
 
-  table->size++;
   struct_table_calibrate(table);
 
   return entry;
@@ -333,47 +1836,71 @@ struct_table_insert_entry(StructTable *table,
   g_return_if_fail(entry->hash);
   g_return_if_fail(entry->path);
 
-  StructEntry **bucket;
+  guint32 *link;
 
-  bucket = find_bucket(table,
-                       entry->hash,
-                       entry->path->path,
-                       entry->path->path_len);
+  struct_table_migrate(table, FALSE);
+  link = find_bucket(table,
+                     entry->hash,
+                     entry->path->path,
+                     entry->path->path_len);
 
-  entry->next = NULL;
-  *bucket = entry;
+  entry_update_key(entry);
+  table->version++;
 
-  table->size++;
+  if (*link != STRUCT_ENTRY_NONE)
+  {
+    /* takes the place of the entry of the same path, keeping the rest
+     * of the chain behind it */
+    StructEntry *old = pool_entry(table, *link);
+
+    if (old == entry)
+      return;
+
+    entry->next = old->next;
+    *link = pool_index(entry);
+    destroy_entry(table, old);
+  }
+  else
+  {
+    entry->next = STRUCT_ENTRY_NONE;
+    *link = pool_index(entry);
+    table->size++;
+  }
 }
 
 StructEntry *
 struct_table_lookup(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len)
+                    guint        path_len)
 {
   g_return_val_if_fail(table, NULL);
   g_return_val_if_fail(path, NULL);
   g_return_val_if_fail(*path == '@', NULL);
   g_return_val_if_fail(path_len > 0, NULL);
 
-  return *find_bucket(table, hash, path, path_len);
+  guint32 *link;
+
+  link = find_bucket(table, hash, path, path_len);
+
+  return LINK_ENTRY(table, *link);
 }
 
 static StructEntry *
-remove_bucket_entry(StructTable  *table,
-                    StructEntry **bucket)
+remove_bucket_entry(StructTable *table,
+                    guint32     *link)
 {
   g_return_val_if_fail(table, NULL);
-  g_return_val_if_fail(bucket, NULL);
+  g_return_val_if_fail(link, NULL);
 
-  StructEntry *entry = *bucket;
+  StructEntry *entry = LINK_ENTRY(table, *link);
 
   if (entry)
   {
-    *bucket = entry->next;
-    entry->next = NULL;
+    *link = entry->next;
+    entry->next = STRUCT_ENTRY_NONE;
     table->size--;
+    table->version++;
 
     return entry;
   }
@@ -385,18 +1912,19 @@ StructEntry *
 struct_table_remove(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len)
+                    guint        path_len)
 {
   g_return_val_if_fail(table, NULL);
   g_return_val_if_fail(path, NULL);
   g_return_val_if_fail(*path == '@', NULL);
   g_return_val_if_fail(path_len > 0, NULL);
 
-  StructEntry **bucket;
+  guint32 *link;
 
-  bucket = find_bucket(table, hash, path, path_len);
+  struct_table_migrate(table, FALSE);
+  link = find_bucket(table, hash, path, path_len);
 
-  return remove_bucket_entry(table, bucket);
+  return remove_bucket_entry(table, link);
 }
 
 
@@ -407,18 +1935,216 @@ struct_table_remove_entry(StructTable *table,
   g_return_val_if_fail(table, NULL);
   g_return_val_if_fail(entry, NULL);
 
-  StructEntry **bucket;
+  guint32 *link;
+
+  struct_table_migrate(table, FALSE);
+  link = find_bucket_with_entry(table, entry);
+
+  return remove_bucket_entry(table, link);
+}
+
+static gsize
+index_get_memory(const StructTable *table)
+{
+  gsize size = (table->max + 1) * sizeof(guint32);
+
+  if (TABLE_IS_MIGRATING(table))
+    size += (table->old_max + 1) * sizeof(guint32);
+
+  return size;
+}
+
+static guint
+chain_length(const StructTable *table,
+             guint32            link)
+{
+  guint n = 0;
+
+  for (; link != STRUCT_ENTRY_NONE; link = pool_entry(table, link)->next)
+    n++;
+
+  return n;
+}
+
+static void
+index_get_stats(const StructTable *table,
+                StructTableStats  *stats)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(stats);
+
+  guint n, len;
+
+  stats->buckets = table->max + 1;
+
+  for (n = 0; n <= table->max; n++)
+  {
+    len = chain_length(table, table->bucket[n]);
+    stats->chains[MIN(len, STRUCT_TABLE_CHAIN_HISTOGRAM)]++;
+    stats->max_chain = MAX(stats->max_chain, len);
+  }
+
+  /* old buckets still waiting to be migrated count as chains too */
+  if (TABLE_IS_MIGRATING(table))
+    for (n = table->migrate_pos; n <= table->old_max; n++)
+    {
+      len = chain_length(table, table->old_bucket[n]);
+      if (len == 0)
+        continue;
+
+      stats->chains[MIN(len, STRUCT_TABLE_CHAIN_HISTOGRAM)]++;
+      stats->max_chain = MAX(stats->max_chain, len);
+    }
+}
+
+void
+struct_table_destroy(StructTable *table)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(table->ref_count <= 1);
+
+  pool_destroy(table);
+
+  g_free(table->old_bucket);
+  g_free(table->bucket);
+  g_free(table);
+}
+
+#endif
+
+StructTable *
+struct_table_new(void)
+{
+  return struct_table_new_sized(DEFAULT_MAX);
+}
+
+guint
+struct_table_get_size(const StructTable *table)
+{
+  g_return_val_if_fail(table, 0);
+
+  return table->size;
+}
+
+/**
+ * Counter that changes whenever an entry of @table is added, removed or
+ * given a new value. Equal versions mean lookups still find the same
+ * entries.
+ */
+guint
+struct_table_get_version(const StructTable *table)
+{
+  g_return_val_if_fail(table, 0);
+
+  return table->version;
+}
+
+/**
+ * Record a change made to an entry in place, such as a new value.
+ */
+void
+struct_table_touch(StructTable *table)
+{
+  g_return_if_fail(table);
+
+  table->version++;
+}
+
+/**
+ * Bytes held by @table for its entries and index, not counting the
+ * paths and values the entries point to.
+ */
+gsize
+struct_table_get_memory(const StructTable *table)
+{
+  g_return_val_if_fail(table, 0);
+
+  return sizeof(*table) + pool_get_memory(table) + index_get_memory(table);
+}
+
+/**
+ * Fill @stats with the size, chain lengths and resize counts of @table.
+ */
+void
+struct_table_get_stats(const StructTable *table,
+                       StructTableStats  *stats)
+{
+  g_return_if_fail(table);
+  g_return_if_fail(stats);
+
+  memset(stats, 0, sizeof(*stats));
+
+  stats->size = table->size;
+  stats->rehashes = table->rehashes;
+  stats->grows = table->grows;
+  stats->shrinks = table->shrinks;
+  stats->memory = struct_table_get_memory(table);
+
+#if COIL_REGION_ALLOC
+  if (table->region)
+  {
+    CoilRegionStats region_stats;
+
+    coil_region_get_stats(table->region, &region_stats);
+    stats->region = region_stats.memory;
+  }
+#endif
+
+  index_get_stats(table, stats);
+}
+
+/**
+ * Return the region owned by @table, created on first use, or NULL when
+ * coil is built without region allocation.
+ *
+ * Values allocated from the region may only be stored in entries of
+ * @table. They are released in bulk when the table is destroyed.
+ */
+CoilRegion *
+struct_table_get_region(StructTable *table)
+{
+  g_return_val_if_fail(table, NULL);
+
+#if COIL_REGION_ALLOC
+  if (table->region == NULL)
+    table->region = coil_region_new();
+
+  return table->region;
+#else
+  return NULL;
+#endif
+}
+
+/* free a value that was not stored, it may be from the region of @table */
+void
+struct_table_free_value(const StructTable *table,
+                        GValue            *value)
+{
+  g_return_if_fail(table);
+
+#if COIL_REGION_ALLOC
+  coil_value_free_in(table->region, value);
+#else
+  coil_value_free(value);
+#endif
+}
 
-  bucket = find_bucket_with_entry(table, entry);
+StructEntry *
+struct_table_get_entry(const StructTable *table,
+                       guint32            idx)
+{
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(idx == STRUCT_ENTRY_NONE || idx < table->pool_len,
+                       NULL);
 
-  return remove_bucket_entry(table, bucket);
+  return LINK_ENTRY(table, idx);
 }
 
 void
 struct_table_delete(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len)
+                    guint        path_len)
 {
   g_return_if_fail(table);
   g_return_if_fail(path);
@@ -429,7 +2155,7 @@ struct_table_delete(StructTable *table,
 
   entry = struct_table_remove(table, hash, path, path_len);
 
-  destroy_entry(entry);
+  destroy_entry(table, entry);
 }
 
 void
@@ -441,32 +2167,125 @@ struct_table_delete_entry(StructTable *table,
 
   struct_table_remove_entry(table, entry);
 
-  destroy_entry(entry);
+  destroy_entry(table, entry);
 }
 
-void
-struct_table_destroy(StructTable *table)
+/**
+ * Remove @entry from @table and return it as an entry of @dest.
+ *
+ * Entries belong to the pool of their table so the entry is copied when
+ * the tables differ. The returned entry is not in @dest yet, update its
+ * path and hash and add it with struct_table_insert_entry().
+ */
+StructEntry *
+struct_table_move_entry(StructTable *table,
+                        StructTable *dest,
+                        StructEntry *entry)
 {
-  g_return_if_fail(table);
-  g_return_if_fail(table->ref_count <= 1);
+  g_return_val_if_fail(table, NULL);
+  g_return_val_if_fail(dest, NULL);
+  g_return_val_if_fail(entry, NULL);
+
+  StructEntry *copy;
+
+  struct_table_remove_entry(table, entry);
+
+  if (table == dest)
+    return entry;
+
+  copy = alloc_entry(dest);
+  copy->hash = entry->hash;
+  copy->path = entry->path;
+  copy->kind = entry->kind;
+  copy->inherited = entry->inherited;
+  memcpy(&copy->value, &entry->value, sizeof(GValue));
+
+  copy->path_len = entry->path_len;
+  memcpy(copy->path_tail, entry->path_tail, STRUCT_ENTRY_TAIL_LEN);
 
-  guint             n;
-  StructEntry **bucket, *entry, *next;
+  release_entry(table, entry);
 
-  /* clear entries in all buckets */
-  if (table->size > 0)
-    for (n = table->max, bucket = &table->bucket[n];
-         n-- > 0; bucket = &table->bucket[n])
+  return copy;
+}
+
+/* drop the tombstones of vector, keeping the order of entries */
+static void
+entry_vector_compact(StructEntryVector *vector)
+{
+  guint32 i, n = 0;
+
+  for (i = 0; i < vector->len; i++)
+  {
+    StructEntry *entry = vector->items[i];
+
+    if (entry)
     {
-      for (entry = *bucket; entry; entry = next)
-      {
-        next = entry->next;
-        destroy_entry(entry);
-      }
+      entry->order = n;
+      vector->items[n++] = entry;
     }
+  }
 
-  g_free(table->bucket);
-  g_free(table);
+  vector->len = n;
+  vector->deleted = 0;
+}
+
+void
+struct_entry_vector_append(StructEntryVector *vector,
+                           StructEntry       *entry)
+{
+  g_return_if_fail(vector);
+  g_return_if_fail(entry);
+
+  if (G_UNLIKELY(vector->len == vector->size))
+  {
+    /* reuse the space of tombstones before growing */
+    if (vector->deleted > 0 && vector->deleted >= vector->len / 4)
+      entry_vector_compact(vector);
+    else
+    {
+      if (G_UNLIKELY(vector->size >= STRUCT_ENTRY_NONE / 2))
+        g_error("%s: too many entries", G_STRLOC);
+
+      vector->size = MAX(vector->size * 2, 8);
+      vector->items = g_renew(StructEntry *, vector->items, vector->size);
+    }
+  }
+
+  entry->order = vector->len;
+  vector->items[vector->len++] = entry;
+}
+
+void
+struct_entry_vector_remove(StructEntryVector *vector,
+                           StructEntry       *entry)
+{
+  g_return_if_fail(vector);
+  g_return_if_fail(entry);
+
+  if (entry->order >= vector->len || vector->items[entry->order] != entry)
+    return; /* not in vector */
+
+  vector->items[entry->order] = NULL;
+  vector->deleted++;
+  entry->order = STRUCT_ENTRY_NONE;
+
+  /* tombstones at the end are free to drop */
+  while (vector->len > 0 && vector->items[vector->len - 1] == NULL)
+  {
+    vector->len--;
+    vector->deleted--;
+  }
+}
+
+void
+struct_entry_vector_clear(StructEntryVector *vector)
+{
+  g_return_if_fail(vector);
+
+  const StructEntryVector empty = STRUCT_ENTRY_VECTOR_INIT;
+
+  g_free(vector->items);
+  *vector = empty;
 }
 
 void
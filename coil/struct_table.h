@@ -8,40 +8,156 @@
 #define __COIL_STRUCT_PRIVATE
 
 #include "path.h"
+#include "region.h"
 
 typedef struct _StructEntry StructEntry;
+typedef struct _StructEntryVector StructEntryVector;
 typedef struct _StructTable StructTable;
+typedef struct _StructTableStats StructTableStats;
 
-struct _StructTable
-{
-  guint         max;
-  guint         size;
+/* entries are linked by index in the entry pool of their table */
+#define STRUCT_ENTRY_NONE G_MAXUINT32
 
-  volatile gint ref_count;
+#define STRUCT_ENTRY_TAIL_LEN 6
 
-  StructEntry **bucket;
-};
+/* what an entry holds, decided once when the value is stored */
+typedef enum
+{
+  STRUCT_VALUE_EMPTY,       /* no value, the key is marked deleted */
+  STRUCT_VALUE_SCALAR,      /* anything that is not expandable */
+  STRUCT_VALUE_STRUCT,
+  STRUCT_VALUE_EXPANDABLE,  /* links, expressions and includes */
+} StructValueKind;
 
 struct _StructEntry
 {
   guint        hash;
-  CoilPath    *path;
-  GValue      *value;
 
   /* next in bucket */
-  StructEntry *next;
+  guint32      next;
+
+  CoilPath    *path;
+
+  /* slot in the entry vector of the containing struct */
+  guint32      order;
+
+  /* copied from path so candidates are rejected without loading it */
+  guint16      path_len;
+  guint8       kind;
+
+  /* copied from a parent of the struct, not set in the struct itself */
+  guint8       inherited;
+
+  gchar        path_tail[STRUCT_ENTRY_TAIL_LEN];
+
+  /* valid unless kind is STRUCT_VALUE_EMPTY, see STRUCT_ENTRY_VALUE */
+  GValue       value;
+};
+
+/* the value held by entry or NULL */
+#define STRUCT_ENTRY_VALUE(entry)                                   \
+  ((entry)->kind != STRUCT_VALUE_EMPTY ? &(entry)->value : NULL)
+
+/* structs and other expandables, which may need expansion before use */
+#define STRUCT_ENTRY_IS_EXPANDABLE(entry)                           \
+  ((entry)->kind >= STRUCT_VALUE_STRUCT)
+
+/*
+ * Entries of a struct in insertion order. A removed entry leaves a NULL
+ * tombstone so the position of an iterator is not disturbed, tombstones
+ * are dropped when the vector would otherwise have to grow.
+ */
+struct _StructEntryVector
+{
+  StructEntry **items;
+  guint32       len;     /* slots in use, tombstones included */
+  guint32       size;
+  guint32       deleted; /* tombstones */
+};
+
+#define STRUCT_ENTRY_VECTOR_INIT { NULL, 0, 0, 0 }
+
+/* last histogram bucket counts everything at least this long */
+#define STRUCT_TABLE_CHAIN_HISTOGRAM 8
+
+struct _StructTableStats
+{
+  guint   size;
+  guint   buckets;
+  guint   deleted; /* tombstones, open addressing only */
+
+  /*
+   * chained: number of buckets holding n entries
+   * open addressing: number of entries found after probing n groups
+   */
+  guint   chains[STRUCT_TABLE_CHAIN_HISTOGRAM + 1];
+  guint   max_chain;
+
+  guint   rehashes;
+  guint   grows;
+  guint   shrinks;
+
+  gsize   memory;
+  gsize   region; /* held by the region of the table, if any */
 };
 
+/* prefixes kept in a PathScan before it allocates */
+#define PATH_SCAN_INLINE 16
+
+typedef enum
+{
+  PATH_SCAN_HASH     = 1 << 0,
+  PATH_SCAN_PREFIXES = 1 << 1, /* implies PATH_SCAN_HASH */
+  PATH_SCAN_VALIDATE = 1 << 2,
+} PathScanFlags;
+
+typedef struct _PathScan
+{
+  guint     n_keys;         /* keys after @root or the container */
+  guint     key_offset;     /* offset of the last key */
+  guint     hash;
+  guint     container_hash; /* hash of the path without the last key */
+  gboolean  valid;          /* with PATH_SCAN_VALIDATE only */
+
+  /*
+   * with PATH_SCAN_PREFIXES, hash and length of the prefixes of the
+   * path, index 0 is @root or the container and n_keys the whole path
+   */
+  guint    *hashes;
+  guint    *lens;
+  guint     size;
+
+  guint     inline_hashes[PATH_SCAN_INLINE];
+  guint     inline_lens[PATH_SCAN_INLINE];
+} PathScan;
+
 G_BEGIN_DECLS
 
+void
+hash_path_seed_init(void);
+
+void
+path_scan(PathScan      *scan,
+          guint          container_hash,
+          const gchar   *path,
+          guint          path_len,
+          PathScanFlags  flags);
+
+gboolean
+path_scan_key(const gchar *key,
+              guint        key_len);
+
+void
+path_scan_clear(PathScan *scan);
+
 guint
 hash_relative_path(guint        container_hash,
                    const gchar *path,
-                   guint8       path_len);
+                   guint        path_len);
 
 guint
 hash_absolute_path(const gchar *path,
-                   guint8       path_len);
+                   guint        path_len);
 
 StructTable *
 struct_table_new_sized(gsize size);
@@ -52,10 +168,42 @@ struct_table_new(void);
 guint
 struct_table_get_size(const StructTable *table);
 
+gsize
+struct_table_get_memory(const StructTable *table);
+
+guint
+struct_table_get_version(const StructTable *table);
+
+void
+struct_table_touch(StructTable *table);
+
+void
+struct_table_get_stats(const StructTable *table,
+                       StructTableStats  *stats);
+
+CoilRegion *
+struct_table_get_region(StructTable *table);
+
+void
+struct_table_free_value(const StructTable *table,
+                        GValue            *value);
+
+StructEntry *
+struct_table_get_entry(const StructTable *table,
+                       guint32            idx);
+
 void
 struct_table_resize(StructTable *table,
                     guint        size);
 
+guint
+struct_table_reserve(StructTable *table,
+                     guint        n);
+
+void
+struct_table_release(StructTable *table,
+                     guint        previous);
+
 StructEntry *
 struct_table_insert(StructTable *table,
                     guint        hash,
@@ -67,25 +215,30 @@ void
 struct_table_insert_entry(StructTable *table,
                           StructEntry *entry);
 
+void
+struct_entry_set_value(const StructTable *table,
+                       StructEntry       *entry,
+                       GValue            *value);
+
 
 StructEntry *
 struct_table_lookup(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len);
+                    guint        path_len);
 
 gboolean
 struct_table_lookup_full(StructTable  *table,
                          guint         hash,
                          const gchar  *path,
-                         guint8        path_len,
+                         guint         path_len,
                          StructEntry **entry);
 
 StructEntry *
 struct_table_remove(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len);
+                    guint        path_len);
 
 StructEntry *
 struct_table_remove_entry(StructTable *table,
@@ -95,12 +248,28 @@ void
 struct_table_delete(StructTable *table,
                     guint        hash,
                     const gchar *path,
-                    guint8       path_len);
+                    guint        path_len);
 
 void
 struct_table_delete_entry(StructTable *table,
                           StructEntry *entry);
 
+StructEntry *
+struct_table_move_entry(StructTable *table,
+                        StructTable *dest,
+                        StructEntry *entry);
+
+void
+struct_entry_vector_append(StructEntryVector *vector,
+                           StructEntry       *entry);
+
+void
+struct_entry_vector_remove(StructEntryVector *vector,
+                           StructEntry       *entry);
+
+void
+struct_entry_vector_clear(StructEntryVector *vector);
+
 void
 struct_table_destroy(StructTable *table);
 
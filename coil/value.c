@@ -48,6 +48,16 @@ coil_value_alloc(void)
   return g_slice_new0(GValue);
 }
 
+/* allocate from region if not NULL, see struct_table_get_region */
+GValue *
+coil_value_alloc_in(CoilRegion *region)
+{
+  if (region == NULL)
+    return coil_value_alloc();
+
+  return coil_region_alloc0(region, sizeof(GValue));
+}
+
 inline GValue *
 coil_value_copy(const GValue *value)
 {
@@ -93,6 +103,25 @@ coil_value_free(gpointer value)
   g_slice_free(GValue, value);
 }
 
+/* free a value which may have been allocated from region */
+void
+coil_value_free_in(CoilRegion *region,
+                   gpointer    value)
+{
+  if (value == NULL)
+    return;
+
+  g_return_if_fail(G_IS_VALUE(value));
+
+  /* released with the region */
+  if (region && coil_region_contains(region, value))
+  {
+    g_value_unset((GValue *)value);
+    return;
+  }
+
+  coil_value_free(value);
+}
 
 void
 coil_value_list_free(GList *list)
@@ -104,6 +133,17 @@ coil_value_list_free(GList *list)
   }
 }
 
+void
+coil_value_list_free_in(CoilRegion *region,
+                        GList      *list)
+{
+  while (list)
+  {
+    coil_value_free_in(region, list->data);
+    list = g_list_delete_link(list, list);
+  }
+}
+
 inline void
 free_string_list(GList *list)
 {
@@ -192,7 +232,9 @@ coil_value_build_string(const GValue     *value,
   g_return_if_fail(format);
   g_return_if_fail(error == NULL || *error == NULL);
 
+  /* fundamental types are never expandable, skip the type check */
   if (format->options & FORCE_EXPAND
+    && !G_TYPE_IS_FUNDAMENTAL(G_VALUE_TYPE(value))
     && G_VALUE_HOLDS(value, COIL_TYPE_EXPANDABLE)
     && !coil_expand_value(value, &value, TRUE, error))
       return;
@@ -201,6 +243,23 @@ coil_value_build_string(const GValue     *value,
 
   if (G_TYPE_IS_FUNDAMENTAL(type))
   {
+    /* same output as transforming to a string, without the copy */
+    gchar number[64];
+    gint  length = -1;
+
+    if (type == G_TYPE_LONG)
+      length = g_snprintf(number, sizeof(number), "%ld",
+                          g_value_get_long(value));
+    else if (type == G_TYPE_DOUBLE && ABS(g_value_get_double(value)) < 1e40)
+      length = strlen(g_ascii_formatd(number, sizeof(number), "%f",
+                                      g_value_get_double(value)));
+
+    if (length >= 0 && length < (gint)sizeof(number))
+    {
+      g_string_append_len(buffer, number, length);
+      return;
+    }
+
     if (type == G_TYPE_BOOLEAN)
     {
       if (g_value_get_boolean(value))
@@ -226,6 +285,12 @@ coil_value_build_string(const GValue     *value,
     goto transform;
   }
 
+  if (type == COIL_TYPE_NONE)
+  {
+    g_string_append_len(buffer, COIL_STATIC_STRLEN("None"));
+    return;
+  }
+
   if (g_type_is_a(type, COIL_TYPE_EXPANDABLE))
   {
     CoilExpandable *object;
@@ -325,10 +390,12 @@ _compare_value_list(const GValue *v1,
 
   n = x->n_values;
   while (n-- > 0) {
+      gint result;
+
       v1 = g_value_array_get_nth(x, n);
       v2 = g_value_array_get_nth(y, n);
-      if (coil_value_compare(v1, v2, error))
-          break;
+      if ((result = coil_value_compare(v1, v2, error)))
+          return result;
   }
 
   return 0;
@@ -558,6 +625,32 @@ value_compare_as_string(const GValue  *v1,
     s2 = g_value_get_string(v2);
     result = strcmp(s1, s2);
   }
+  else if ((t1 == G_TYPE_GSTRING
+      && g_value_type_transformable(t2, G_TYPE_STRING))
+    || (t2 == G_TYPE_GSTRING
+      && g_value_type_transformable(t1, G_TYPE_STRING)))
+  {
+    GValue s1 = {0, }, s2 = {0, };
+
+    /* compared as the string it holds, like G_TYPE_STRING above */
+    g_value_init(&s1, G_TYPE_STRING);
+    g_value_init(&s2, G_TYPE_STRING);
+
+    if (t1 == G_TYPE_GSTRING)
+      g_value_set_static_string(&s1, ((GString *)g_value_get_boxed(v1))->str);
+    else
+      g_value_transform(v1, &s1);
+
+    if (t2 == G_TYPE_GSTRING)
+      g_value_set_static_string(&s2, ((GString *)g_value_get_boxed(v2))->str);
+    else
+      g_value_transform(v2, &s2);
+
+    result = strcmp(g_value_get_string(&s1), g_value_get_string(&s2));
+
+    g_value_unset(&s1);
+    g_value_unset(&s2);
+  }
   else if (g_value_type_transformable(t1, G_TYPE_STRING)
     && g_value_type_transformable(t2, G_TYPE_STRING))
   {
@@ -615,3 +708,105 @@ start:
   return value_compare_as_string(v1, v2, error);
 }
 
+/* murmur3 finalizer, spreads the bits of hashes combined by addition */
+static guint
+hash_mix(guint h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static guint
+hash_string(const gchar *string)
+{
+  return hash_mix(g_str_hash(string ? string : ""));
+}
+
+/**
+ * coil_value_hash: Hash the contents of @value
+ *
+ * Values equal by coil_value_compare() hash alike. Values that would be
+ * compared as strings hash their string, expandables hash their
+ * expanded value, lists hash their items in order and structs return
+ * coil_struct_get_content_hash().
+ *
+ * @value: A GValue or NULL.
+ * @hash: Return location for the hash.
+ * @error: A GError reference or NULL.
+ */
+COIL_API(gboolean)
+coil_value_hash(const GValue *value,
+                guint        *hash,
+                GError      **error)
+{
+  g_return_val_if_fail(hash, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  GType type;
+
+  if (value == NULL)
+  {
+    *hash = 0;
+    return TRUE;
+  }
+
+  type = G_VALUE_TYPE(value);
+
+  if (g_type_is_a(type, COIL_TYPE_STRUCT))
+    return coil_struct_get_content_hash(COIL_STRUCT(g_value_get_object(value)),
+                                        hash, error);
+
+  if (g_type_is_a(type, COIL_TYPE_EXPANDABLE))
+  {
+    if (!coil_expand_value(value, &value, TRUE, error))
+      return FALSE;
+
+    return coil_value_hash(value, hash, error);
+  }
+
+  if (type == G_TYPE_STRING)
+    *hash = hash_string(g_value_get_string(value));
+  else if (type == G_TYPE_GSTRING)
+    *hash = hash_string(((GString *)g_value_get_boxed(value))->str);
+  else if (type == COIL_TYPE_LIST)
+  {
+    GValueArray *list = (GValueArray *)g_value_get_boxed(value);
+    guint        i, item_hash, h = list->n_values;
+
+    for (i = 0; i < list->n_values; i++)
+    {
+      if (!coil_value_hash(g_value_array_get_nth(list, i), &item_hash, error))
+        return FALSE;
+
+      h = hash_mix(h * 31 + item_hash);
+    }
+
+    *hash = h;
+  }
+  else if (g_value_type_transformable(type, G_TYPE_STRING))
+  {
+    GValue  zero = {0, };
+    gchar  *string;
+
+    /* -0.0 compares equal to 0.0 */
+    if ((type == G_TYPE_DOUBLE && g_value_get_double(value) == 0.0)
+      || (type == G_TYPE_FLOAT && g_value_get_float(value) == 0.0f))
+    {
+      g_value_init(&zero, type);
+      value = &zero;
+    }
+
+    string = g_strdup_value_contents(value);
+    *hash = hash_string(string);
+    g_free(string);
+  }
+  else
+    *hash = hash_mix(GPOINTER_TO_UINT(g_value_peek_pointer(value)));
+
+  return TRUE;
+}
@@ -7,6 +7,7 @@
 #define __COIL_VALUE_H
 
 #include "format.h"
+#include "region.h"
 
 typedef struct _CoilNone      CoilNone;
 typedef struct _CoilNoneClass CoilNoneClass;
@@ -47,6 +48,16 @@ struct _CoilNoneClass
   }                                                         \
   G_STMT_END
 
+/* same as coil_value_init with the value allocated from region */
+#define coil_value_init_in(region, v_ptr, type, v_func, ptr) \
+  G_STMT_START                                              \
+  {                                                         \
+    v_ptr = coil_value_alloc_in(region);                    \
+    g_value_init(v_ptr, type);                              \
+    G_PASTE_ARGS(g_value_,v_func)(v_ptr, ptr);              \
+  }                                                         \
+  G_STMT_END
+
 G_BEGIN_DECLS
 
 GType
@@ -55,6 +66,9 @@ coil_none_get_type(void) G_GNUC_CONST;
 GValue *
 coil_value_alloc(void);
 
+GValue *
+coil_value_alloc_in(CoilRegion *region);
+
 GValue *
 coil_value_copy(const GValue *value);
 
@@ -64,9 +78,17 @@ coil_value_list_copy(const GList *value_list);
 void
 coil_value_free(gpointer value);
 
+void
+coil_value_free_in(CoilRegion *region,
+                   gpointer    value);
+
 void
 coil_value_list_free(GList *list);
 
+void
+coil_value_list_free_in(CoilRegion *region,
+                        GList      *list);
+
 void
 free_string_list(GList *list);
 
@@ -86,6 +108,11 @@ coil_value_compare(const GValue *,
                    const GValue *,
                    GError      **);
 
+gboolean
+coil_value_hash(const GValue *value,
+                guint        *hash,
+                GError      **error);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Batch insert benchmark.
+ *
+ * Generates paths of --keys keys in each of --sections structs nested
+ * two levels deep, in a shuffled order, and inserts them into a new
+ * root one at a time with coil_struct_insert() and all at once with
+ * coil_struct_insert_batch(). The best of --rounds rounds is reported
+ * and the two roots are compared, any difference fails the run.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_sections = 500;
+static gint num_keys = 1000;
+static gint num_rounds = 3;
+
+static const GOptionEntry entries[] =
+{
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of structs holding keys.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each struct.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {NULL}
+};
+
+static GPtrArray *
+generate_paths(void)
+{
+  GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+  GRand     *rand = g_rand_new_with_seed(42);
+  gint       i, j;
+  guint      k;
+
+  for (i = 0; i < num_sections; i++)
+    for (j = 0; j < num_keys; j++)
+      g_ptr_array_add(paths, g_strdup_printf("group%d.section%d.key%d",
+                                             i % 10, i, j));
+
+  /* generators rarely emit paths grouped by struct */
+  for (k = paths->len - 1; k > 0; k--)
+  {
+    guint    n = g_rand_int_range(rand, 0, k + 1);
+    gpointer tmp = paths->pdata[k];
+
+    paths->pdata[k] = paths->pdata[n];
+    paths->pdata[n] = tmp;
+  }
+
+  g_rand_free(rand);
+
+  return paths;
+}
+
+/* paths and values are made before timing, either way takes them */
+static CoilStructItem *
+generate_items(GPtrArray *paths)
+{
+  CoilStructItem *items = g_new(CoilStructItem, paths->len);
+  guint           i;
+
+  for (i = 0; i < paths->len; i++)
+  {
+    items[i].path = g_strdup(g_ptr_array_index(paths, i));
+    items[i].path_len = strlen(items[i].path);
+    coil_value_init(items[i].value, G_TYPE_INT, set_int, i);
+  }
+
+  return items;
+}
+
+static CoilStruct *
+insert_each(GPtrArray *paths,
+            gdouble   *t)
+{
+  GError         *error = NULL;
+  GTimer         *timer = g_timer_new();
+  CoilStruct     *root = coil_struct_new(NULL, NULL);
+  CoilStructItem *items = generate_items(paths);
+  guint           i;
+
+  g_timer_start(timer);
+
+  for (i = 0; i < paths->len; i++)
+  {
+    if (!coil_struct_insert(root, items[i].path, items[i].path_len,
+                            items[i].value, FALSE, &error))
+      g_error("%s", error->message);
+  }
+
+  *t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  g_free(items);
+
+  return root;
+}
+
+static CoilStruct *
+insert_batch(GPtrArray *paths,
+             gdouble   *t)
+{
+  GError         *error = NULL;
+  GTimer         *timer = g_timer_new();
+  CoilStruct     *root = coil_struct_new(NULL, NULL);
+  CoilStructItem *items = generate_items(paths);
+
+  g_timer_start(timer);
+
+  if (!coil_struct_insert_batch(root, items, paths->len, FALSE, &error))
+    g_error("%s", error->message);
+
+  *t = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  g_free(items);
+
+  return root;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError     *error = NULL;
+  GPtrArray  *paths = generate_paths();
+  CoilStruct *each, *batch;
+  gdouble     t, best_each = G_MAXDOUBLE, best_batch = G_MAXDOUBLE;
+  gboolean    identical = TRUE;
+  gint        round;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    each = insert_each(paths, &t);
+    best_each = MIN(best_each, t);
+
+    batch = insert_batch(paths, &t);
+    best_batch = MIN(best_batch, t);
+
+    if (round == 0)
+    {
+      identical = coil_struct_equals(each, batch, &error);
+      if (error)
+        g_error("%s", error->message);
+    }
+
+    g_object_unref(each);
+    g_object_unref(batch);
+  }
+
+  g_print("%u keys in %d structs, best of %d rounds\n",
+          paths->len, num_sections, num_rounds);
+  g_print("  %-12s %10.3f ms\n", "insert", best_each * 1e3);
+  g_print("  %-12s %10.3f ms %10.1fx%s\n", "batch",
+          best_batch * 1e3, best_each / MAX(best_batch, 1e-9),
+          identical ? "" : "  differs from insert");
+
+  g_ptr_array_free(paths, TRUE);
+
+  return identical;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_sections <= 0 || num_keys <= 0 || num_rounds <= 0)
+    return "--sections, --keys and --rounds must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark batch inserts",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
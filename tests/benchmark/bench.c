@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Shared harness for the benchmarks in this directory.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+/* parse a generated document, there is no point going on if it fails */
+CoilStruct *
+bench_parse_string(const gchar *document)
+{
+  GError     *error = NULL;
+  CoilStruct *root;
+
+  root = coil_parse_string(document, &error);
+  if (root == NULL)
+    g_error("%s", error->message);
+
+  return root;
+}
+
+int
+main(int    argc,
+     char **argv)
+{
+  GError         *error = NULL;
+  GOptionContext *context;
+  const gchar    *message;
+  gchar          *document = NULL;
+  gboolean        result;
+
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+  g_thread_init(NULL);
+#endif
+
+  context = g_option_context_new(benchmark.parameter_string);
+  g_option_context_add_main_entries(context, benchmark.entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+    g_error("%s", error->message);
+
+  g_option_context_free(context);
+
+  if (benchmark.check_options
+    && (message = benchmark.check_options()) != NULL)
+    g_error("%s", message);
+
+  coil_init();
+
+  if (benchmark.generate_document)
+    document = benchmark.generate_document();
+
+  result = benchmark.run(document);
+  g_free(document);
+
+  return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+#ifndef __COIL_BENCH_H
+#define __COIL_BENCH_H
+
+#include "coil.h"
+
+/*
+ * Each benchmark defines a CoilBench named benchmark. main() in bench.c
+ * parses its options, checks them, calls coil_init() and runs it on the
+ * generated document.
+ */
+typedef struct _CoilBench CoilBench;
+
+struct _CoilBench
+{
+  const gchar        *parameter_string; /* shown by --help */
+  const GOptionEntry *entries;
+
+  /* message for options that cannot be used, NULL when they are fine */
+  const gchar      *(*check_options)(void);
+
+  /* optional, called after coil_init(), the result is freed after run */
+  gchar            *(*generate_document)(void);
+
+  /* FALSE fails the run */
+  gboolean          (*run)(const gchar *document);
+};
+
+G_BEGIN_DECLS
+
+extern const CoilBench benchmark;
+
+CoilStruct *
+bench_parse_string(const gchar *document);
+
+G_END_DECLS
+
+#endif
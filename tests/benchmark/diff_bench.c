@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Structural diff benchmark.
+ *
+ * Generates a document a of --sections nested structs holding --keys
+ * keys each, and a document b like a but for --changes keys set to
+ * other values, a key of the last struct removed and a key added to
+ * the first. Times coil_struct_diff() of a and b, once with the content
+ * hashes still to compute and again with the hashes kept, then applies
+ * the patch to a with coil_struct_apply_patch() and times that against
+ * parsing b. Finally a is compared with b and any difference fails the
+ * run.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_sections = 200;
+static gint num_keys = 50;
+static gint num_changes = 10;
+
+static const GOptionEntry entries[] =
+{
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of nested structs in each document.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each nested struct.", "<integer>"},
+
+  {"changes", 'c', 0, G_OPTION_ARG_INT, &num_changes,
+      "Number of keys set to other values in b.", "<integer>"},
+
+  {NULL}
+};
+
+/* changed[i * num_keys + j] is set when key j of section i changes */
+static gboolean *
+generate_changes(guint *n_changed)
+{
+  gboolean *changed = g_new0(gboolean, num_sections * num_keys);
+  gint      c, i;
+
+  *n_changed = 0;
+
+  for (c = 0; c < num_changes; c++)
+  {
+    i = ((c * 7) % num_sections) * num_keys + (c * 13) % num_keys;
+
+    if (!changed[i])
+      (*n_changed)++;
+
+    changed[i] = TRUE;
+  }
+
+  return changed;
+}
+
+static gchar *
+generate_document(const gboolean *changed)
+{
+  GString *buffer = g_string_new(NULL);
+  gint     i, j;
+
+  for (i = 0; i < num_sections; i++)
+  {
+    g_string_append_printf(buffer, "section%d: {\n", i);
+
+    for (j = 0; j < num_keys; j++)
+    {
+      if (changed && changed[i * num_keys + j])
+        g_string_append_printf(buffer, "  key%d: 'changed'\n", j);
+      else
+        g_string_append_printf(buffer, "  key%d: %d\n", j, i * num_keys + j);
+    }
+
+    if (changed ? i == 0 : i == num_sections - 1)
+      g_string_append(buffer, "  extra: [1 2 3]\n");
+
+    g_string_append(buffer, "}\n");
+  }
+
+  return g_string_free(buffer, FALSE);
+}
+
+static CoilPatch *
+diff(CoilStruct *a,
+     CoilStruct *b)
+{
+  GError    *error = NULL;
+  CoilPatch *patch;
+
+  patch = coil_struct_diff(a, b, &error);
+  if (patch == NULL)
+    g_error("%s", error->message);
+
+  return patch;
+}
+
+static gchar *
+to_string(CoilStruct *root)
+{
+  GError          *error = NULL;
+  CoilStringFormat format = default_string_format;
+  gchar           *string;
+
+  string = coil_struct_to_string(root, &format, &error);
+  if (string == NULL)
+    g_error("%s", error->message);
+
+  return string;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError     *error = NULL;
+  GTimer     *timer = g_timer_new();
+  CoilStruct *a, *b, *parsed;
+  CoilPatch  *patch;
+  gboolean   *changed;
+  gchar      *doc_a, *doc_b, *expect, *result;
+  gdouble     t_cold, t_diff, t_apply, t_parse;
+  guint       n_changed, size;
+  gboolean    identical;
+
+  changed = generate_changes(&n_changed);
+  doc_a = generate_document(NULL);
+  doc_b = generate_document(changed);
+
+  a = bench_parse_string(doc_a);
+  b = bench_parse_string(doc_b);
+
+  g_timer_start(timer);
+  patch = diff(a, b);
+  t_cold = g_timer_elapsed(timer, NULL);
+  coil_patch_free(patch);
+
+  g_timer_start(timer);
+  patch = diff(a, b);
+  t_diff = g_timer_elapsed(timer, NULL);
+
+  /* changed keys, the removed key and the added key */
+  size = coil_patch_get_size(patch);
+  if (size != n_changed + 2)
+    g_error("Expecting %u changes, found %u.", n_changed + 2, size);
+
+  g_timer_start(timer);
+
+  if (!coil_struct_apply_patch(a, patch, &error))
+    g_error("%s", error->message);
+
+  t_apply = g_timer_elapsed(timer, NULL);
+  coil_patch_free(patch);
+
+  g_timer_start(timer);
+  parsed = bench_parse_string(doc_b);
+  t_parse = g_timer_elapsed(timer, NULL);
+  g_object_unref(parsed);
+
+  patch = diff(a, b);
+  size = coil_patch_get_size(patch);
+  coil_patch_free(patch);
+
+  expect = to_string(b);
+  result = to_string(a);
+  identical = size == 0 && strcmp(expect, result) == 0;
+
+  g_print("%d structs of %d keys, %u changes\n",
+          num_sections, num_keys, n_changed + 2);
+  g_print("  %-12s %10.3f ms\n", "first diff", t_cold * 1e3);
+  g_print("  %-12s %10.3f ms %10.1fx\n", "diff",
+          t_diff * 1e3, t_cold / MAX(t_diff, 1e-9));
+  g_print("  %-12s %10.3f ms\n", "reparse", t_parse * 1e3);
+  g_print("  %-12s %10.3f ms %10.1fx%s\n", "apply",
+          t_apply * 1e3, t_parse / MAX(t_apply, 1e-9),
+          identical ? "" : "  differs from b");
+
+  g_free(expect);
+  g_free(result);
+  g_object_unref(a);
+  g_object_unref(b);
+  g_free(doc_a);
+  g_free(doc_b);
+  g_free(changed);
+  g_timer_destroy(timer);
+
+  return identical;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_sections < 2 || num_keys <= 0 || num_changes < 0)
+    return "--sections must be at least 2, --keys positive "
+           "and --changes not negative.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark structural diffs",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
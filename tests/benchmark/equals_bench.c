@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Struct equality benchmark.
+ *
+ * Generates structs a and b of --sections nested structs holding --keys
+ * keys each, with the keys of b in reverse order, and a struct c like a
+ * but for its last key. Times coil_struct_equals() of a and b, which
+ * are equal, and of a and c, which are not, once with the content
+ * hashes still to compute and --iterations times with the hashes kept.
+ * Finally a key of a is set and set back, checking the content hash of
+ * the root changes and comes back.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_sections = 100;
+static gint num_keys = 100;
+static gint num_iterations = 1000;
+
+static const GOptionEntry entries[] =
+{
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of nested structs in each struct compared.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each nested struct.", "<integer>"},
+
+  {"iterations", 'i', 0, G_OPTION_ARG_INT, &num_iterations,
+      "Number of comparisons timed once the hashes are kept.", "<integer>"},
+
+  {NULL}
+};
+
+static void
+append_struct(GString     *buffer,
+              const gchar *name,
+              gboolean     reverse,
+              gint         last_value)
+{
+  gint i, j, k;
+
+  g_string_append_printf(buffer, "%s: {\n", name);
+
+  for (i = 0; i < num_sections; i++)
+  {
+    g_string_append_printf(buffer, "  section%d: {\n", i);
+
+    for (j = 0; j < num_keys; j++)
+    {
+      k = reverse ? num_keys - j - 1 : j;
+
+      g_string_append_printf(buffer, "    key%d: %d\n", k,
+                             (i == num_sections - 1 && k == num_keys - 1)
+                               ? last_value : i * num_keys + k);
+    }
+
+    g_string_append(buffer, "  }\n");
+  }
+
+  g_string_append(buffer, "}\n");
+}
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer = g_string_new(NULL);
+  gint     last = num_sections * num_keys - 1;
+
+  append_struct(buffer, "a", FALSE, last);
+  append_struct(buffer, "b", TRUE, last);
+  append_struct(buffer, "c", FALSE, -1);
+
+  return g_string_free(buffer, FALSE);
+}
+
+static CoilStruct *
+get_struct(CoilStruct  *root,
+           const gchar *path)
+{
+  GError       *error = NULL;
+  const GValue *value;
+
+  value = coil_struct_lookup(root, path, strlen(path), TRUE, &error);
+  if (value == NULL)
+    g_error("%s", error ? error->message : "missing struct");
+
+  return COIL_STRUCT(g_value_get_object(value));
+}
+
+static guint
+get_content_hash(CoilStruct *node)
+{
+  GError *error = NULL;
+  guint   hash;
+
+  if (!coil_struct_get_content_hash(node, &hash, &error))
+    g_error("%s", error->message);
+
+  return hash;
+}
+
+/* seconds per comparison of x and y, which should be equal or not */
+static gdouble
+time_equals(CoilStruct *x,
+            CoilStruct *y,
+            gboolean    expect,
+            gint        iterations)
+{
+  GError  *error = NULL;
+  GTimer  *timer = g_timer_new();
+  gdouble  t;
+  gint     i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    if (coil_struct_equals(x, y, &error) != expect || error)
+      g_error("%s", error ? error->message : "unexpected comparison");
+  }
+
+  t = g_timer_elapsed(timer, NULL) / iterations;
+  g_timer_destroy(timer);
+
+  return t;
+}
+
+static void
+check_change(CoilStruct *root,
+             CoilStruct *a)
+{
+  GError *error = NULL;
+  GValue *value;
+  gchar  *path;
+  guint   before, after;
+
+  before = get_content_hash(root);
+
+  path = g_strdup("section0.key0");
+  coil_value_init(value, G_TYPE_INT, set_int, -1);
+  if (!coil_struct_insert(a, path, strlen(path), value, TRUE, &error))
+    g_error("%s", error->message);
+
+  after = get_content_hash(root);
+  if (after == before)
+    g_error("Content hash did not change with a key.");
+
+  path = g_strdup("section0.key0");
+  coil_value_init(value, G_TYPE_INT, set_int, 0);
+  if (!coil_struct_insert(a, path, strlen(path), value, TRUE, &error))
+    g_error("%s", error->message);
+
+  after = get_content_hash(root);
+  if (after != before)
+    g_error("Content hash did not come back with a key.");
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  CoilStruct *root, *a, *b, *c;
+  gdouble     t_cold, t_equal, t_differ;
+
+  root = bench_parse_string(document);
+
+  a = get_struct(root, "a");
+  b = get_struct(root, "b");
+  c = get_struct(root, "c");
+
+  t_cold = time_equals(a, b, TRUE, 1);
+  t_equal = time_equals(a, b, TRUE, num_iterations);
+  t_differ = time_equals(a, c, FALSE, num_iterations);
+
+  if (get_content_hash(a) != get_content_hash(b))
+    g_error("Equal structs hash differently.");
+
+  check_change(root, a);
+
+  g_print("%d structs of %d keys\n", num_sections, num_keys);
+  g_print("  %-12s %10.3f ms\n", "first", t_cold * 1e3);
+  g_print("  %-12s %10.3f ms\n", "equal", t_equal * 1e3);
+  g_print("  %-12s %10.3f ms %10.1fx\n", "differ",
+          t_differ * 1e3, t_equal / MAX(t_differ, 1e-12));
+
+  g_object_unref(root);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_sections <= 0 || num_keys <= 0 || num_iterations <= 0)
+    return "--sections, --keys and --iterations must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark struct equality",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
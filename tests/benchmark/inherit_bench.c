@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Inheritance benchmark.
+ *
+ * Generates a base struct of --sections nested structs holding --keys
+ * keys each and --envs structs extending it, each overriding one key.
+ * Times the parse and a lookup of one inherited key in every env, then
+ * reports how many structs still share the entries of base and what
+ * the tree holds. With --expand-all every env is expanded completely
+ * afterwards, which is what every lookup cost when inherited structs
+ * were copied whole. An expanded env still holds every key it inherits,
+ * so the entries reported only shrink for envs that stay unexpanded.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_envs = 200;
+static gint num_sections = 50;
+static gint num_keys = 20;
+static gint num_rounds = 5;
+static gboolean expand_all = FALSE;
+
+static const GOptionEntry entries[] =
+{
+  {"envs", 'e', 0, G_OPTION_ARG_INT, &num_envs,
+      "Number of structs extending base.", "<integer>"},
+
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of nested structs in base.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each nested struct.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"expand-all", 0, 0, G_OPTION_ARG_NONE, &expand_all,
+      "Expand every env completely after the lookups.", NULL},
+
+  {NULL}
+};
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer = g_string_new("base: {\n");
+  gint     i, j;
+
+  for (i = 0; i < num_sections; i++)
+  {
+    g_string_append_printf(buffer, "  section%d: {\n", i);
+
+    for (j = 0; j < num_keys; j++)
+      g_string_append_printf(buffer, "    key%d: 'value %d %d'\n", j, i, j);
+
+    /* a link has to be copied into the context of each env */
+    g_string_append(buffer, "    link: =key0\n  }\n");
+  }
+
+  g_string_append(buffer, "}\n");
+
+  for (i = 0; i < num_envs; i++)
+    g_string_append_printf(buffer, "env%d: base { section%d.key0: %d }\n",
+                           i, i % MAX(num_sections, 1), i);
+
+  return g_string_free(buffer, FALSE);
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError          *error = NULL;
+  GTimer          *timer = g_timer_new();
+  CoilStruct      *root;
+  CoilStructStats  stats;
+  gdouble          best_parse = G_MAXDOUBLE, best_lookup = G_MAXDOUBLE, t;
+  gchar            path[64];
+  gint             round, i;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+    root = bench_parse_string(document);
+    t = g_timer_elapsed(timer, NULL);
+    best_parse = MIN(best_parse, t);
+
+    g_timer_start(timer);
+
+    for (i = 0; i < num_envs; i++)
+    {
+      const GValue *value;
+
+      g_snprintf(path, sizeof(path), "env%d.section%d.key1",
+                 i, (i + 1) % num_sections);
+
+      value = coil_struct_lookup(root, path, strlen(path), TRUE, &error);
+      if (value == NULL)
+        g_error("%s", error ? error->message : "missing inherited key");
+    }
+
+    if (expand_all && !coil_struct_expand_items(root, TRUE, &error))
+      g_error("%s", error->message);
+
+    t = g_timer_elapsed(timer, NULL);
+    best_lookup = MIN(best_lookup, t);
+
+    if (round == 0)
+      coil_struct_get_stats(root, &stats);
+
+    g_object_unref(root);
+  }
+
+  g_timer_destroy(timer);
+
+  g_print("%d envs extending %d structs of %d keys, best of %d rounds\n",
+          num_envs, num_sections, num_keys, num_rounds);
+
+  g_print("  %-12s %10.3f ms\n", "parse", best_parse * 1e3);
+  g_print("  %-12s %10.3f ms %10.1f us/env\n",
+          expand_all ? "expand-all" : "lookup",
+          best_lookup * 1e3, best_lookup * 1e6 / MAX(num_envs, 1));
+
+  g_print("  %-12s %10u (%u sharing entries)\n", "structs",
+          stats.structs, stats.shared);
+  g_print("  %-12s %10u\n", "entries", stats.entries);
+  g_print("  %-12s %10u\n", "links", stats.links);
+  g_print("  %-12s %10" G_GSIZE_FORMAT " bytes\n", "table memory",
+          stats.table.memory);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_envs <= 0 || num_sections <= 1 || num_keys <= 1 || num_rounds <= 0)
+    return "--envs and --rounds must be positive, "
+           "--sections and --keys at least 2.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark inheritance",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
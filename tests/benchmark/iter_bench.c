@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Struct iteration benchmark.
+ *
+ * Parses a generated document (or the coil files given on the command
+ * line) and times a walk over every entry of the tree with
+ * CoilStructIter, and what coildump --expand-all does: expand every
+ * value and print the tree. --delete removes every n-th key of each
+ * generated struct first so iteration also has to step over deleted
+ * entries.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gchar **files = NULL;
+
+static gint num_keys = 100000;
+static gint num_rounds = 5;
+static gint fanout = 16;
+static gint delete_every = 0;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of generated keys when no files are given.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"fanout", 0, 0, G_OPTION_ARG_INT, &fanout,
+      "Number of keys per generated struct.", "<integer>"},
+
+  {"delete", 'd', 0, G_OPTION_ARG_INT, &delete_every,
+      "Delete every n-th key of each generated struct.", "<integer>"},
+
+  {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, NULL},
+
+  {NULL}
+};
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer;
+  gint     i;
+
+  if (files)
+    return NULL;
+
+  buffer = g_string_sized_new(num_keys * 32);
+
+  for (i = 0; i < num_keys; i++)
+  {
+    if (i % fanout == 0)
+    {
+      if (i > 0)
+        g_string_append(buffer, "}\n");
+
+      /* every other section extends the one before to give expand work */
+      if (i / fanout % 2 == 1)
+        g_string_append_printf(buffer, "section%d: section%d {\n",
+                               i / fanout, i / fanout - 1);
+      else
+        g_string_append_printf(buffer, "section%d: {\n", i / fanout);
+    }
+
+    g_string_append_printf(buffer, "  key%d: %d\n", i, i);
+  }
+
+  if (num_keys > 0)
+    g_string_append(buffer, "}\n");
+
+  return g_string_free(buffer, FALSE);
+}
+
+static CoilStruct *
+parse_input(const gchar  *document,
+            GError      **error)
+{
+  CoilStruct     *root, *section;
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value;
+  gchar           key[32];
+  gint            i;
+
+  if (document == NULL)
+    return coil_parse_file(files[0], error);
+
+  root = coil_parse_string(document, error);
+  if (root == NULL || delete_every <= 0)
+    return root;
+
+  coil_struct_iter_init(&it, root);
+
+  while (coil_struct_iter_next(&it, &path, &value))
+  {
+    gint n = g_ascii_strtoll(path->key + strlen("section"), NULL, 10);
+
+    section = COIL_STRUCT(g_value_get_object(value));
+
+    for (i = 0; i < fanout; i += delete_every)
+    {
+      g_snprintf(key, sizeof(key), "key%d", n * fanout + i);
+
+      if (!coil_struct_delete(section, key, strlen(key), FALSE, error))
+      {
+        g_object_unref(root);
+        return NULL;
+      }
+    }
+  }
+
+  return root;
+}
+
+static guint
+iterate_tree(CoilStruct *node)
+{
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value;
+  guint           n = 0;
+
+  coil_struct_iter_init(&it, node);
+
+  while (coil_struct_iter_next(&it, &path, &value))
+  {
+    n++;
+
+    if (value && G_VALUE_HOLDS(value, COIL_TYPE_STRUCT))
+    {
+      CoilStruct *object = COIL_STRUCT(g_value_get_object(value));
+
+      if (!coil_struct_is_prototype(object))
+        n += iterate_tree(object);
+    }
+  }
+
+  return n;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError          *error = NULL;
+  GTimer          *timer = g_timer_new();
+  CoilStruct      *root;
+  CoilStructStats  stats;
+  CoilStringFormat format = default_string_format;
+  GString         *buffer = g_string_sized_new(8192);
+  gdouble          best_iter = G_MAXDOUBLE, best_expand = G_MAXDOUBLE, t;
+  guint            visited = 0;
+  gint             round;
+
+  format.options |= FORCE_EXPAND;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    root = parse_input(document, &error);
+    if (root == NULL)
+      g_error("%s", error->message);
+
+    /* expand and print like coildump --expand-all */
+    g_timer_start(timer);
+
+    if (!coil_struct_expand_items(root, TRUE, &error))
+      g_error("%s", error->message);
+
+    coil_struct_build_string(root, buffer, &format, &error);
+    if (error)
+      g_error("%s", error->message);
+
+    t = g_timer_elapsed(timer, NULL);
+    best_expand = MIN(best_expand, t);
+    g_string_truncate(buffer, 0);
+
+    /* once expanded, walk the whole tree */
+    g_timer_start(timer);
+    visited = iterate_tree(root);
+    t = g_timer_elapsed(timer, NULL);
+    best_iter = MIN(best_iter, t);
+
+    if (round == 0)
+      coil_struct_get_stats(root, &stats);
+
+    g_object_unref(root);
+  }
+
+  g_timer_destroy(timer);
+  g_string_free(buffer, TRUE);
+
+  g_print("%u entries in %u structs, best of %d rounds\n",
+          stats.entries, stats.structs, num_rounds);
+
+  g_print("  %-12s %10.3f ms %10.1f ns/entry\n", "iterate",
+          best_iter * 1e3, best_iter * 1e9 / MAX(visited, 1));
+  g_print("  %-12s %10.3f ms %10.1f ns/entry\n", "expand-all",
+          best_expand * 1e3, best_expand * 1e9 / MAX(stats.entries, 1));
+
+  g_strfreev(files);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0 || fanout <= 0 || delete_every < 0)
+    return "--keys, --rounds and --fanout must be positive, "
+           "--delete not negative.";
+
+  if (files && delete_every > 0)
+    return "--delete only applies to the generated document.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "[file] - benchmark struct iteration",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Change notification benchmark.
+ *
+ * Changes to a struct used to be reported by emitting a "modify" signal
+ * on the struct and on each of its containers, and batches were started
+ * and ended by setting the "accumulate" property. Both are now plain
+ * field accesses on the struct, "modify" is only emitted on structs with
+ * handlers connected. A struct --depth levels deep holding --keys keys
+ * is iterated with coil_struct_iter_next_expand(), which reports a
+ * change for every key, and with coil_struct_iter_next(), which does
+ * not. The difference is the cost of notifying observers. The same walk
+ * is then timed with --handlers "modify" handlers at every level.
+ * Finally the "accumulate" property is compared with
+ * coil_struct_begin_batch().
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_keys = 1000;
+static gint num_rounds = 5;
+static gint num_iterations = 1000;
+static gint depth = 4;
+static gint num_handlers = 1;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in the innermost struct.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"iterations", 'i', 0, G_OPTION_ARG_INT, &num_iterations,
+      "Number of walks over the keys in each round.", "<integer>"},
+
+  {"depth", 'd', 0, G_OPTION_ARG_INT, &depth,
+      "Number of containers above the innermost struct.", "<integer>"},
+
+  {"handlers", 0, 0, G_OPTION_ARG_INT, &num_handlers,
+      "Number of \"modify\" handlers connected at every level.",
+      "<integer>"},
+
+  {NULL}
+};
+
+static gpointer
+bench_handler(CoilStruct *instance,
+              gpointer    data)
+{
+  (*(guint *)data)++;
+
+  return NULL;
+}
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer = g_string_new(NULL);
+  gint     i;
+
+  for (i = 0; i < depth; i++)
+    g_string_append_printf(buffer, "level%d: {\n", i);
+
+  for (i = 0; i < num_keys; i++)
+    g_string_append_printf(buffer, "  key%d: %d\n", i, i);
+
+  for (i = 0; i < depth; i++)
+    g_string_append(buffer, "}\n");
+
+  return g_string_free(buffer, FALSE);
+}
+
+static CoilStruct *
+get_innermost(CoilStruct *root)
+{
+  GError       *error = NULL;
+  GString      *path = g_string_new(NULL);
+  const GValue *value;
+  gint          i;
+
+  if (depth == 0)
+    return root;
+
+  for (i = 0; i < depth; i++)
+    g_string_append_printf(path, "%slevel%d", i ? "." : "", i);
+
+  value = coil_struct_lookup(root, path->str, path->len, TRUE, &error);
+  if (value == NULL)
+    g_error("%s", error ? error->message : "missing innermost struct");
+
+  g_string_free(path, TRUE);
+
+  return COIL_STRUCT(g_value_get_object(value));
+}
+
+static gdouble
+time_walk(CoilStruct *node,
+          gboolean    notify)
+{
+  GError         *error = NULL;
+  GTimer         *timer = g_timer_new();
+  CoilStructIter  it;
+  const GValue   *value;
+  gdouble         t, best = G_MAXDOUBLE;
+  gint            round, i;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+
+    for (i = 0; i < num_iterations; i++)
+    {
+      coil_struct_iter_init(&it, node);
+
+      if (notify)
+      {
+        while (coil_struct_iter_next_expand(&it, NULL, &value, FALSE, &error))
+          ;
+
+        if (error)
+          g_error("%s", error->message);
+      }
+      else
+      {
+        while (coil_struct_iter_next(&it, NULL, &value))
+          ;
+      }
+    }
+
+    t = g_timer_elapsed(timer, NULL);
+    best = MIN(best, t);
+  }
+
+  g_timer_destroy(timer);
+
+  return best;
+}
+
+static gdouble
+time_batch(CoilStruct *node,
+           gboolean    property)
+{
+  GTimer  *timer = g_timer_new();
+  gdouble  t, best = G_MAXDOUBLE;
+  gint     round, i;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+
+    for (i = 0; i < num_iterations * num_keys; i++)
+    {
+      if (property)
+      {
+        g_object_set(G_OBJECT(node), "accumulate", TRUE, NULL);
+        g_object_set(G_OBJECT(node), "accumulate", FALSE, NULL);
+      }
+      else
+      {
+        coil_struct_begin_batch(node);
+        coil_struct_end_batch(node);
+      }
+    }
+
+    t = g_timer_elapsed(timer, NULL);
+    best = MIN(best, t);
+  }
+
+  g_timer_destroy(timer);
+
+  return best;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  CoilStruct *root, *node, *level;
+  gdouble     t_walk, t_notify, t_signal, t_property, t_batch;
+  gdouble     n = (gdouble)num_iterations * num_keys;
+  guint       calls = 0;
+  gint        i;
+
+  root = bench_parse_string(document);
+
+  node = get_innermost(root);
+
+  t_walk = time_walk(node, FALSE);
+  t_notify = time_walk(node, TRUE);
+
+  for (level = node; level; level = coil_struct_get_container(level))
+    for (i = 0; i < num_handlers; i++)
+      g_signal_connect(level, "modify",
+                       G_CALLBACK(bench_handler), &calls);
+
+  t_signal = time_walk(node, TRUE);
+
+  if (num_handlers > 0 && calls == 0)
+    g_error("\"modify\" was not emitted.");
+
+  t_property = time_batch(node, TRUE);
+  t_batch = time_batch(node, FALSE);
+
+  g_print("%d keys %d levels deep, %d handlers per level, "
+          "best of %d rounds\n",
+          num_keys, depth, num_handlers, num_rounds);
+
+  g_print("notify\n");
+  g_print("  %-12s %10.1f ns/key\n", "iterate", t_walk * 1e9 / n);
+  g_print("  %-12s %10.1f ns/key\n", "observer",
+          (t_notify - t_walk) * 1e9 / n);
+  g_print("  %-12s %10.1f ns/key %10.1fx\n", "modify",
+          (t_signal - t_walk) * 1e9 / n,
+          (t_signal - t_walk) / MAX(t_notify - t_walk, 1e-9));
+
+  g_print("batch\n");
+  g_print("  %-12s %10.1f ns/batch\n", "property", t_property * 1e9 / n);
+  g_print("  %-12s %10.1f ns/batch %10.1fx\n", "field",
+          t_batch * 1e9 / n, t_property / MAX(t_batch, 1e-9));
+
+  g_object_unref(root);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0 || num_iterations <= 0
+    || depth < 0 || num_handlers < 0)
+    return "--keys, --rounds and --iterations must be positive, "
+           "--depth and --handlers not negative.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark change notification",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
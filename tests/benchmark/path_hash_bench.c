@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Path hash benchmark.
+ *
+ * Compares the path hash against the previous byte at a time DJB hash
+ * on absolute paths collected from coil files, or generated paths when
+ * no files are given. Reports hashing throughput and the chain lengths
+ * each hash produces in a chained table with one bucket per key.
+ *
+ * Set COIL_HASH_SEED to reproduce chain lengths between runs.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+#include "struct_table.h"
+
+#define MAX_CHAIN_HISTOGRAM 8
+
+static gchar **files = NULL;
+
+static gint num_keys = 100000;
+static gint num_rounds = 5;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of generated paths when no files are given.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, NULL},
+
+  {NULL}
+};
+
+typedef guint (*PathHashFunc)(const gchar *path, guint path_len);
+
+static guint
+djb_hash_path(const gchar *path,
+              guint        path_len)
+{
+  const guchar *p = (const guchar *)path + COIL_ROOT_PATH_LEN;
+  const guchar *end = (const guchar *)path + path_len;
+  guint         hash = 0;
+
+  while (p < end)
+    hash = hash * 33 + *p++;
+
+  return hash;
+}
+
+static gboolean
+collect_paths(GPtrArray   *paths,
+              CoilStruct  *node,
+              GError     **error)
+{
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value;
+
+  if (!coil_struct_expand(node, error))
+    return FALSE;
+
+  coil_struct_iter_init(&it, node);
+
+  while (coil_struct_iter_next(&it, &path, &value))
+  {
+    g_ptr_array_add(paths, coil_path_ref((CoilPath *)path));
+
+    if (value && G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+      && !collect_paths(paths, COIL_STRUCT(g_value_get_object(value)), error))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+load_paths(GPtrArray  *paths,
+           GError    **error)
+{
+  gchar **file;
+  gint    i;
+
+  if (files == NULL)
+  {
+    for (i = 0; i < num_keys; i++)
+    {
+      gchar *str = g_strdup_printf(COIL_ROOT_PATH ".section%d.key%d",
+                                   i / 64, i);
+
+      g_ptr_array_add(paths,
+                      coil_path_take_strings(str, strlen(str), NULL, 0, 0));
+    }
+
+    return TRUE;
+  }
+
+  for (file = files; *file; file++)
+  {
+    CoilStruct *root;
+    gboolean    res;
+
+    root = coil_parse_file(*file, error);
+    if (root == NULL)
+      return FALSE;
+
+    res = collect_paths(paths, root, error);
+    g_object_unref(root);
+
+    if (!res)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+report_throughput(const gchar     *name,
+                  PathHashFunc     hash_func,
+                  const GPtrArray *paths)
+{
+  guint    i, sink = 0;
+  gint     round;
+  gsize    bytes = 0;
+  gdouble  t, best = G_MAXDOUBLE;
+  GTimer  *timer = g_timer_new();
+
+  for (i = 0; i < paths->len; i++)
+    bytes += ((const CoilPath *)g_ptr_array_index(paths, i))->path_len;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+
+    for (i = 0; i < paths->len; i++)
+    {
+      const CoilPath *p = g_ptr_array_index(paths, i);
+
+      sink += hash_func(p->path, p->path_len);
+    }
+
+    t = g_timer_elapsed(timer, NULL);
+    best = MIN(best, t);
+  }
+
+  g_timer_destroy(timer);
+
+  g_print("%s (sink %08x)\n", name, sink);
+  g_print("  %-16s %10.1f ns/path %10.1f MB/s\n", "throughput",
+          best * 1e9 / paths->len, bytes / best / (1 << 20));
+}
+
+static void
+report_chains(PathHashFunc     hash_func,
+              const GPtrArray *paths)
+{
+  guint     i, n = paths->len, mask, max_chain = 0, used = 0;
+  guint    *chains;
+  guint64   probes = 0;
+  guint     histogram[MAX_CHAIN_HISTOGRAM + 1] = {0};
+  GString  *hist = g_string_new(NULL);
+
+  /* one bucket per key rounded up to a power of 2, like the table */
+  mask = n;
+  for (i = 1; i < 32; i <<= 1)
+    mask |= mask >> i;
+
+  chains = g_new0(guint, mask + 1);
+
+  for (i = 0; i < n; i++)
+  {
+    const CoilPath *p = g_ptr_array_index(paths, i);
+
+    chains[hash_func(p->path, p->path_len) & mask]++;
+  }
+
+  for (i = 0; i <= mask; i++)
+  {
+    guint c = chains[i];
+
+    histogram[MIN(c, MAX_CHAIN_HISTOGRAM)]++;
+    max_chain = MAX(max_chain, c);
+    used += c > 0;
+
+    /* each key costs its position in the chain to find */
+    probes += (guint64)c * (c + 1) / 2;
+  }
+
+  for (i = 0; i <= MAX_CHAIN_HISTOGRAM; i++)
+    g_string_append_printf(hist, " %u%s:%u", i,
+                           i == MAX_CHAIN_HISTOGRAM ? "+" : "", histogram[i]);
+
+  g_print("  %-16s %10u\n", "buckets", mask + 1);
+  g_print("  %-16s %10u\n", "used buckets", used);
+  g_print("  %-16s %10u\n", "max chain", max_chain);
+  g_print("  %-16s %10.3f\n", "probes per hit", (gdouble)probes / n);
+  g_print("  %-16s%s\n", "histogram", hist->str);
+
+  g_string_free(hist, TRUE);
+  g_free(chains);
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError    *error = NULL;
+  GPtrArray *paths;
+
+  paths = g_ptr_array_new_with_free_func((GDestroyNotify)coil_path_unref);
+
+  if (!load_paths(paths, &error))
+    g_error("%s", error->message);
+
+  if (paths->len == 0)
+    g_error("No paths to hash.");
+
+  g_print("%u paths, best of %d rounds\n\n", paths->len, num_rounds);
+
+  report_throughput("djb33", djb_hash_path, paths);
+  report_chains(djb_hash_path, paths);
+
+  g_print("\n");
+
+  report_throughput("path hash", hash_absolute_path, paths);
+  report_chains(hash_absolute_path, paths);
+
+  g_ptr_array_free(paths, TRUE);
+  g_strfreev(files);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0)
+    return "--keys and --rounds must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "[file ...] - benchmark path hashing",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
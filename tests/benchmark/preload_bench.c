@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Include preloading benchmark.
+ *
+ * Writes --files coil files of --sections sections holding --keys keys,
+ * each section extending the one before and holding a link, and each
+ * file including one more file --depth levels deep. A main file
+ * includes all of them in a struct of its own. The main file is parsed
+ * and expanded with coil_struct_expand_items() as the reference, then
+ * again after coil_struct_preload_includes() parsed the included files
+ * on 1 up to --threads threads. Expansion itself stays serial. Every
+ * result is printed and compared with the reference and any difference
+ * fails the run.
+ */
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+static gint num_files = 32;
+static gint num_sections = 50;
+static gint num_keys = 20;
+static gint depth = 1;
+static gint num_rounds = 3;
+static gint num_threads = 4;
+
+static const GOptionEntry entries[] =
+{
+  {"files", 'f', 0, G_OPTION_ARG_INT, &num_files,
+      "Number of files included by the main file.", "<integer>"},
+
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of sections in each file.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each section.", "<integer>"},
+
+  {"depth", 'd', 0, G_OPTION_ARG_INT, &depth,
+      "Number of levels of files included by each file.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"threads", 't', 0, G_OPTION_ARG_INT, &num_threads,
+      "Largest number of threads to time.", "<integer>"},
+
+  {NULL}
+};
+
+static gchar *
+file_path(const gchar *dir,
+          gint         file,
+          gint         level)
+{
+  gchar *name = g_strdup_printf("file%d_%d.coil", file, level);
+  gchar *path = g_build_filename(dir, name, NULL);
+
+  g_free(name);
+
+  return path;
+}
+
+static void
+write_file(const gchar *path,
+           const gchar *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents(path, contents, -1, &error))
+    g_error("%s", error->message);
+}
+
+static gchar *
+write_files(void)
+{
+  GString *buffer = g_string_new(NULL);
+  gchar   *dir, *path;
+  gint     i, j, k, level;
+
+  dir = g_build_filename(g_get_tmp_dir(), "coil-preload-bench-XXXXXX", NULL);
+  if (mkdtemp(dir) == NULL)
+    g_error("Unable to create a temporary directory.");
+
+  for (i = 0; i < num_files; i++)
+  {
+    for (level = 0; level < depth; level++)
+    {
+      g_string_truncate(buffer, 0);
+
+      for (j = 0; j < num_sections; j++)
+      {
+        if (j > 0)
+          g_string_append_printf(buffer, "section%d: section%d {\n",
+                                 j, j - 1);
+        else
+          g_string_append(buffer, "section0: {\n");
+
+        for (k = 0; k < num_keys; k++)
+          g_string_append_printf(buffer, "  key%d_%d: 'file %d level %d'\n",
+                                 j, k, i, level);
+
+        g_string_append_printf(buffer, "  link: =key%d_0\n}\n", j);
+      }
+
+      if (level + 1 < depth)
+      {
+        path = file_path(dir, i, level + 1);
+        g_string_append_printf(buffer, "nested: { @file: '%s' }\n", path);
+        g_free(path);
+      }
+
+      path = file_path(dir, i, level);
+      write_file(path, buffer->str);
+      g_free(path);
+    }
+  }
+
+  g_string_truncate(buffer, 0);
+
+  for (i = 0; i < num_files; i++)
+  {
+    path = file_path(dir, i, 0);
+    g_string_append_printf(buffer, "block%d: { @file: '%s' }\n", i, path);
+    g_free(path);
+  }
+
+  path = g_build_filename(dir, "main.coil", NULL);
+  write_file(path, buffer->str);
+  g_free(path);
+
+  g_string_free(buffer, TRUE);
+
+  return dir;
+}
+
+static void
+remove_files(const gchar *dir)
+{
+  gchar *path;
+  gint   i, level;
+
+  for (i = 0; i < num_files; i++)
+  {
+    for (level = 0; level < depth; level++)
+    {
+      path = file_path(dir, i, level);
+      g_unlink(path);
+      g_free(path);
+    }
+  }
+
+  path = g_build_filename(dir, "main.coil", NULL);
+  g_unlink(path);
+  g_free(path);
+
+  g_rmdir(dir);
+}
+
+/* threads is 0 to expand without preloading */
+static gdouble
+time_expand(const gchar *main_path,
+            gint         threads,
+            gchar      **result)
+{
+  GError          *error = NULL;
+  GTimer          *timer = g_timer_new();
+  CoilStruct      *root;
+  CoilStringFormat format = default_string_format;
+  gdouble          t, best = G_MAXDOUBLE;
+  gboolean         expanded;
+  gint             round;
+
+  format.options |= FORCE_EXPAND;
+  *result = NULL;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    root = coil_parse_file(main_path, &error);
+    if (root == NULL)
+      g_error("%s", error->message);
+
+    g_timer_start(timer);
+
+    expanded = (threads == 0
+                || coil_struct_preload_includes(root, threads, &error))
+      && coil_struct_expand_items(root, TRUE, &error);
+
+    t = g_timer_elapsed(timer, NULL);
+
+    if (!expanded)
+      g_error("%s", error->message);
+
+    best = MIN(best, t);
+
+    if (round == 0)
+    {
+      *result = coil_struct_to_string(root, &format, &error);
+      if (*result == NULL)
+        g_error("%s", error->message);
+    }
+
+    g_object_unref(root);
+  }
+
+  g_timer_destroy(timer);
+
+  return best;
+}
+
+static gboolean
+time_files(const gchar *dir)
+{
+  gchar    *main_path = g_build_filename(dir, "main.coil", NULL);
+  gchar    *expect, *result;
+  gdouble   t_serial, t;
+  gboolean  identical = TRUE;
+  gint      threads;
+
+  t_serial = time_expand(main_path, 0, &expect);
+
+  g_print("%d files of %d sections of %d keys, %d levels deep, "
+          "best of %d rounds\n",
+          num_files, num_sections, num_keys, depth, num_rounds);
+
+  g_print("  %-12s %10.3f ms\n", "serial", t_serial * 1e3);
+
+  for (threads = 1; threads <= num_threads; threads++)
+  {
+    t = time_expand(main_path, threads, &result);
+
+    g_print("  %2d %-9s %10.3f ms %10.2fx%s\n",
+            threads, threads == 1 ? "thread" : "threads", t * 1e3,
+            t_serial / MAX(t, 1e-9),
+            strcmp(result, expect) ? "  differs from serial" : "");
+
+    identical &= strcmp(result, expect) == 0;
+    g_free(result);
+  }
+
+  g_free(expect);
+  g_free(main_path);
+
+  return identical;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  gchar    *dir;
+  gboolean  identical;
+
+  dir = write_files();
+  identical = time_files(dir);
+  remove_files(dir);
+  g_free(dir);
+
+  return identical;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_files <= 0 || num_sections <= 0 || num_keys <= 0
+    || depth <= 0 || num_rounds <= 0 || num_threads <= 0)
+    return "--files, --sections, --keys, --depth, --rounds "
+           "and --threads must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark preloading included files before a serial expansion",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
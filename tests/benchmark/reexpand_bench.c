@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Re-expansion benchmark.
+ *
+ * Generates a base struct of --keys keys, each with an expression and a
+ * link reading it, and --envs structs extending base and overriding one
+ * key each. Once everything is expanded a key of base is set --rounds
+ * times with coil_struct_insert() and the key, expression and link of
+ * every env are looked up again. The same is timed parsing the changed
+ * document from scratch. Finally the changed tree is compared with the
+ * changed document parsed and any difference fails the run.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_envs = 100;
+static gint num_keys = 50;
+static gint num_rounds = 50;
+
+static const GOptionEntry entries[] =
+{
+  {"envs", 'e', 0, G_OPTION_ARG_INT, &num_envs,
+      "Number of structs extending base.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in base.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of keys set in base.", "<integer>"},
+
+  {NULL}
+};
+
+static gchar *
+generate_document(const gint *values)
+{
+  GString *buffer = g_string_new("base: {\n");
+  gint     i;
+
+  for (i = 0; i < num_keys; i++)
+    g_string_append_printf(buffer,
+                           "  key%d: %d\n"
+                           "  expr%d: '${key%d} of %d'\n"
+                           "  link%d: =key%d\n",
+                           i, values[i], i, i, num_keys, i, i);
+
+  g_string_append(buffer, "}\n");
+
+  for (i = 0; i < num_envs; i++)
+    g_string_append_printf(buffer, "env%d: base { key%d: 'env %d' }\n",
+                           i, i % num_keys, i);
+
+  return g_string_free(buffer, FALSE);
+}
+
+static gchar *
+expanded_string(CoilStruct *root)
+{
+  GError          *error = NULL;
+  CoilStringFormat format = default_string_format;
+  gchar           *string;
+
+  format.options |= FORCE_EXPAND;
+
+  string = coil_struct_to_string(root, &format, &error);
+  if (string == NULL)
+    g_error("%s", error->message);
+
+  return string;
+}
+
+/* what a change to key of base may have changed */
+static void
+lookup_key(CoilStruct *root,
+           gint        key)
+{
+  GError       *error = NULL;
+  const gchar  *names[] = {"key", "expr", "link"};
+  gchar        *path;
+  guint         n;
+  gint          i;
+
+  for (i = 0; i < num_envs; i++)
+  {
+    for (n = 0; n < G_N_ELEMENTS(names); n++)
+    {
+      path = g_strdup_printf("env%d.%s%d", i, names[n], key);
+
+      if (!coil_struct_lookup(root, path, strlen(path), TRUE, &error))
+        g_error("%s", error ? error->message : "missing path in tree");
+
+      g_free(path);
+    }
+  }
+}
+
+/*
+ * Expands every env before base, links copied from base are resolved
+ * in the env then. Trees compared are expanded the same way.
+ */
+static void
+lookup_all(CoilStruct *root)
+{
+  gint key;
+
+  for (key = 0; key < num_keys; key++)
+    lookup_key(root, key);
+}
+
+static CoilStruct *
+parse_document(const gint *values)
+{
+  CoilStruct *root;
+  gchar      *document = generate_document(values);
+
+  root = bench_parse_string(document);
+  g_free(document);
+
+  return root;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError     *error = NULL;
+  GTimer     *timer = g_timer_new();
+  CoilStruct *root, *parsed = NULL;
+  GValue     *value;
+  gint       *values = g_new(gint, num_keys);
+  gchar      *path, *expect, *result;
+  gdouble     t_insert = 0, t_parse = 0;
+  gboolean    identical;
+  gint        round, key;
+
+  for (key = 0; key < num_keys; key++)
+    values[key] = key;
+
+  root = parse_document(values);
+  lookup_all(root);
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    key = (round * 7) % num_keys;
+    values[key] = num_keys + round;
+
+    g_timer_start(timer);
+
+    path = g_strdup_printf("base.key%d", key);
+    coil_value_init(value, G_TYPE_INT, set_int, values[key]);
+
+    if (!coil_struct_insert(root, path, strlen(path), value, TRUE, &error))
+      g_error("%s", error->message);
+
+    lookup_key(root, key);
+
+    t_insert += g_timer_elapsed(timer, NULL);
+
+    if (parsed)
+      g_object_unref(parsed);
+
+    g_timer_start(timer);
+
+    parsed = parse_document(values);
+    lookup_key(parsed, key);
+
+    t_parse += g_timer_elapsed(timer, NULL);
+  }
+
+  g_object_unref(parsed);
+
+  parsed = parse_document(values);
+  lookup_all(parsed);
+
+  expect = expanded_string(parsed);
+  result = expanded_string(root);
+  identical = strcmp(expect, result) == 0;
+
+  g_print("%d envs extending %d keys, %d keys set\n",
+          num_envs, num_keys, num_rounds);
+
+  g_print("  %-12s %10.3f ms/key\n", "reparse",
+          t_parse * 1e3 / num_rounds);
+  g_print("  %-12s %10.3f ms/key %10.1fx%s\n", "insert",
+          t_insert * 1e3 / num_rounds, t_parse / MAX(t_insert, 1e-9),
+          identical ? "" : "  differs from reparse");
+
+  g_free(expect);
+  g_free(result);
+  g_object_unref(parsed);
+  g_object_unref(root);
+  g_free(values);
+  g_timer_destroy(timer);
+
+  return identical;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_envs <= 0 || num_keys <= 0 || num_rounds <= 0)
+    return "--envs, --keys and --rounds must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark re-expansion after changes",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
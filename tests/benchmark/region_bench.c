@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Benchmark for root allocation and teardown.
+ *
+ * Parses a generated document (or the coil files given on the command
+ * line) and times the parse and the final unref of the root separately.
+ * Run once against a build with --enable-region-alloc and once without
+ * to compare. With the region enabled the number of region allocations
+ * and blocks is reported as well; without it every entry chunk and value
+ * is a separate allocation.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gchar **files = NULL;
+
+static gint num_keys = 100000;
+static gint num_rounds = 5;
+static gint fanout = 16;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of generated keys when no files are given.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"fanout", 0, 0, G_OPTION_ARG_INT, &fanout,
+      "Number of keys per generated struct.", "<integer>"},
+
+  {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, NULL},
+
+  {NULL}
+};
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer;
+  gint     i;
+
+  if (files)
+    return NULL;
+
+  buffer = g_string_sized_new(num_keys * 24);
+
+  for (i = 0; i < num_keys; i++)
+  {
+    if (i % fanout == 0)
+    {
+      if (i > 0)
+        g_string_append(buffer, "}\n");
+
+      g_string_append_printf(buffer, "section%d: {\n", i / fanout);
+    }
+
+    /* a mix of value types so each kind of value box is allocated */
+    switch (i % 3)
+    {
+      case 0:
+        g_string_append_printf(buffer, "  key%d: %d\n", i, i);
+        break;
+      case 1:
+        g_string_append_printf(buffer, "  key%d: 'value%d'\n", i, i);
+        break;
+      default:
+        g_string_append_printf(buffer, "  key%d: %d.5\n", i, i);
+        break;
+    }
+  }
+
+  if (num_keys > 0)
+    g_string_append(buffer, "}\n");
+
+  return g_string_free(buffer, FALSE);
+}
+
+static CoilStruct *
+parse_input(const gchar  *document,
+            GError      **error)
+{
+  if (document)
+    return coil_parse_string(document, error);
+
+  /* only the first file is timed, the rest are parsed for validation */
+  return coil_parse_file(files[0], error);
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError          *error = NULL;
+  GTimer          *timer = g_timer_new();
+  CoilStruct      *root;
+  CoilStructStats  stats;
+  gdouble          best_parse = G_MAXDOUBLE, best_free = G_MAXDOUBLE, t;
+  gchar          **file;
+  gint             round;
+#if COIL_REGION_ALLOC
+  CoilRegionStats  region_stats;
+#endif
+
+  if (document == NULL)
+  {
+    for (file = files + 1; *file; file++)
+    {
+      root = coil_parse_file(*file, &error);
+      if (root == NULL)
+        g_error("%s", error->message);
+
+      g_object_unref(root);
+    }
+  }
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+    root = parse_input(document, &error);
+    t = g_timer_elapsed(timer, NULL);
+
+    if (root == NULL)
+      g_error("%s", error->message);
+
+    best_parse = MIN(best_parse, t);
+
+    if (round == 0)
+    {
+      coil_struct_get_stats(root, &stats);
+#if COIL_REGION_ALLOC
+      coil_region_get_stats(coil_struct_get_region(root), &region_stats);
+#endif
+    }
+
+    g_timer_start(timer);
+    g_object_unref(root);
+    t = g_timer_elapsed(timer, NULL);
+
+    best_free = MIN(best_free, t);
+  }
+
+  g_timer_destroy(timer);
+
+  g_print("%u entries in %u structs, best of %d rounds\n",
+          stats.entries, stats.structs, num_rounds);
+
+  g_print("  %-12s %10.3f ms %10.1f ns/entry\n", "parse",
+          best_parse * 1e3, best_parse * 1e9 / MAX(stats.entries, 1));
+  g_print("  %-12s %10.3f ms %10.1f ns/entry\n", "teardown",
+          best_free * 1e3, best_free * 1e9 / MAX(stats.entries, 1));
+
+#if COIL_REGION_ALLOC
+  g_print("  %-12s %10" G_GSIZE_FORMAT " in %u blocks "
+          "(%" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes used)\n",
+          "region", region_stats.allocations, region_stats.blocks,
+          region_stats.bytes, region_stats.memory);
+#else
+  g_print("  %-12s disabled, configure with --enable-region-alloc\n",
+          "region");
+#endif
+
+  g_strfreev(files);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0 || fanout <= 0)
+    return "--keys, --rounds and --fanout must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "[file ...] - benchmark root teardown",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Snapshot benchmark.
+ *
+ * Generates a base struct of --sections nested structs holding --keys
+ * keys and a link each, and --envs structs extending it. Times
+ * coil_struct_freeze() on the root, checks that every path looks up
+ * the same value in the snapshot as in the tree, then times lookups of
+ * every key and link of every env in the tree and in the snapshot.
+ * Finally --threads threads look up the same paths in the snapshot at
+ * once.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_envs = 50;
+static gint num_sections = 20;
+static gint num_keys = 20;
+static gint num_rounds = 5;
+static gint num_iterations = 10;
+static gint num_threads = 4;
+
+static const GOptionEntry entries[] =
+{
+  {"envs", 'e', 0, G_OPTION_ARG_INT, &num_envs,
+      "Number of structs extending base.", "<integer>"},
+
+  {"sections", 's', 0, G_OPTION_ARG_INT, &num_sections,
+      "Number of nested structs in base.", "<integer>"},
+
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of keys in each nested struct.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"iterations", 'i', 0, G_OPTION_ARG_INT, &num_iterations,
+      "Number of lookups of every path in each round.", "<integer>"},
+
+  {"threads", 't', 0, G_OPTION_ARG_INT, &num_threads,
+      "Number of threads looking up paths in the snapshot.", "<integer>"},
+
+  {NULL}
+};
+
+typedef struct _LookupJob
+{
+  const CoilSnapshot *snapshot;
+  GPtrArray          *paths;
+  guint              *lens;
+  guint               misses;
+} LookupJob;
+
+static gchar *
+generate_document(void)
+{
+  GString *buffer = g_string_new("base: {\n");
+  gint     i, j;
+
+  for (i = 0; i < num_sections; i++)
+  {
+    g_string_append_printf(buffer, "  section%d: {\n", i);
+
+    for (j = 0; j < num_keys; j++)
+      g_string_append_printf(buffer, "    key%d: %d\n", j, i * num_keys + j);
+
+    g_string_append(buffer, "    link: =key0\n  }\n");
+  }
+
+  g_string_append(buffer, "}\n");
+
+  for (i = 0; i < num_envs; i++)
+    g_string_append_printf(buffer, "env%d: base { section%d.key0: 'env %d' }\n",
+                           i, i % num_sections, i);
+
+  return g_string_free(buffer, FALSE);
+}
+
+static GPtrArray *
+generate_paths(void)
+{
+  GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+  gint       i, j, k;
+
+  for (i = 0; i < num_envs; i++)
+  {
+    for (j = 0; j < num_sections; j++)
+    {
+      for (k = 0; k < num_keys; k++)
+        g_ptr_array_add(paths,
+                        g_strdup_printf("env%d.section%d.key%d", i, j, k));
+
+      g_ptr_array_add(paths, g_strdup_printf("env%d.section%d.link", i, j));
+    }
+  }
+
+  return paths;
+}
+
+static void
+check_snapshot(CoilStruct         *root,
+               const CoilSnapshot *snapshot,
+               GPtrArray          *paths,
+               const guint        *lens)
+{
+  GError       *error = NULL;
+  const GValue *expect, *value;
+  guint         i;
+
+  for (i = 0; i < paths->len; i++)
+  {
+    const gchar *path = g_ptr_array_index(paths, i);
+
+    expect = coil_struct_lookup(root, path, lens[i], TRUE, &error);
+    if (expect == NULL)
+      g_error("%s", error ? error->message : "missing path in tree");
+
+    value = coil_snapshot_lookup(snapshot, path, lens[i]);
+    if (value == NULL)
+      g_error("'%s' is missing from the snapshot.", path);
+
+    if (coil_value_compare(expect, value, &error) != 0 || error)
+      g_error("'%s' differs in the snapshot.", path);
+  }
+
+  if (coil_snapshot_lookup(snapshot, "no.such.path", strlen("no.such.path")))
+    g_error("Found a path missing from the tree in the snapshot.");
+}
+
+static guint
+lookup_snapshot(const CoilSnapshot *snapshot,
+                GPtrArray          *paths,
+                const guint        *lens)
+{
+  guint misses = 0, i;
+  gint  n;
+
+  for (n = 0; n < num_iterations; n++)
+    for (i = 0; i < paths->len; i++)
+      misses += coil_snapshot_lookup(snapshot,
+                                     g_ptr_array_index(paths, i),
+                                     lens[i]) == NULL;
+
+  return misses;
+}
+
+static gpointer
+lookup_thread(gpointer data)
+{
+  LookupJob *job = data;
+
+  job->misses = lookup_snapshot(job->snapshot, job->paths, job->lens);
+
+  return NULL;
+}
+
+static gdouble
+time_threads(const CoilSnapshot *snapshot,
+             GPtrArray          *paths,
+             guint              *lens)
+{
+  GTimer     *timer = g_timer_new();
+  GThread   **threads = g_new(GThread *, num_threads);
+  LookupJob  *jobs = g_new(LookupJob, num_threads);
+  gdouble     t, best = G_MAXDOUBLE;
+  gint        round, i;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    g_timer_start(timer);
+
+    for (i = 0; i < num_threads; i++)
+    {
+      jobs[i].snapshot = snapshot;
+      jobs[i].paths = paths;
+      jobs[i].lens = lens;
+      jobs[i].misses = 0;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+      threads[i] = g_thread_new("lookup", lookup_thread, &jobs[i]);
+#else
+      threads[i] = g_thread_create(lookup_thread, &jobs[i], TRUE, NULL);
+#endif
+    }
+
+    for (i = 0; i < num_threads; i++)
+    {
+      g_thread_join(threads[i]);
+
+      if (jobs[i].misses)
+        g_error("%u lookups missed in thread %d.", jobs[i].misses, i);
+    }
+
+    t = g_timer_elapsed(timer, NULL);
+    best = MIN(best, t);
+  }
+
+  g_free(jobs);
+  g_free(threads);
+  g_timer_destroy(timer);
+
+  return best;
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError            *error = NULL;
+  GTimer            *timer = g_timer_new();
+  CoilStruct        *root = NULL;
+  CoilSnapshot      *snapshot = NULL;
+  CoilSnapshotStats  stats;
+  GPtrArray         *paths = generate_paths();
+  guint             *lens = g_new(guint, paths->len);
+  gdouble            best_freeze = G_MAXDOUBLE, best_live = G_MAXDOUBLE;
+  gdouble            best_snapshot = G_MAXDOUBLE, t_threads, t;
+  gdouble            n = (gdouble)num_iterations * paths->len;
+  guint              i;
+  gint               round, k;
+
+  for (i = 0; i < paths->len; i++)
+    lens[i] = strlen(g_ptr_array_index(paths, i));
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    if (snapshot)
+    {
+      coil_snapshot_unref(snapshot);
+      g_object_unref(root);
+    }
+
+    root = bench_parse_string(document);
+
+    g_timer_start(timer);
+    snapshot = coil_struct_freeze(root, &error);
+    t = g_timer_elapsed(timer, NULL);
+
+    if (snapshot == NULL)
+      g_error("%s", error->message);
+
+    best_freeze = MIN(best_freeze, t);
+
+    if (round == 0)
+      check_snapshot(root, snapshot, paths, lens);
+
+    /* the tree is fully expanded by now, as is the snapshot */
+    g_timer_start(timer);
+
+    for (k = 0; k < num_iterations; k++)
+    {
+      for (i = 0; i < paths->len; i++)
+      {
+        if (!coil_struct_lookup(root, g_ptr_array_index(paths, i),
+                                lens[i], TRUE, &error))
+          g_error("%s", error ? error->message : "missing path in tree");
+      }
+    }
+
+    t = g_timer_elapsed(timer, NULL);
+    best_live = MIN(best_live, t);
+
+    g_timer_start(timer);
+
+    if (lookup_snapshot(snapshot, paths, lens))
+      g_error("Lookups missed in the snapshot.");
+
+    t = g_timer_elapsed(timer, NULL);
+    best_snapshot = MIN(best_snapshot, t);
+  }
+
+  t_threads = time_threads(snapshot, paths, lens);
+
+  coil_snapshot_get_stats(snapshot, &stats);
+
+  g_print("%d envs extending %d structs of %d keys, best of %d rounds\n",
+          num_envs, num_sections, num_keys, num_rounds);
+
+  g_print("  %-12s %10.3f ms\n", "freeze", best_freeze * 1e3);
+  g_print("  %-12s %10.1f ns/lookup\n", "tree", best_live * 1e9 / n);
+  g_print("  %-12s %10.1f ns/lookup %10.1fx\n", "snapshot",
+          best_snapshot * 1e9 / n, best_live / MAX(best_snapshot, 1e-9));
+  g_print("  %-12s %10.1f ns/lookup %10.1fx (%d threads)\n", "threads",
+          t_threads * 1e9 / (n * num_threads),
+          best_snapshot * num_threads / MAX(t_threads, 1e-9), num_threads);
+
+  g_print("  %-12s %10u in %u slots, %u buckets\n", "paths",
+          stats.size, stats.slots, stats.buckets);
+  g_print("  %-12s %10" G_GSIZE_FORMAT " bytes\n", "memory", stats.memory);
+
+  coil_snapshot_unref(snapshot);
+  g_object_unref(root);
+  g_free(lens);
+  g_ptr_array_free(paths, TRUE);
+  g_timer_destroy(timer);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_envs <= 0 || num_sections <= 0 || num_keys <= 0
+    || num_rounds <= 0 || num_iterations <= 0 || num_threads <= 0)
+    return "--envs, --sections, --keys, --rounds, --iterations "
+           "and --threads must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark frozen snapshots",
+  entries,
+  check_options,
+  generate_document,
+  run_benchmark,
+};
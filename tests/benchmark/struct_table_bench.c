@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Microbenchmark for the struct path table.
+ *
+ * Times insert, lookup (hit and miss) and remove on a set of absolute
+ * paths, either generated or collected from coil files given on the
+ * command line. The table backend is selected at configure time so run
+ * once against a build with --enable-open-addressing and once without
+ * to compare.
+ *
+ * Also reports the bytes the table holds per key once all keys are
+ * inserted, entries and index included but not the paths themselves.
+ *
+ * --hash-bits truncates the path hashes so that many keys collide, which
+ * shows what candidate comparisons cost. Run under
+ * "perf stat -e cache-misses,L1-dcache-load-misses" to count the cache
+ * misses of a lookup heavy workload (e.g. --rounds 50).
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+#include "struct_table.h"
+
+static gchar **files = NULL;
+
+static gint num_keys = 100000;
+static gint num_rounds = 5;
+static gint fanout = 16;
+static gint hash_bits = 32;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of generated paths when no files are given.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {"fanout", 0, 0, G_OPTION_ARG_INT, &fanout,
+      "Number of keys per struct for generated paths.", "<integer>"},
+
+  {"hash-bits", 0, 0, G_OPTION_ARG_INT, &hash_bits,
+      "Keep only the low bits of each path hash to force collisions.",
+      "<integer>"},
+
+  {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, NULL},
+
+  {NULL}
+};
+
+typedef struct _BenchKeys
+{
+  GPtrArray *paths;
+  GArray    *hashes;
+  GPtrArray *misses;
+  GArray    *miss_hashes;
+} BenchKeys;
+
+static guint
+bench_hash(const CoilPath *path)
+{
+  guint hash = hash_absolute_path(path->path, path->path_len);
+
+  if (hash_bits < 32)
+    hash &= (1u << hash_bits) - 1;
+
+  /* 0 is reserved for @root */
+  return hash ? hash : 1;
+}
+
+static void
+add_key(BenchKeys *keys,
+        CoilPath  *path)
+{
+  gchar    *miss_str;
+  CoilPath *miss;
+  guint     hash;
+
+  hash = bench_hash(path);
+  g_ptr_array_add(keys->paths, path);
+  g_array_append_val(keys->hashes, hash);
+
+  /* a sibling path which is never inserted */
+  miss_str = g_strdup_printf("%s_", path->path);
+  miss = coil_path_take_strings(miss_str, path->path_len + 1, NULL, 0, 0);
+  hash = bench_hash(miss);
+  g_ptr_array_add(keys->misses, miss);
+  g_array_append_val(keys->miss_hashes, hash);
+}
+
+static void
+generate_keys(BenchKeys *keys)
+{
+  gint i;
+
+  for (i = 0; i < num_keys; i++)
+  {
+    gchar *str;
+    guint  len;
+
+    str = g_strdup_printf(COIL_ROOT_PATH ".section%d.group%d.key%d",
+                          i / (fanout * fanout), (i / fanout) % fanout, i);
+    len = strlen(str);
+
+    add_key(keys, coil_path_take_strings(str, len, NULL, 0, 0));
+  }
+}
+
+static gboolean
+collect_keys(BenchKeys   *keys,
+             CoilStruct  *node,
+             GError     **error)
+{
+  CoilStructIter  it;
+  const CoilPath *path;
+  const GValue   *value;
+
+  if (!coil_struct_expand(node, error))
+    return FALSE;
+
+  coil_struct_iter_init(&it, node);
+
+  while (coil_struct_iter_next(&it, &path, &value))
+  {
+    add_key(keys, coil_path_copy(path));
+
+    if (value && G_VALUE_HOLDS(value, COIL_TYPE_STRUCT)
+      && !collect_keys(keys, COIL_STRUCT(g_value_get_object(value)), error))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+load_keys(BenchKeys  *keys,
+          GError    **error)
+{
+  gchar **file;
+
+  if (files == NULL)
+  {
+    generate_keys(keys);
+    return TRUE;
+  }
+
+  for (file = files; *file; file++)
+  {
+    CoilStruct *root;
+    gboolean    res;
+
+    root = coil_parse_file(*file, error);
+    if (root == NULL)
+      return FALSE;
+
+    res = collect_keys(keys, root, error);
+    g_object_unref(root);
+
+    if (!res)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+report(const gchar *name,
+       gdouble      best,
+       guint        n)
+{
+  g_print("  %-12s %10.1f ns/op %12.0f op/s\n",
+          name, best * 1e9 / n, n / best);
+}
+
+/* slowest single insert, which includes any resize work it triggers */
+static gdouble
+worst_insert(const BenchKeys *keys,
+             GTimer          *timer)
+{
+  guint        i;
+  gdouble      t, last, worst = 0;
+  StructTable *table = struct_table_new();
+
+  g_timer_start(timer);
+  last = 0;
+
+  for (i = 0; i < keys->paths->len; i++)
+  {
+    CoilPath *path = g_ptr_array_index(keys->paths, i);
+
+    struct_table_insert(table, g_array_index(keys->hashes, guint, i),
+                        coil_path_ref(path), NULL);
+
+    t = g_timer_elapsed(timer, NULL);
+    worst = MAX(worst, t - last);
+    last = t;
+  }
+
+  struct_table_unref(table);
+
+  return worst;
+}
+
+static void
+time_table(const BenchKeys *keys)
+{
+  guint        i, n = keys->paths->len, found;
+  gint         round;
+  gdouble      best_insert = G_MAXDOUBLE, best_hit = G_MAXDOUBLE,
+               best_miss = G_MAXDOUBLE, best_remove = G_MAXDOUBLE,
+               best_worst = G_MAXDOUBLE, t;
+  gsize        memory = 0;
+  GTimer      *timer = g_timer_new();
+  StructTable *table;
+
+#define TIME_BEST(best, stmt) \
+  G_STMT_START \
+  { \
+    g_timer_start(timer); \
+    stmt; \
+    t = g_timer_elapsed(timer, NULL); \
+    if (t < best) \
+      best = t; \
+  } \
+  G_STMT_END
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    table = struct_table_new();
+
+    TIME_BEST(best_insert,
+      for (i = 0; i < n; i++)
+      {
+        CoilPath *path = g_ptr_array_index(keys->paths, i);
+
+        struct_table_insert(table, g_array_index(keys->hashes, guint, i),
+                            coil_path_ref(path), NULL);
+      });
+
+    found = 0;
+    TIME_BEST(best_hit,
+      for (i = 0; i < n; i++)
+      {
+        const CoilPath *path = g_ptr_array_index(keys->paths, i);
+
+        found += struct_table_lookup(table,
+                                     g_array_index(keys->hashes, guint, i),
+                                     path->path, path->path_len) != NULL;
+      });
+
+    if (found != n)
+      g_error("Expected %u hits but found %u.", n, found);
+
+    memory = struct_table_get_memory(table);
+
+    found = 0;
+    TIME_BEST(best_miss,
+      for (i = 0; i < n; i++)
+      {
+        const CoilPath *path = g_ptr_array_index(keys->misses, i);
+
+        found += struct_table_lookup(table,
+                                     g_array_index(keys->miss_hashes, guint, i),
+                                     path->path, path->path_len) != NULL;
+      });
+
+    if (found != 0)
+      g_error("Expected no hits but found %u.", found);
+
+    TIME_BEST(best_remove,
+      for (i = 0; i < n; i++)
+      {
+        const CoilPath *path = g_ptr_array_index(keys->paths, i);
+
+        struct_table_delete(table, g_array_index(keys->hashes, guint, i),
+                            path->path, path->path_len);
+      });
+
+    struct_table_unref(table);
+
+    best_worst = MIN(best_worst, worst_insert(keys, timer));
+  }
+
+#undef TIME_BEST
+
+  g_timer_destroy(timer);
+
+  g_print("%s table, %u keys, best of %d rounds\n",
+#if COIL_OPEN_ADDRESSING
+          "open addressing",
+#else
+          "chained",
+#endif
+          n, num_rounds);
+
+  report("insert", best_insert, n);
+  report("lookup hit", best_hit, n);
+  report("lookup miss", best_miss, n);
+  report("remove", best_remove, n);
+
+  g_print("  %-12s %10.1f us\n", "worst insert", best_worst * 1e6);
+  g_print("  %-12s %10.1f bytes/key (%" G_GSIZE_FORMAT " bytes/entry)\n",
+          "memory", (gdouble)memory / n, sizeof(StructEntry));
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  GError    *error = NULL;
+  BenchKeys  keys;
+
+  keys.paths = g_ptr_array_new_with_free_func((GDestroyNotify)coil_path_unref);
+  keys.misses = g_ptr_array_new_with_free_func((GDestroyNotify)coil_path_unref);
+  keys.hashes = g_array_new(FALSE, FALSE, sizeof(guint));
+  keys.miss_hashes = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  if (!load_keys(&keys, &error))
+    g_error("%s", error->message);
+
+  time_table(&keys);
+
+  g_ptr_array_free(keys.paths, TRUE);
+  g_ptr_array_free(keys.misses, TRUE);
+  g_array_free(keys.hashes, TRUE);
+  g_array_free(keys.miss_hashes, TRUE);
+  g_strfreev(files);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0 || fanout <= 0)
+    return "--keys, --rounds and --fanout must be positive.";
+
+  if (hash_bits <= 0 || hash_bits > 32)
+    return "--hash-bits must be between 1 and 32.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "[file ...] - benchmark struct path table",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2009, 2010, 2011
+ *
+ * Author: John O'Connor
+ */
+
+/*
+ * Key and path validation benchmark.
+ *
+ * Key and path validation used to match COIL_KEY_REGEX and
+ * COIL_PATH_REGEX with GRegex. Both ways are timed on generated keys and
+ * paths, tests/unit/validate.suite checks that they agree.
+ */
+
+#include "bench.h"
+
+#include <string.h>
+
+static gint num_keys = 1000000;
+static gint num_rounds = 5;
+
+static const GOptionEntry entries[] =
+{
+  {"keys", 'k', 0, G_OPTION_ARG_INT, &num_keys,
+      "Number of generated keys and paths to time.", "<integer>"},
+
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &num_rounds,
+      "Number of rounds, the best round is reported.", "<integer>"},
+
+  {NULL}
+};
+
+typedef gboolean (*ValidateFunc)(const gchar *str, guint len);
+
+static GRegex *key_regex = NULL;
+static GRegex *path_regex = NULL;
+
+/* how validation was done before, kept as the reference */
+static gboolean
+regex_validate_key(const gchar *key,
+                   guint        key_len)
+{
+  return g_regex_match_full(key_regex, key, key_len, 0, 0, NULL, NULL);
+}
+
+static gboolean
+regex_validate_path(const gchar *path,
+                    guint        path_len)
+{
+  return g_regex_match_full(path_regex, path, path_len, 0, 0, NULL, NULL);
+}
+
+static GPtrArray *
+generate_strings(gboolean paths)
+{
+  GPtrArray *strings = g_ptr_array_new_with_free_func(g_free);
+  gint       i;
+
+  for (i = 0; i < num_keys; i++)
+  {
+    if (paths)
+      g_ptr_array_add(strings,
+                      g_strdup_printf(COIL_ROOT_PATH ".section%d.sub-%d.key_%d",
+                                      i / 64, i / 8, i));
+    else
+      g_ptr_array_add(strings, g_strdup_printf("some_key-%d", i));
+  }
+
+  return strings;
+}
+
+static gdouble
+time_validate(ValidateFunc     validate,
+              const GPtrArray *strings,
+              const guint     *lens)
+{
+  GTimer  *timer = g_timer_new();
+  gdouble  t, best = G_MAXDOUBLE;
+  guint    i, valid;
+  gint     round;
+
+  for (round = 0; round < num_rounds; round++)
+  {
+    valid = 0;
+    g_timer_start(timer);
+
+    for (i = 0; i < strings->len; i++)
+      valid += validate(g_ptr_array_index(strings, i), lens[i]);
+
+    t = g_timer_elapsed(timer, NULL);
+    best = MIN(best, t);
+
+    if (valid != strings->len)
+      g_error("%u of %u generated strings did not validate.",
+              strings->len - valid, strings->len);
+  }
+
+  g_timer_destroy(timer);
+
+  return best;
+}
+
+static void
+report(const gchar  *name,
+       ValidateFunc  regex_func,
+       ValidateFunc  table_func,
+       gboolean      paths)
+{
+  GPtrArray *strings = generate_strings(paths);
+  guint     *lens = g_new(guint, strings->len);
+  gdouble    t_regex, t_table;
+  guint      i;
+
+  for (i = 0; i < strings->len; i++)
+    lens[i] = strlen(g_ptr_array_index(strings, i));
+
+  t_regex = time_validate(regex_func, strings, lens);
+  t_table = time_validate(table_func, strings, lens);
+
+  g_print("%s\n", name);
+  g_print("  %-12s %10.1f ns/%s\n", "regex",
+          t_regex * 1e9 / strings->len, name);
+  g_print("  %-12s %10.1f ns/%s %10.1fx\n", "table",
+          t_table * 1e9 / strings->len, name, t_regex / t_table);
+
+  g_free(lens);
+  g_ptr_array_free(strings, TRUE);
+}
+
+static gboolean
+run_benchmark(const gchar *document)
+{
+  key_regex = g_regex_new("^"COIL_KEY_REGEX"$",
+                          G_REGEX_OPTIMIZE,
+                          G_REGEX_MATCH_NOTEMPTY,
+                          NULL);
+
+  path_regex = g_regex_new("^"COIL_PATH_REGEX"$",
+                           G_REGEX_OPTIMIZE,
+                           G_REGEX_MATCH_NOTEMPTY,
+                           NULL);
+
+  report("key", regex_validate_key, coil_validate_key_len, FALSE);
+  report("path", regex_validate_path, coil_validate_path_len, TRUE);
+
+  g_regex_unref(key_regex);
+  g_regex_unref(path_regex);
+
+  return TRUE;
+}
+
+static const gchar *
+check_options(void)
+{
+  if (num_keys <= 0 || num_rounds <= 0)
+    return "--keys and --rounds must be positive.";
+
+  return NULL;
+}
+
+const CoilBench benchmark =
+{
+  "- benchmark key validation",
+  entries,
+  check_options,
+  NULL,
+  run_benchmark,
+};
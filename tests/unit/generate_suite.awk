@@ -30,7 +30,7 @@ END {
   print "int main(int argc, char **argv)"
   print "{"
   print "  g_test_init(&argc, &argv, NULL);"
-  print "  g_type_init();\n"
+  print "  coil_init();\n"
   for ( fn in tests )
   {
     printf("  g_test_add_func(\"/%s/%s\", %s%s);\n", suite, tests[fn],